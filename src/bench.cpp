@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+//
+#include "headless_context.h"
+#include "renderer.h"
+
+struct Options {
+  std::vector<glm::uvec2> resolutions = {{256, 256}, {512, 512}};
+  unsigned int samples = 32;
+  unsigned int warmup = 2;
+  SamplerType sampler_type = SamplerType::PCG;
+  std::string sampler = "pcg";
+  // scene specialized and generic shader variants
+  std::vector<bool> kernels = {true, false};
+  std::string json = "bench.json";
+};
+
+struct Result {
+  std::string scene;
+  std::string integrator;
+  std::string kernel;
+  glm::uvec2 resolution;
+  unsigned int samples;
+  double gpu_time;   // [s]
+  double wall_time;  // [s]
+  double rays;
+  double p50;  // [ms]
+  double p95;  // [ms]
+
+  double samplesPerSecond() const {
+    return static_cast<double>(samples) * resolution.x * resolution.y /
+           gpu_time;
+  }
+  double raysPerSecond() const { return rays / gpu_time; }
+  double msPerSample() const { return 1e3 * gpu_time / samples; }
+};
+
+void printUsage() {
+  std::cout << "Usage: bench [options]\n"
+            << "  --resolutions <WxH,WxH,...>  resolutions (default: "
+               "256x256,512x512)\n"
+            << "  --samples <n>                timed passes per case "
+               "(default: 32)\n"
+            << "  --warmup <n>                 untimed passes per case "
+               "(default: 2)\n"
+            << "  --sampler <name>             xorshift, sobol, bluenoise or "
+               "pcg\n"
+            << "                               (default: pcg)\n"
+            << "  --kernels <name,...>         specialized, generic "
+               "(default: both)\n"
+            << "  --json <file>                JSON report (default: "
+               "bench.json)\n";
+}
+
+[[noreturn]] void invalidArgument(const std::string& arg) {
+  std::cerr << "invalid argument: " << arg << std::endl;
+  printUsage();
+  std::exit(EXIT_FAILURE);
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      printUsage();
+      std::exit(EXIT_SUCCESS);
+    }
+
+    if (i + 1 >= argc) invalidArgument(arg);
+    const std::string value = argv[++i];
+
+    if (arg == "--resolutions") {
+      options.resolutions.clear();
+      size_t pos = 0;
+      while (pos < value.size()) {
+        size_t next = value.find(',', pos);
+        if (next == std::string::npos) next = value.size();
+        glm::uvec2 res;
+        if (std::sscanf(value.substr(pos, next - pos).c_str(), "%ux%u",
+                        &res.x, &res.y) != 2 ||
+            res.x == 0 || res.y == 0) {
+          invalidArgument(value);
+        }
+        options.resolutions.push_back(res);
+        pos = next + 1;
+      }
+    } else if (arg == "--samples") {
+      options.samples = std::max(1ul, std::stoul(value));
+    } else if (arg == "--warmup") {
+      options.warmup = std::stoul(value);
+    } else if (arg == "--sampler") {
+      if (value == "xorshift") {
+        options.sampler_type = SamplerType::XORShift;
+      } else if (value == "sobol") {
+        options.sampler_type = SamplerType::Sobol;
+      } else if (value == "bluenoise") {
+        options.sampler_type = SamplerType::BlueNoise;
+      } else if (value == "pcg") {
+        options.sampler_type = SamplerType::PCG;
+      } else {
+        invalidArgument(value);
+      }
+      options.sampler = value;
+    } else if (arg == "--kernels") {
+      options.kernels.clear();
+      size_t pos = 0;
+      while (pos < value.size()) {
+        size_t next = value.find(',', pos);
+        if (next == std::string::npos) next = value.size();
+        const std::string kernel = value.substr(pos, next - pos);
+        if (kernel == "specialized") {
+          options.kernels.push_back(true);
+        } else if (kernel == "generic") {
+          options.kernels.push_back(false);
+        } else {
+          invalidArgument(kernel);
+        }
+        pos = next + 1;
+      }
+      if (options.kernels.empty()) invalidArgument(value);
+    } else if (arg == "--json") {
+      options.json = value;
+    } else {
+      invalidArgument(arg);
+    }
+  }
+  return options;
+}
+
+// percentile of pass times(closest rank)
+double percentile(std::vector<double> values, double p) {
+  std::sort(values.begin(), values.end());
+  const size_t rank = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+  return values[rank];
+}
+
+Result runCase(Renderer& renderer, SceneType scene_type,
+               Integrator integrator, bool specialized,
+               const Options& options) {
+  renderer.setSceneType(scene_type);
+  renderer.setIntegrator(integrator);
+  renderer.setShaderSpecialization(specialized);
+  renderer.setSamplerType(options.sampler_type);
+
+  // warmup, also hides shader JIT on first draw
+  for (unsigned int i = 0; i < options.warmup; ++i) {
+    renderer.accumulate();
+  }
+  glFinish();
+  renderer.clear();
+
+  // time each accumulation pass
+  std::vector<GLuint> queries(options.samples);
+  glGenQueries(queries.size(), queries.data());
+
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < options.samples; ++i) {
+    glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+    renderer.accumulate();
+    glEndQuery(GL_TIME_ELAPSED);
+  }
+  glFinish();
+  const auto end = std::chrono::steady_clock::now();
+
+  Result result;
+  result.resolution = glm::uvec2(renderer.getWidth(), renderer.getHeight());
+  result.samples = options.samples;
+  result.wall_time = std::chrono::duration<double>(end - start).count();
+
+  std::vector<double> pass_times(queries.size());
+  result.gpu_time = 0;
+  for (unsigned int i = 0; i < queries.size(); ++i) {
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+    pass_times[i] = 1e-6 * elapsed;
+    result.gpu_time += 1e-9 * elapsed;
+  }
+  glDeleteQueries(queries.size(), queries.data());
+
+  result.p50 = percentile(pass_times, 0.50);
+  result.p95 = percentile(pass_times, 0.95);
+  result.rays = renderer.getRays();
+
+  return result;
+}
+
+void writeJSON(const std::string& filepath, const std::vector<Result>& results,
+               const Options& options) {
+  std::ofstream file(filepath);
+  if (!file) {
+    std::cerr << "failed to write " << filepath << std::endl;
+    return;
+  }
+
+  file << std::setprecision(9);
+  file << "{\n";
+  file << "  \"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n";
+  file << "  \"version\": \"" << glGetString(GL_VERSION) << "\",\n";
+  file << "  \"warmup\": " << options.warmup << ",\n";
+  file << "  \"sampler\": \"" << options.sampler << "\",\n";
+  file << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    file << "    {\"scene\": \"" << r.scene << "\", \"integrator\": \""
+         << r.integrator << "\", \"kernel\": \"" << r.kernel
+         << "\", \"width\": " << r.resolution.x
+         << ", \"height\": " << r.resolution.y
+         << ", \"samples\": " << r.samples
+         << ", \"gpu_time_s\": " << r.gpu_time
+         << ", \"wall_time_s\": " << r.wall_time << ", \"rays\": " << r.rays
+         << ", \"samples_per_s\": " << r.samplesPerSecond()
+         << ", \"rays_per_s\": " << r.raysPerSecond()
+         << ", \"ms_per_sample\": " << r.msPerSample()
+         << ", \"p50_ms\": " << r.p50 << ", \"p95_ms\": " << r.p95 << "}"
+         << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  file << "  ]\n";
+  file << "}\n";
+}
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+
+  // setup offscreen context
+  HeadlessContext context;
+
+  std::cout << "renderer: " << glGetString(GL_RENDERER) << std::endl;
+  std::cout << "version: " << glGetString(GL_VERSION) << std::endl;
+
+  const std::vector<std::pair<SceneType, std::string>> scenes = {
+      {SceneType::Original, "original"},
+      {SceneType::Sphere, "sphere"},
+      {SceneType::Indirect, "indirect"}};
+  const std::vector<std::pair<Integrator, std::string>> integrators = {
+      {Integrator::PT, "pt"}, {Integrator::PTNEE, "ptnee"}};
+
+  std::cout << std::left << std::setw(10) << "scene" << std::setw(8)
+            << "integ" << std::setw(13) << "kernel" << std::setw(11)
+            << "resolution" << std::right
+            << std::setw(12) << "Msamples/s" << std::setw(10) << "Mrays/s"
+            << std::setw(13) << "ms/sample" << std::setw(10) << "p50 ms"
+            << std::setw(10) << "p95 ms" << std::endl;
+
+  std::vector<Result> results;
+  for (const glm::uvec2& resolution : options.resolutions) {
+    auto renderer = std::make_unique<Renderer>(resolution.x, resolution.y);
+    // only bench pays for counting rays
+    renderer->setRayCounting(true);
+
+    for (const auto& [scene_type, scene_name] : scenes) {
+      for (const auto& [integrator, integrator_name] : integrators) {
+        for (const bool specialized : options.kernels) {
+          Result result = runCase(*renderer, scene_type, integrator,
+                                  specialized, options);
+          result.scene = scene_name;
+          result.integrator = integrator_name;
+          result.kernel = specialized ? "specialized" : "generic";
+          results.push_back(result);
+
+          const std::string res = std::to_string(resolution.x) + "x" +
+                                  std::to_string(resolution.y);
+          std::cout << std::fixed << std::setprecision(3) << std::left
+                    << std::setw(10) << scene_name << std::setw(8)
+                    << integrator_name << std::setw(13) << result.kernel
+                    << std::setw(11) << res << std::right << std::setw(12)
+                    << 1e-6 * result.samplesPerSecond() << std::setw(10)
+                    << 1e-6 * result.raysPerSecond() << std::setw(13)
+                    << result.msPerSample() << std::setw(10) << result.p50
+                    << std::setw(10) << result.p95 << std::endl;
+        }
+      }
+    }
+
+    renderer->destroy();
+  }
+
+  writeJSON(options.json, results, options);
+  std::cout << "saved " << options.json << std::endl;
+
+  context.destroy();
+
+  return 0;
+}
\ No newline at end of file
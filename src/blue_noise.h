@@ -0,0 +1,165 @@
+#ifndef _BLUE_NOISE_H
+#define _BLUE_NOISE_H
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// tileable blue noise generated by void and cluster(Ulichney 1993)
+// each texel holds its rank in [0, 1)
+class BlueNoise {
+ public:
+  // same as BLUE_NOISE_SIZE in rng.frag
+  static constexpr int SIZE = 64;
+  static constexpr int N_PIXELS = SIZE * SIZE;
+
+  std::vector<float> values;
+
+ private:
+  static constexpr float SIGMA = 1.5f;
+
+  std::vector<float> kernel;  // gaussian of toroidal offset
+  std::vector<float> energy;  // sum of kernel over set pixels
+  std::vector<bool> pattern;
+
+  void setPixel(int idx, bool value) {
+    pattern[idx] = value;
+    const float sign = value ? 1.0f : -1.0f;
+    const int x0 = idx % SIZE;
+    const int y0 = idx / SIZE;
+    for (int y = 0; y < SIZE; ++y) {
+      for (int x = 0; x < SIZE; ++x) {
+        const int dx = (x - x0 + SIZE) % SIZE;
+        const int dy = (y - y0 + SIZE) % SIZE;
+        energy[x + SIZE * y] += sign * kernel[dx + SIZE * dy];
+      }
+    }
+  }
+
+  // set pixel with highest energy
+  int tightestCluster() const {
+    int best = -1;
+    for (int i = 0; i < N_PIXELS; ++i) {
+      if (pattern[i] && (best < 0 || energy[i] > energy[best])) best = i;
+    }
+    return best;
+  }
+
+  // unset pixel with lowest energy
+  int largestVoid() const {
+    int best = -1;
+    for (int i = 0; i < N_PIXELS; ++i) {
+      if (!pattern[i] && (best < 0 || energy[i] < energy[best])) best = i;
+    }
+    return best;
+  }
+
+ public:
+  BlueNoise(unsigned int seed = 0) {
+    kernel.resize(N_PIXELS);
+    for (int y = 0; y < SIZE; ++y) {
+      for (int x = 0; x < SIZE; ++x) {
+        const int dx = std::min(x, SIZE - x);
+        const int dy = std::min(y, SIZE - y);
+        kernel[x + SIZE * y] =
+            std::exp(-(dx * dx + dy * dy) / (2.0f * SIGMA * SIGMA));
+      }
+    }
+
+    energy.assign(N_PIXELS, 0);
+    pattern.assign(N_PIXELS, false);
+
+    // initial binary pattern, 10% of random pixels
+    std::mt19937 mt(seed);
+    std::uniform_int_distribution<int> dist(0, N_PIXELS - 1);
+    const int n_initial = N_PIXELS / 10;
+    for (int n = 0; n < n_initial;) {
+      const int idx = dist(mt);
+      if (pattern[idx]) continue;
+      setPixel(idx, true);
+      n++;
+    }
+
+    // move tightest cluster to largest void until it stays there
+    while (true) {
+      const int cluster = tightestCluster();
+      setPixel(cluster, false);
+      const int void_idx = largestVoid();
+      setPixel(void_idx, true);
+      if (void_idx == cluster) break;
+    }
+    const std::vector<bool> initial_pattern = pattern;
+    const std::vector<float> initial_energy = energy;
+
+    std::vector<int> ranks(N_PIXELS);
+
+    // rank initial pixels by removing tightest cluster
+    for (int rank = n_initial - 1; rank >= 0; --rank) {
+      const int cluster = tightestCluster();
+      setPixel(cluster, false);
+      ranks[cluster] = rank;
+    }
+
+    // rank remaining pixels by filling largest void
+    pattern = initial_pattern;
+    energy = initial_energy;
+    for (int rank = n_initial; rank < N_PIXELS; ++rank) {
+      const int void_idx = largestVoid();
+      setPixel(void_idx, true);
+      ranks[void_idx] = rank;
+    }
+
+    values.resize(N_PIXELS);
+    for (int i = 0; i < N_PIXELS; ++i) {
+      values[i] = (ranks[i] + 0.5f) / N_PIXELS;
+    }
+
+    kernel.clear();
+    energy.clear();
+    pattern.clear();
+  }
+
+  // values from cache directory, generated and saved when missing
+  // generation takes tens of milliseconds, so it is not repeated every launch
+  // empty directory disables cache
+  static std::vector<float> load(const std::string& cache_directory,
+                                 unsigned int seed = 0) {
+    if (cache_directory.empty()) return BlueNoise(seed).values;
+
+    char filename[64];
+    std::snprintf(filename, sizeof(filename), "blue_noise_%d_%u.bin", SIZE,
+                  seed);
+    const std::string filepath = cache_directory + "/" + filename;
+
+    std::vector<float> values(N_PIXELS);
+    {
+      std::ifstream file(filepath, std::ios::binary);
+      file.read(reinterpret_cast<char*>(values.data()),
+                N_PIXELS * sizeof(float));
+      // reject truncated or trailing data
+      if (file && file.peek() == std::ifstream::traits_type::eof()) {
+        bool valid = true;
+        for (const float value : values) {
+          if (!(value >= 0.0f && value < 1.0f)) valid = false;
+        }
+        if (valid) return values;
+      }
+    }
+
+    values = BlueNoise(seed).values;
+    std::error_code ec;
+    std::filesystem::create_directories(cache_directory, ec);
+    std::ofstream file(filepath, std::ios::binary);
+    if (file) {
+      file.write(reinterpret_cast<const char*>(values.data()),
+                 N_PIXELS * sizeof(float));
+    }
+    return values;
+  }
+};
+
+#endif
\ No newline at end of file
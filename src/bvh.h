@@ -0,0 +1,292 @@
+#ifndef _BVH_H
+#define _BVH_H
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+struct AABB {
+  glm::vec3 pMin;
+  glm::vec3 pMax;
+
+  AABB()
+      : pMin(std::numeric_limits<float>::max()),
+        pMax(std::numeric_limits<float>::lowest()) {}
+  AABB(const glm::vec3& pMin, const glm::vec3& pMax)
+      : pMin(pMin), pMax(pMax) {}
+
+  void extend(const glm::vec3& p) {
+    pMin = glm::min(pMin, p);
+    pMax = glm::max(pMax, p);
+  }
+  void extend(const AABB& bbox) {
+    pMin = glm::min(pMin, bbox.pMin);
+    pMax = glm::max(pMax, bbox.pMax);
+  }
+
+  bool isValid() const { return pMin.x <= pMax.x; }
+  glm::vec3 center() const { return 0.5f * (pMin + pMax); }
+
+  float surfaceArea() const {
+    if (!isValid()) return 0;
+    const glm::vec3 d = pMax - pMin;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+};
+
+// 32 bytes, uploaded to GPU as two RGBA32I texels
+// interior node: first child is the next node, leftOrFirst is second child
+// leaf node: primitives are indices[leftOrFirst, leftOrFirst + count)
+struct alignas(16) BVHNode {
+  glm::vec3 bboxMin;  // 12
+  int leftOrFirst;    // 16
+  glm::vec3 bboxMax;  // 28
+  int count;          // 32
+};
+
+// SAH binned BVH flattened in depth first order
+class BVH {
+ public:
+  static constexpr int N_BINS = 12;
+  static constexpr int MAX_LEAF_SIZE = 4;
+  // same as BVH_STACK_SIZE in closest_hit.frag
+  static constexpr int MAX_DEPTH = 64;
+
+  std::vector<BVHNode> nodes;
+  std::vector<int> indices;
+
+ private:
+  struct Bin {
+    AABB bbox;
+    int count = 0;
+  };
+
+  std::vector<AABB> bboxes;
+  std::vector<glm::vec3> centers;
+
+  // parent of every node, -1 for root, and leaf of every index, for refit
+  std::vector<int> parents;
+  std::vector<int> leaves;
+
+  void makeLeaf(int node, int first, int count) {
+    nodes[node].leftOrFirst = first;
+    nodes[node].count = count;
+  }
+
+  void buildNode(int node, int first, int count, int depth) {
+    // node bounds and centroid bounds
+    AABB bbox, centroid_bbox;
+    for (int i = first; i < first + count; ++i) {
+      bbox.extend(bboxes[indices[i]]);
+      centroid_bbox.extend(centers[indices[i]]);
+    }
+    nodes[node].bboxMin = bbox.pMin;
+    nodes[node].bboxMax = bbox.pMax;
+
+    if (count <= 1 || depth >= MAX_DEPTH) {
+      makeLeaf(node, first, count);
+      return;
+    }
+
+    // find best split over all axes
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    int best_split = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+      const float cmin = centroid_bbox.pMin[axis];
+      const float cmax = centroid_bbox.pMax[axis];
+      if (cmax <= cmin) continue;
+      const float scale = N_BINS / (cmax - cmin);
+
+      std::array<Bin, N_BINS> bins;
+      for (int i = first; i < first + count; ++i) {
+        const int b = std::min(
+            static_cast<int>((centers[indices[i]][axis] - cmin) * scale),
+            N_BINS - 1);
+        bins[b].bbox.extend(bboxes[indices[i]]);
+        bins[b].count++;
+      }
+
+      // sweep from right to get right side area and count of each split
+      std::array<float, N_BINS - 1> right_area;
+      std::array<int, N_BINS - 1> right_count;
+      AABB right_bbox;
+      int right_sum = 0;
+      for (int b = N_BINS - 1; b > 0; --b) {
+        right_bbox.extend(bins[b].bbox);
+        right_sum += bins[b].count;
+        right_area[b - 1] = right_bbox.surfaceArea();
+        right_count[b - 1] = right_sum;
+      }
+
+      AABB left_bbox;
+      int left_sum = 0;
+      for (int b = 0; b < N_BINS - 1; ++b) {
+        left_bbox.extend(bins[b].bbox);
+        left_sum += bins[b].count;
+        if (left_sum == 0 || right_count[b] == 0) continue;
+
+        const float cost = left_bbox.surfaceArea() * left_sum +
+                           right_area[b] * right_count[b];
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_split = b;
+        }
+      }
+    }
+
+    // make leaf when it is cheaper than split
+    // traversal cost is assumed to be same as 1 intersection
+    const float leaf_cost = bbox.surfaceArea() * count;
+    const float split_cost = best_cost + bbox.surfaceArea();
+    if (best_axis < 0 || (count <= MAX_LEAF_SIZE && split_cost >= leaf_cost)) {
+      makeLeaf(node, first, count);
+      return;
+    }
+
+    // partition primitives
+    const float cmin = centroid_bbox.pMin[best_axis];
+    const float scale = N_BINS / (centroid_bbox.pMax[best_axis] - cmin);
+    const auto middle = std::partition(
+        indices.begin() + first, indices.begin() + first + count,
+        [&](int idx) {
+          const int b = std::min(
+              static_cast<int>((centers[idx][best_axis] - cmin) * scale),
+              N_BINS - 1);
+          return b <= best_split;
+        });
+    const int left_count = static_cast<int>(middle - indices.begin()) - first;
+
+    // children, left child directly follows its parent
+    const int left = nodes.size();
+    nodes.emplace_back();
+    buildNode(left, first, left_count, depth + 1);
+
+    const int right = nodes.size();
+    nodes.emplace_back();
+    buildNode(right, first + left_count, count - left_count, depth + 1);
+
+    nodes[node].leftOrFirst = right;
+    nodes[node].count = 0;
+  }
+
+ public:
+  void build(const std::vector<AABB>& primitive_bboxes) {
+    bboxes = primitive_bboxes;
+    centers.resize(bboxes.size());
+    indices.resize(bboxes.size());
+    for (size_t i = 0; i < bboxes.size(); ++i) {
+      centers[i] = bboxes[i].center();
+      indices[i] = i;
+    }
+
+    nodes.clear();
+    nodes.reserve(2 * bboxes.size());
+    nodes.emplace_back();
+    buildNode(0, 0, bboxes.size(), 0);
+
+    bboxes.clear();
+    centers.clear();
+    setupParents();
+  }
+
+  // false when nodes are not a tree in depth first order whose leaves cover
+  // every index once, e.g. nodes read from corrupted file
+  bool validate() const {
+    // empty BVH has single leaf without primitives
+    if (indices.empty()) return nodes.size() == 1 && nodes[0].count == 0;
+
+    const int n_nodes = nodes.size();
+    const int n_indices = indices.size();
+    std::vector<int> depths(n_nodes, -1);
+    std::vector<bool> covered(n_indices, false);
+    if (n_nodes > 0) depths[0] = 0;
+    // children follow their parent, so depth of node is known when reached
+    for (int node = 0; node < n_nodes; ++node) {
+      if (depths[node] < 0 || depths[node] > MAX_DEPTH) return false;
+      const int first = nodes[node].leftOrFirst;
+      const int count = nodes[node].count;
+      if (count > 0) {
+        if (first < 0 || first > n_indices - count) return false;
+        for (int i = first; i < first + count; ++i) {
+          if (covered[i]) return false;
+          covered[i] = true;
+        }
+      } else if (count == 0) {
+        const int left = node + 1;
+        if (left >= n_nodes || first <= left || first >= n_nodes ||
+            depths[left] >= 0 || depths[first] >= 0) {
+          return false;
+        }
+        depths[left] = depths[node] + 1;
+        depths[first] = depths[node] + 1;
+      } else {
+        return false;
+      }
+    }
+    return n_nodes > 0 &&
+           std::find(covered.begin(), covered.end(), false) == covered.end();
+  }
+
+  // call after nodes and indices are set without build()
+  void setupParents() {
+    parents.assign(nodes.size(), -1);
+    leaves.assign(indices.size(), -1);
+    // empty BVH has single leaf without primitives
+    if (indices.empty()) return;
+    for (size_t node = 0; node < nodes.size(); ++node) {
+      const int first = nodes[node].leftOrFirst;
+      if (nodes[node].count > 0) {
+        for (int i = first; i < first + nodes[node].count; ++i) {
+          leaves[i] = node;
+        }
+      } else {
+        parents[node + 1] = node;
+        parents[first] = node;
+      }
+    }
+  }
+
+  // update bounds of leaf holding indices[position] and of its ancestors
+  // keeping topology, for moved primitive
+  // primitive_ids[i] is index of primitive_bboxes of indices[i]
+  // returns nodes whose bounds changed, ancestors of unchanged node are
+  // unchanged too
+  std::vector<int> refit(int position,
+                         const std::vector<AABB>& primitive_bboxes,
+                         const std::vector<int>& primitive_ids) {
+    std::vector<int> changed;
+    if (position < 0 || position >= static_cast<int>(leaves.size())) {
+      return changed;
+    }
+
+    for (int node = leaves[position]; node >= 0; node = parents[node]) {
+      AABB bbox;
+      if (nodes[node].count > 0) {
+        const int first = nodes[node].leftOrFirst;
+        for (int i = first; i < first + nodes[node].count; ++i) {
+          bbox.extend(primitive_bboxes[primitive_ids[i]]);
+        }
+      } else {
+        const BVHNode& left = nodes[node + 1];
+        const BVHNode& right = nodes[nodes[node].leftOrFirst];
+        bbox.extend(AABB(left.bboxMin, left.bboxMax));
+        bbox.extend(AABB(right.bboxMin, right.bboxMax));
+      }
+
+      if (bbox.pMin == nodes[node].bboxMin &&
+          bbox.pMax == nodes[node].bboxMax) {
+        break;
+      }
+      nodes[node].bboxMin = bbox.pMin;
+      nodes[node].bboxMax = bbox.pMax;
+      changed.push_back(node);
+    }
+    return changed;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -42,6 +42,24 @@ class Camera {
     params.a = 1.0f / std::tan(0.5f * fov);
   }
 
+  void lookAt(const glm::vec3& camPos, const glm::vec3& lookat) {
+    this->lookat = lookat;
+    params.camPos = camPos;
+    params.camForward = glm::normalize(lookat - camPos);
+    params.camRight =
+        glm::normalize(glm::cross(params.camForward, glm::vec3(0, 1, 0)));
+    params.camUp =
+        glm::normalize(glm::cross(params.camRight, params.camForward));
+  }
+
+  // direction of ray through sensor point uv, same as rayGen() in raygen.frag
+  glm::vec3 getRayDirection(const glm::vec2& uv) const {
+    const glm::vec3 pinholePos = params.camPos + params.a * params.camForward;
+    const glm::vec3 sensorPos =
+        params.camPos + uv.x * params.camRight + uv.y * params.camUp;
+    return glm::normalize(pinholePos - sensorPos);
+  }
+
   void move(const glm::vec3& v) {
     // const float dist = glm::distance(lookat, params.camPos);
     params.camPos +=
@@ -0,0 +1,232 @@
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define CHECKPOINT_FSYNC
+#endif
+
+// progressive render state, header followed by raw planes
+// planes are textures as read by glGetTexImage(rows bottom to top), so they
+// can be mapped and uploaded without conversion
+namespace CheckpointFormat {
+
+constexpr char MAGIC[8] = {'C', 'B', 'X', 'C', 'H', 'E', 'C', 'K'};
+constexpr std::uint32_t VERSION = 1;
+// offset of every plane
+constexpr std::uint64_t ALIGNMENT = 64;
+
+enum Plane : std::uint32_t {
+  ACCUM,            // RGBA32F accumTexture
+  MOMENTS,          // RGBA32F momentsTexture
+  RNG_STATE,        // R32UI stateTexture
+  PATH_ORIGIN,      // RGBA32F wavefront path state, empty for other
+  PATH_DIRECTION,   // integrators
+  PATH_THROUGHPUT,  //
+  TILE_SAMPLES,     // float per tile, see TileScheduler
+  N_PLANES,
+};
+
+struct PlaneEntry {
+  std::uint32_t element_size;
+  std::uint32_t reserved;
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t n_planes;
+
+  // must match to resume
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t integrator;
+  std::uint32_t sampler_type;
+  std::uint32_t seed;
+  std::uint32_t max_depth;
+  std::uint64_t scene_hash;
+  float camera_position[3];
+  float camera_forward[3];
+  float camera_right[3];
+  float camera_up[3];
+  float camera_fov;
+
+  // restored on resume
+  std::uint32_t tile_size;
+  std::uint32_t tile_cursor;
+  float wavefront_samples;
+
+  // for messages only
+  std::uint32_t samples;
+  char scene_name[256];
+
+  PlaneEntry planes[N_PLANES];
+};
+
+}  // namespace CheckpointFormat
+
+// raw array of one plane, data is not owned
+struct CheckpointPlane {
+  const void* data = nullptr;
+  size_t size = 0;
+  size_t element_size = 0;
+
+  size_t count() const { return element_size ? size / element_size : 0; }
+  template <typename T>
+  const T* as() const {
+    return static_cast<const T*>(data);
+  }
+};
+
+// read only memory mapping of checkpoint
+// header and planes point into mapping and are valid while this object lives
+class Checkpoint {
+ private:
+  MappedFile file;
+  CheckpointPlane planes[CheckpointFormat::N_PLANES];
+
+  // flush file or directory to disk, so that it survives a crash of system
+  // no-op without fsync
+  static bool sync(const std::string& path, bool directory) {
+#ifdef CHECKPOINT_FSYNC
+    const int fd = ::open(path.c_str(), directory ? O_RDONLY : O_WRONLY);
+    if (fd < 0) return false;
+    const bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#else
+    (void)path;
+    (void)directory;
+    return true;
+#endif
+  }
+
+  bool validate() {
+    using namespace CheckpointFormat;
+    const char* data = file.data();
+    const size_t size = file.size();
+    if (size < sizeof(Header)) return false;
+    const Header* header = reinterpret_cast<const Header*>(data);
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if (header->version != VERSION || header->n_planes != N_PLANES) {
+      std::cerr << "unsupported checkpoint version" << std::endl;
+      return false;
+    }
+
+    for (std::uint32_t i = 0; i < N_PLANES; ++i) {
+      const PlaneEntry& entry = header->planes[i];
+      if (entry.offset % ALIGNMENT != 0 || entry.offset > size ||
+          entry.size > size - entry.offset || entry.element_size == 0 ||
+          entry.size % entry.element_size != 0) {
+        std::cerr << "corrupted checkpoint plane " << i << std::endl;
+        return false;
+      }
+      planes[i].data = data + entry.offset;
+      planes[i].size = entry.size;
+      planes[i].element_size = entry.element_size;
+    }
+    return true;
+  }
+
+ public:
+  Checkpoint() {}
+  Checkpoint(const Checkpoint&) = delete;
+  Checkpoint& operator=(const Checkpoint&) = delete;
+
+  // return false when file is missing or not a checkpoint
+  bool open(const std::string& filepath) {
+    if (!file.open(filepath)) return false;
+    if (!validate()) {
+      file.close();
+      return false;
+    }
+    return true;
+  }
+
+  bool isOpen() const { return file.isOpen(); }
+
+  const CheckpointFormat::Header& getHeader() const {
+    return *reinterpret_cast<const CheckpointFormat::Header*>(file.data());
+  }
+  const CheckpointPlane& getPlane(CheckpointFormat::Plane plane) const {
+    return planes[plane];
+  }
+
+  // write header and planes, planes[i] is CheckpointFormat::Plane i
+  // written to temporary file first, previous checkpoint stays intact until
+  // new one is complete
+  // temporary file is synced before rename and directory after, so that a
+  // power loss leaves either old or new checkpoint, never an empty file
+  static bool write(const std::string& filepath,
+                    CheckpointFormat::Header header,
+                    const std::vector<CheckpointPlane>& planes) {
+    using namespace CheckpointFormat;
+    if (planes.size() != N_PLANES) return false;
+
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.n_planes = N_PLANES;
+
+    const auto align = [](std::uint64_t offset) {
+      return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    };
+    std::uint64_t offset = align(sizeof(Header));
+    for (std::uint32_t i = 0; i < N_PLANES; ++i) {
+      header.planes[i].element_size = planes[i].element_size;
+      header.planes[i].reserved = 0;
+      header.planes[i].offset = offset;
+      header.planes[i].size = planes[i].size;
+      offset = align(offset + planes[i].size);
+    }
+
+    const std::string temp_filepath = filepath + ".tmp";
+    {
+      std::ofstream file(temp_filepath, std::ios::binary);
+      if (!file) return false;
+      const char zeros[ALIGNMENT] = {};
+      file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+      std::uint64_t written = sizeof(Header);
+      for (std::uint32_t i = 0; i < N_PLANES; ++i) {
+        file.write(zeros, header.planes[i].offset - written);
+        file.write(static_cast<const char*>(planes[i].data), planes[i].size);
+        written = header.planes[i].offset + planes[i].size;
+      }
+      file.flush();
+      if (!file) {
+        file.close();
+        std::remove(temp_filepath.c_str());
+        return false;
+      }
+    }
+    if (!sync(temp_filepath, false)) {
+      std::remove(temp_filepath.c_str());
+      return false;
+    }
+    if (std::rename(temp_filepath.c_str(), filepath.c_str()) != 0) {
+      // rename does not replace existing file on Windows
+      std::remove(filepath.c_str());
+      if (std::rename(temp_filepath.c_str(), filepath.c_str()) != 0) {
+        return false;
+      }
+    }
+    const std::filesystem::path directory =
+        std::filesystem::path(filepath).parent_path();
+    return sync(directory.empty() ? "." : directory.string(), true);
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,1027 @@
+#ifndef _CPU_RENDERER_H
+#define _CPU_RENDERER_H
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "constant.h"
+#include "glm/glm.hpp"
+#include "image.h"
+#include "scene.h"
+#include "simd.h"
+
+// multithreaded path tracer on CPU, reads Scene and CameraBlock directly
+// estimators are the same as pt.frag and pt-nee.frag, accumulation has the
+// same layout as accumTexture and momentsTexture of Renderer
+class CPURenderer {
+ public:
+  // same as RAY_TMIN, RAY_TMAX in global.frag
+  static constexpr float RAY_TMIN = 0.1f;
+  static constexpr float RAY_TMAX = 10000.0f;
+  // same as BVH_STACK_SIZE in closest_hit.frag
+  static constexpr int BVH_STACK_SIZE = BVH::MAX_DEPTH;
+  static constexpr unsigned int TILE_SIZE = 16;
+  // spheres and planes are tested all at once in SIMD lanes up to this
+  // number, otherwise they are traversed in BVH like triangles
+  static constexpr size_t MAX_PACKED_PRIMITIVES = 64;
+
+ private:
+  static constexpr int W = simd::WIDTH;
+
+  struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+  };
+
+  // same as IntersectInfo in global.frag
+  struct IntersectInfo {
+    float t;
+    glm::vec3 hitPos;
+    glm::vec3 hitNormal;
+    glm::vec3 dpdu;
+    glm::vec3 dpdv;
+    float u;
+    float v;
+    int primID;
+    int materialID;
+  };
+
+  // W spheres or planes in SoA layout, unused lanes are NaN and never hit
+  struct alignas(32) SpherePacket {
+    float center[3][W];
+    float radius2[W];
+    float index[W];
+  };
+  struct alignas(32) PlanePacket {
+    float origin[3][W];
+    float normal[3][W];
+    float rightDir[3][W];
+    float rightLengthInv[W];
+    float upDir[3][W];
+    float upLengthInv[W];
+    float index[W];
+  };
+
+  // PCG32, Melissa O'Neill
+  class RNG {
+   private:
+    std::uint64_t state;
+
+    static std::uint64_t splitmix64(std::uint64_t x) {
+      x += 0x9e3779b97f4a7c15ULL;
+      x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+      return x ^ (x >> 31);
+    }
+
+   public:
+    // independent stream for each pixel and sample
+    RNG(std::uint32_t pixel, std::uint32_t sample, std::uint32_t seed)
+        : state(splitmix64(
+              splitmix64((std::uint64_t(seed) << 32) | pixel) + sample)) {}
+
+    // [0, 1)
+    float operator()() {
+      const std::uint64_t old = state;
+      state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+      const std::uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+      const std::uint32_t rot = old >> 59;
+      const std::uint32_t r =
+          (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+      return (r >> 8) * (1.0f / 16777216.0f);
+    }
+  };
+
+  // work stealing queue of tile indices, owner pops front, thieves pop back
+  struct TileQueue {
+    std::mutex mutex;
+    std::deque<unsigned int> tiles;
+
+    bool popFront(unsigned int& tile) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (tiles.empty()) return false;
+      tile = tiles.front();
+      tiles.pop_front();
+      return true;
+    }
+    bool popBack(unsigned int& tile) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (tiles.empty()) return false;
+      tile = tiles.back();
+      tiles.pop_back();
+      return true;
+    }
+  };
+
+  const Scene* scene;
+  CameraBlock camera;
+  glm::uvec2 resolution;
+  glm::uvec2 n_tiles;
+
+  bool nee;
+  unsigned int samples_per_pass;
+  unsigned int max_depth;
+  float adaptive_threshold;
+  unsigned int adaptive_min_samples;
+  unsigned int seed;
+  unsigned int samples;
+
+  // (radiance, number of rays) and (luminance, squared luminance, number of
+  // samples, 0) of each pixel, rows from bottom to top
+  std::vector<glm::vec4> accum;
+  std::vector<glm::vec4> moments;
+
+  bool use_packets;
+  bool has_triangles;
+  std::vector<SpherePacket> sphere_packets;
+  std::vector<PlanePacket> plane_packets;
+
+  // thread pool, workers wait for next pass
+  std::vector<std::thread> workers;
+  std::vector<TileQueue> queues;
+  std::mutex pool_mutex;
+  std::condition_variable start_cv;
+  std::condition_variable done_cv;
+  unsigned int pass_id;
+  unsigned int running;
+  bool quit;
+
+  static float luminance(const glm::vec3& c) {
+    return glm::dot(c, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+  }
+
+  // same as isConverged() in adaptive.frag
+  bool isConverged(const glm::vec4& m) const {
+    if (adaptive_threshold <= 0 || m.z < adaptive_min_samples || m.z < 2) {
+      return false;
+    }
+    const float n = m.z;
+    const float mean = m.x / n;
+    const float variance = std::max(m.y / n - mean * mean, 0.0f) * n / (n - 1);
+    return std::sqrt(variance / n) / std::max(mean, 1e-3f) <
+           adaptive_threshold;
+  }
+
+  static int primitiveIndex(int primID) {
+    return primID & ((1 << Scene::PRIMITIVE_TYPE_SHIFT) - 1);
+  }
+  static int primitiveType(int primID) {
+    return primID >> Scene::PRIMITIVE_TYPE_SHIFT;
+  }
+  static int makePrimitiveRef(int type, int index) {
+    return (type << Scene::PRIMITIVE_TYPE_SHIFT) | index;
+  }
+
+  // pack spheres and planes into SIMD lanes
+  void setupPackets() {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    sphere_packets.assign((scene->spheres.size() + W - 1) / W, {});
+    for (SpherePacket& packet : sphere_packets) {
+      std::fill_n(&packet.center[0][0], 3 * W, nan);
+      std::fill_n(packet.radius2, W, nan);
+    }
+    for (size_t i = 0; i < scene->spheres.size(); ++i) {
+      const SphereRecord& sphere = scene->spheres[i];
+      SpherePacket& packet = sphere_packets[i / W];
+      for (int k = 0; k < 3; ++k) {
+        packet.center[k][i % W] = sphere.center[k];
+      }
+      packet.radius2[i % W] = sphere.radius2;
+      packet.index[i % W] = i;
+    }
+
+    plane_packets.assign((scene->planes.size() + W - 1) / W, {});
+    for (PlanePacket& packet : plane_packets) {
+      std::fill_n(&packet.origin[0][0], 3 * W, nan);
+    }
+    for (size_t i = 0; i < scene->planes.size(); ++i) {
+      const PlaneRecord& plane = scene->planes[i];
+      PlanePacket& packet = plane_packets[i / W];
+      for (int k = 0; k < 3; ++k) {
+        packet.origin[k][i % W] = plane.origin[k];
+        packet.normal[k][i % W] = plane.normal[k];
+        packet.rightDir[k][i % W] = plane.rightDir[k];
+        packet.upDir[k][i % W] = plane.upDir[k];
+      }
+      packet.rightLengthInv[i % W] = plane.rightLengthInv;
+      packet.upLengthInv[i % W] = plane.upLengthInv;
+      packet.index[i % W] = i;
+    }
+
+    use_packets = scene->spheres.size() + scene->planes.size() <=
+                  MAX_PACKED_PRIMITIVES;
+    has_triangles = !scene->triangles.empty();
+  }
+
+  // same as intersectSphere() in intersect.frag
+  bool intersectSphere(int sphere, const Ray& ray, IntersectInfo& info) const {
+    const SphereRecord& record = scene->spheres[sphere];
+    const glm::vec3 oc = ray.origin - record.center;
+    const float b = glm::dot(oc, ray.direction);
+    const float c = glm::dot(oc, oc) - record.radius2;
+    const float D = b * b - c;
+    if (D < 0) return false;
+
+    const float t0 = -b - std::sqrt(D);
+    const float t1 = -b + std::sqrt(D);
+    float t = t0;
+    if (t < RAY_TMIN || t > RAY_TMAX) {
+      t = t1;
+      if (t < RAY_TMIN || t > RAY_TMAX) return false;
+    }
+
+    info.t = t;
+    info.hitPos = ray.origin + t * ray.direction;
+    info.materialID = record.material_id;
+
+    const glm::vec3 r = info.hitPos - record.center;
+    info.hitNormal = glm::normalize(r);
+    info.dpdu = glm::normalize(glm::vec3(-r.z, 0, r.x));
+
+    float phi = std::atan2(r.z, r.x);
+    if (phi < 0) phi += 2.0f * PI;
+    const float theta =
+        std::acos(glm::clamp(r.y * record.radiusInv, -1.0f, 1.0f));
+    info.dpdv = glm::normalize(glm::vec3(std::cos(phi) * r.y,
+                                         -record.radius * std::sin(theta),
+                                         std::sin(phi) * r.y));
+
+    info.u = phi * 0.5f / PI;
+    info.v = theta / PI;
+    return true;
+  }
+
+  // same as intersectPlane() in intersect.frag
+  bool intersectPlane(int plane, const Ray& ray, IntersectInfo& info) const {
+    const PlaneRecord& record = scene->planes[plane];
+    const float t = -glm::dot(ray.origin - record.origin, record.normal) /
+                    glm::dot(ray.direction, record.normal);
+    if (!(t >= RAY_TMIN && t <= RAY_TMAX)) return false;
+
+    const glm::vec3 hitPos = ray.origin + t * ray.direction;
+    const float u = glm::dot(hitPos - record.origin, record.rightDir) *
+                    record.rightLengthInv;
+    const float v =
+        glm::dot(hitPos - record.origin, record.upDir) * record.upLengthInv;
+    if (!(u >= 0 && u <= 1 && v >= 0 && v <= 1)) return false;
+
+    info.t = t;
+    info.hitPos = hitPos;
+    info.hitNormal = glm::dot(-ray.direction, record.normal) > 0
+                         ? record.normal
+                         : -record.normal;
+    info.dpdu = record.rightDir;
+    info.dpdv = record.upDir;
+    info.u = u;
+    info.v = v;
+    info.materialID = record.material_id;
+    return true;
+  }
+
+  // same as intersectTriangle() in intersect.frag
+  bool intersectTriangle(int triangle, const Ray& ray,
+                         IntersectInfo& info) const {
+    const Triangle& record = scene->triangles[triangle];
+    const glm::vec3 p0(scene->vertices[record.vertex.x]);
+    const glm::vec3 p1(scene->vertices[record.vertex.y]);
+    const glm::vec3 p2(scene->vertices[record.vertex.z]);
+
+    // permute axes so that largest component of direction is z
+    const glm::vec3 absDir = glm::abs(ray.direction);
+    const int kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0 : 2)
+                                       : (absDir.y > absDir.z ? 1 : 2);
+    int kx = kz == 2 ? 0 : kz + 1;
+    int ky = kx == 2 ? 0 : kx + 1;
+    // preserve winding
+    if (ray.direction[kz] < 0) std::swap(kx, ky);
+
+    // shear constants
+    const float Sz = 1.0f / ray.direction[kz];
+    const float Sx = ray.direction[kx] * Sz;
+    const float Sy = ray.direction[ky] * Sz;
+
+    // vertices relative to ray origin, sheared
+    const glm::vec3 A = p0 - ray.origin;
+    const glm::vec3 B = p1 - ray.origin;
+    const glm::vec3 C = p2 - ray.origin;
+    const float Ax = A[kx] - Sx * A[kz];
+    const float Ay = A[ky] - Sy * A[kz];
+    const float Bx = B[kx] - Sx * B[kz];
+    const float By = B[ky] - Sy * B[kz];
+    const float Cx = C[kx] - Sx * C[kz];
+    const float Cy = C[ky] - Sy * C[kz];
+
+    // scaled barycentric coordinates
+    const float U = Cx * By - Cy * Bx;
+    const float V = Ax * Cy - Ay * Cx;
+    const float W_ = Bx * Ay - By * Ax;
+    if ((U < 0 || V < 0 || W_ < 0) && (U > 0 || V > 0 || W_ > 0)) {
+      return false;
+    }
+    const float det = U + V + W_;
+    if (det == 0) return false;
+
+    // hit distance
+    const float T = Sz * (U * A[kz] + V * B[kz] + W_ * C[kz]);
+    const float t = T / det;
+    if (!(t >= RAY_TMIN && t <= RAY_TMAX)) return false;
+    const glm::vec3 barycentric = glm::vec3(U, V, W_) / det;
+
+    // geometric normal faces the ray like plane
+    glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+    if (glm::dot(-ray.direction, normal) < 0) normal = -normal;
+
+    // interpolate shading normal
+    if (record.normal.x >= 0) {
+      const glm::vec3 n = glm::normalize(
+          barycentric.x * glm::vec3(scene->normals[record.normal.x]) +
+          barycentric.y * glm::vec3(scene->normals[record.normal.y]) +
+          barycentric.z * glm::vec3(scene->normals[record.normal.z]));
+      normal = glm::dot(n, normal) > 0 ? n : -n;
+    }
+
+    info.t = t;
+    info.hitPos = barycentric.x * p0 + barycentric.y * p1 + barycentric.z * p2;
+    info.hitNormal = normal;
+    const glm::vec3 e1 = p1 - p0;
+    info.dpdu = glm::normalize(e1 - glm::dot(e1, normal) * normal);
+    info.dpdv = glm::cross(normal, info.dpdu);
+    info.u = barycentric.y;
+    info.v = barycentric.z;
+    info.materialID = record.material_id;
+    return true;
+  }
+
+  bool intersectEach(const Ray& ray, int primID, IntersectInfo& info) const {
+    const int index = primitiveIndex(primID);
+    switch (primitiveType(primID)) {
+      case Scene::PRIMITIVE_SPHERE:
+        return intersectSphere(index, ray, info);
+      case Scene::PRIMITIVE_PLANE:
+        return intersectPlane(index, ray, info);
+      case Scene::PRIMITIVE_TRIANGLE:
+        return intersectTriangle(index, ray, info);
+    }
+    return false;
+  }
+
+  // closest sphere and plane in SIMD lanes, hit is recomputed by scalar
+  // intersection for full IntersectInfo
+  bool intersectPackets(const Ray& ray, IntersectInfo& info) const {
+    using simd::FloatV;
+    const FloatV ox(ray.origin.x), oy(ray.origin.y), oz(ray.origin.z);
+    const FloatV dx(ray.direction.x), dy(ray.direction.y),
+        dz(ray.direction.z);
+    const FloatV tmin(RAY_TMIN), tmax(RAY_TMAX);
+
+    bool hit = false;
+
+    // spheres
+    FloatV best_t(info.t);
+    FloatV best_index(-1.0f);
+    for (const SpherePacket& packet : sphere_packets) {
+      const FloatV ocx = ox - FloatV::load(packet.center[0]);
+      const FloatV ocy = oy - FloatV::load(packet.center[1]);
+      const FloatV ocz = oz - FloatV::load(packet.center[2]);
+      const FloatV b = ocx * dx + ocy * dy + ocz * dz;
+      const FloatV c =
+          ocx * ocx + ocy * ocy + ocz * ocz - FloatV::load(packet.radius2);
+      const FloatV D = b * b - c;
+      const FloatV sqrtD = simd::sqrt(simd::max(D, FloatV(0.0f)));
+      const FloatV t0 = -b - sqrtD;
+      const FloatV t1 = -b + sqrtD;
+      const FloatV t = simd::select((t0 >= tmin) & (t0 <= tmax), t0, t1);
+      const FloatV mask = (D >= FloatV(0.0f)) & (t >= tmin) & (t <= tmax) &
+                          (t < best_t);
+      best_t = simd::select(mask, t, best_t);
+      best_index = simd::select(mask, FloatV::load(packet.index), best_index);
+    }
+    hit |= closestLane(ray, best_t, best_index, Scene::PRIMITIVE_SPHERE, info);
+
+    // planes
+    best_t = FloatV(info.t);
+    best_index = FloatV(-1.0f);
+    for (const PlanePacket& packet : plane_packets) {
+      const FloatV nx = FloatV::load(packet.normal[0]);
+      const FloatV ny = FloatV::load(packet.normal[1]);
+      const FloatV nz = FloatV::load(packet.normal[2]);
+      const FloatV px = ox - FloatV::load(packet.origin[0]);
+      const FloatV py = oy - FloatV::load(packet.origin[1]);
+      const FloatV pz = oz - FloatV::load(packet.origin[2]);
+      const FloatV t =
+          -(px * nx + py * ny + pz * nz) / (dx * nx + dy * ny + dz * nz);
+      FloatV mask = (t >= tmin) & (t <= tmax) & (t < best_t);
+      if (!simd::movemask(mask)) continue;
+
+      // hit position relative to plane origin
+      const FloatV hx = px + t * dx;
+      const FloatV hy = py + t * dy;
+      const FloatV hz = pz + t * dz;
+      const FloatV u = (hx * FloatV::load(packet.rightDir[0]) +
+                        hy * FloatV::load(packet.rightDir[1]) +
+                        hz * FloatV::load(packet.rightDir[2])) *
+                       FloatV::load(packet.rightLengthInv);
+      const FloatV v = (hx * FloatV::load(packet.upDir[0]) +
+                        hy * FloatV::load(packet.upDir[1]) +
+                        hz * FloatV::load(packet.upDir[2])) *
+                       FloatV::load(packet.upLengthInv);
+      const FloatV zero(0.0f), one(1.0f);
+      mask = mask & (u >= zero) & (u <= one) & (v >= zero) & (v <= one);
+      best_t = simd::select(mask, t, best_t);
+      best_index = simd::select(mask, FloatV::load(packet.index), best_index);
+    }
+    hit |= closestLane(ray, best_t, best_index, Scene::PRIMITIVE_PLANE, info);
+
+    return hit;
+  }
+
+  // reduce lanes to closest hit and fill info if it is closer than info.t
+  bool closestLane(const Ray& ray, simd::FloatV best_t,
+                   simd::FloatV best_index, int type,
+                   IntersectInfo& info) const {
+    alignas(32) float ts[W];
+    alignas(32) float indices[W];
+    best_t.store(ts);
+    best_index.store(indices);
+
+    int lane = -1;
+    for (int i = 0; i < W; ++i) {
+      if (indices[i] >= 0 && (lane < 0 || ts[i] < ts[lane])) lane = i;
+    }
+    if (lane < 0 || !(ts[lane] < info.t)) return false;
+
+    const int primID = makePrimitiveRef(type, indices[lane]);
+    IntersectInfo temp;
+    // relative hit position differs slightly from scalar intersection
+    if (!intersectEach(ray, primID, temp) || !(temp.t < info.t)) return false;
+    temp.primID = primID;
+    info = temp;
+    return true;
+  }
+
+  // same as intersect() in closest_hit.frag
+  // only triangles are tested when spheres and planes are in packets
+  bool intersectBVH(const Ray& ray, IntersectInfo& info,
+                    bool triangles_only) const {
+    const std::vector<BVHNode>& nodes = scene->bvh.nodes;
+    const std::vector<int>& indices = scene->bvh.indices;
+    const glm::vec3 invDir = 1.0f / ray.direction;
+
+    // return entry distance of ray, or -1 when ray misses box before tmax
+    const auto intersectNode = [&](int node, float tmax) {
+      const glm::vec3 t0 = (nodes[node].bboxMin - ray.origin) * invDir;
+      const glm::vec3 t1 = (nodes[node].bboxMax - ray.origin) * invDir;
+      const glm::vec3 tmin3 = glm::min(t0, t1);
+      const glm::vec3 tmax3 = glm::max(t0, t1);
+      const float tnear =
+          std::max(std::max(tmin3.x, tmin3.y), std::max(tmin3.z, 0.0f));
+      const float tfar =
+          std::min(std::min(tmax3.x, tmax3.y), std::min(tmax3.z, tmax));
+      return tnear <= tfar ? tnear : -1.0f;
+    };
+
+    if (intersectNode(0, info.t) < 0) return false;
+
+    // stack of far children and their entry distance
+    int stack[BVH_STACK_SIZE];
+    float stackT[BVH_STACK_SIZE];
+    int sp = 0;
+
+    bool hit = false;
+    int node = 0;
+    while (true) {
+      const BVHNode& current = nodes[node];
+
+      // leaf
+      if (current.count > 0) {
+        for (int i = current.leftOrFirst;
+             i < current.leftOrFirst + current.count; ++i) {
+          const int primID = indices[i];
+          if (triangles_only &&
+              primitiveType(primID) != Scene::PRIMITIVE_TRIANGLE) {
+            continue;
+          }
+          IntersectInfo temp;
+          if (intersectEach(ray, primID, temp) && temp.t < info.t) {
+            hit = true;
+            temp.primID = primID;
+            info = temp;
+          }
+        }
+      }
+      // interior, visit nearer child first
+      else {
+        const int left = node + 1;
+        const int right = current.leftOrFirst;
+        const float tl = intersectNode(left, info.t);
+        const float tr = intersectNode(right, info.t);
+        if (tl >= 0 && tr >= 0) {
+          const bool leftFirst = tl <= tr;
+          stack[sp] = leftFirst ? right : left;
+          stackT[sp] = leftFirst ? tr : tl;
+          sp++;
+          node = leftFirst ? left : right;
+          continue;
+        } else if (tl >= 0) {
+          node = left;
+          continue;
+        } else if (tr >= 0) {
+          node = right;
+          continue;
+        }
+      }
+
+      // pop next node, skip nodes behind closest hit
+      bool found = false;
+      while (sp > 0) {
+        sp--;
+        if (stackT[sp] <= info.t) {
+          node = stack[sp];
+          found = true;
+          break;
+        }
+      }
+      if (!found) break;
+    }
+
+    return hit;
+  }
+
+  bool intersect(const Ray& ray, IntersectInfo& info, float& ray_count) const {
+    info.t = RAY_TMAX;
+    ray_count += 1.0f;
+    if (scene->block.n_primitives == 0) return false;
+
+    if (!use_packets) return intersectBVH(ray, info, false);
+    bool hit = intersectPackets(ray, info);
+    if (has_triangles) hit |= intersectBVH(ray, info, true);
+    return hit;
+  }
+
+  // same as sampling.frag
+  static glm::vec3 sampleCosineHemisphere(float u, float v, float& pdf) {
+    const float theta =
+        0.5f * std::acos(glm::clamp(1.0f - 2.0f * u, -1.0f, 1.0f));
+    const float phi = 2.0f * PI * v;
+    const float y = std::cos(theta);
+    pdf = y / PI;
+    return glm::vec3(std::cos(phi) * std::sin(theta), y,
+                     std::sin(phi) * std::sin(theta));
+  }
+
+  glm::vec3 samplePointOnPrimitive(int primID, RNG& rng, glm::vec3& normal,
+                                   float& pdf_area) const {
+    const int index = primitiveIndex(primID);
+    const float u = rng();
+    const float v = rng();
+    switch (primitiveType(primID)) {
+      case Scene::PRIMITIVE_SPHERE: {
+        const SphereRecord& sphere = scene->spheres[index];
+        pdf_area = 1.0f / (4.0f * PI * sphere.radius2);
+        const float theta = std::acos(1.0f - 2.0f * u);
+        const float phi = 2.0f * PI * v;
+        const glm::vec3 r =
+            sphere.radius * glm::vec3(std::cos(phi) * std::sin(theta),
+                                      std::cos(theta),
+                                      std::sin(phi) * std::sin(theta));
+        normal = glm::normalize(r);
+        return sphere.center + r;
+      }
+      case Scene::PRIMITIVE_PLANE: {
+        const PlaneRecord& plane = scene->planes[index];
+        normal = plane.normal;
+        pdf_area = plane.rightLengthInv * plane.upLengthInv;
+        return plane.origin + (u / plane.rightLengthInv) * plane.rightDir +
+               (v / plane.upLengthInv) * plane.upDir;
+      }
+      case Scene::PRIMITIVE_TRIANGLE: {
+        const Triangle& triangle = scene->triangles[index];
+        const glm::vec3 p0(scene->vertices[triangle.vertex.x]);
+        const glm::vec3 e1 = glm::vec3(scene->vertices[triangle.vertex.y]) - p0;
+        const glm::vec3 e2 = glm::vec3(scene->vertices[triangle.vertex.z]) - p0;
+        const glm::vec3 n = glm::cross(e1, e2);
+        normal = glm::normalize(n);
+        pdf_area = 2.0f / glm::length(n);
+        // uniform barycentric coordinates
+        const float su = std::sqrt(u);
+        return p0 + (1.0f - su) * e1 + v * su * e2;
+      }
+    }
+    return glm::vec3(0);
+  }
+
+  // same as samplePointOnLight() in sampling.frag
+  glm::vec3 samplePointOnLight(const Light& light, RNG& rng, int& primID,
+                               glm::vec3& normal, float& pdf_area) const {
+    primID = light.primID;
+    float pdf_choice = 1.0f;
+    if (light.n_triangles > 0) {
+      // first triangle whose CDF exceeds u
+      const float* cdf = scene->light_cdf.data() + light.cdf_offset;
+      const int index = static_cast<int>(
+          std::upper_bound(cdf, cdf + light.n_triangles - 1, rng()) - cdf);
+      pdf_choice = cdf[index] - (index > 0 ? cdf[index - 1] : 0.0f);
+      primID += index;
+    }
+
+    const glm::vec3 x = samplePointOnPrimitive(primID, rng, normal, pdf_area);
+    pdf_area *= pdf_choice;
+    return x;
+  }
+
+  // same as BRDF() and sampleBRDF() in brdf.frag
+  static glm::vec3 BRDF(const Material& material) {
+    return material.brdf_type == 0 ? material.kd / PI : glm::vec3(0);
+  }
+
+  static glm::vec3 sampleBRDF(const glm::vec3& wo, glm::vec3& wi,
+                              const Material& material, RNG& rng,
+                              float& pdf) {
+    switch (material.brdf_type) {
+      // lambert
+      case 0: {
+        const float u = rng();
+        const float v = rng();
+        wi = sampleCosineHemisphere(u, v, pdf);
+        return material.kd / PI;
+      }
+      // mirror
+      case 1:
+        pdf = 1;
+        wi = glm::reflect(-wo, glm::vec3(0, 1, 0));
+        return material.kd / std::abs(wi.y);
+      // glass
+      case 2: {
+        pdf = 1;
+
+        // set appropriate normal and ior
+        glm::vec3 n(0, 1, 0);
+        float ior1 = 1.0f;
+        float ior2 = 1.5f;
+        if (wo.y < 0) {
+          n = glm::vec3(0, -1, 0);
+          ior1 = 1.5f;
+          ior2 = 1.0f;
+        }
+        const float eta = ior1 / ior2;
+
+        // fresnel
+        const float F0 = std::pow((ior1 - ior2) / (ior1 + ior2), 2.0f);
+        const float fr = F0 + (1 - F0) * std::pow(1 - std::abs(wo.y), 5.0f);
+
+        if (rng() < fr) {
+          // reflection
+          wi = glm::reflect(-wo, n);
+        } else {
+          // refract, total reflection when refract fails
+          wi = glm::refract(-wo, n, eta);
+          if (wi == glm::vec3(0)) wi = glm::reflect(-wo, n);
+        }
+        return material.kd / std::abs(wi.y);
+      }
+    }
+    pdf = 0;
+    return glm::vec3(0);
+  }
+
+  static glm::vec3 worldToLocal(const glm::vec3& v, const IntersectInfo& info) {
+    return glm::vec3(glm::dot(v, info.dpdu), glm::dot(v, info.hitNormal),
+                     glm::dot(v, info.dpdv));
+  }
+  static glm::vec3 localToWorld(const glm::vec3& v, const IntersectInfo& info) {
+    return v.x * info.dpdu + v.y * info.hitNormal + v.z * info.dpdv;
+  }
+
+  // same as sampleLight() in pt-nee.frag
+  bool sampleLight(const Light& light, const IntersectInfo& info, RNG& rng,
+                   glm::vec3& wi, float& pdf, float& ray_count) const {
+    glm::vec3 normal;
+    float pdf_area;
+    int primID;
+    const glm::vec3 sampledPos =
+        samplePointOnLight(light, rng, primID, normal, pdf_area);
+
+    // test visibility
+    wi = glm::normalize(sampledPos - info.hitPos);
+    if (glm::dot(wi, info.hitNormal) < 0) return false;
+
+    IntersectInfo shadowInfo;
+    if (intersect({info.hitPos, wi}, shadowInfo, ray_count) &&
+        shadowInfo.primID == primID &&
+        glm::distance(shadowInfo.hitPos, sampledPos) < 0.1f) {
+      // convert area p.d.f. to solid angle p.d.f.
+      const float r = shadowInfo.t;
+      const float cos_term = std::abs(glm::dot(-wi, normal));
+      pdf = r * r / cos_term * pdf_area;
+      return true;
+    }
+    return false;
+  }
+
+  // computeRadiance() of pt.frag, or pt-nee.frag with NEE
+  glm::vec3 computeRadiance(Ray ray, RNG& rng, float& ray_count) const {
+    float russian_roulette_prob = 1;
+    glm::vec3 color(0);
+    glm::vec3 throughput(1);
+    bool is_previous_specular = false;
+    for (unsigned int i = 0; i < max_depth; ++i) {
+      // russian roulette
+      if (rng() >= russian_roulette_prob) break;
+      throughput /= russian_roulette_prob;
+
+      IntersectInfo info;
+      if (!intersect(ray, info, ray_count)) break;
+
+      const Material& material = scene->block.materials[info.materialID];
+      const glm::vec3 wo_local = worldToLocal(-ray.direction, info);
+
+      // Le
+      if ((!nee || is_previous_specular || i == 0) &&
+          glm::any(glm::greaterThan(material.le, glm::vec3(0)))) {
+        color += throughput * material.le;
+        break;
+      }
+
+      // light sampling
+      if (nee && material.brdf_type == 0) {
+        for (int k = 0; k < scene->block.n_lights; ++k) {
+          const Light& light = scene->block.lights[k];
+          glm::vec3 wi_light;
+          float pdf_light;
+          if (sampleLight(light, info, rng, wi_light, pdf_light, ray_count)) {
+            const float cos_term = std::abs(worldToLocal(wi_light, info).y);
+            // prevent firefly
+            if (pdf_light > 0.01f) {
+              color += throughput * BRDF(material) * cos_term * light.le /
+                       pdf_light;
+            }
+          }
+        }
+      }
+
+      // BRDF sampling
+      float pdf_brdf;
+      glm::vec3 wi_local;
+      const glm::vec3 brdf =
+          sampleBRDF(wo_local, wi_local, material, rng, pdf_brdf);
+      // prevent NaN
+      if (pdf_brdf == 0) break;
+
+      // update throughput
+      throughput *= brdf * std::abs(wi_local.y) / pdf_brdf;
+
+      // update russian roulette probability
+      russian_roulette_prob = std::min(
+          std::max(std::max(throughput.x, throughput.y), throughput.z), 1.0f);
+
+      // set next ray
+      ray = {info.hitPos, localToWorld(wi_local, info)};
+      is_previous_specular = material.brdf_type != 0;
+    }
+    return color;
+  }
+
+  // same as rayGen() in raygen.frag
+  Ray rayGen(const glm::vec2& uv, float& pdf) const {
+    const glm::vec3 pinholePos = camera.camPos + camera.a * camera.camForward;
+    const glm::vec3 sensorPos =
+        camera.camPos + uv.x * camera.camRight + uv.y * camera.camUp;
+
+    Ray ray;
+    ray.origin = camera.camPos;
+    ray.direction = glm::normalize(pinholePos - sensorPos);
+    pdf = 1.0f / std::pow(glm::dot(ray.direction, camera.camForward), 3.0f);
+    return ray;
+  }
+
+  // main() of pt.frag
+  void renderPixel(unsigned int x, unsigned int y) {
+    const unsigned int pixel = y * resolution.x + x;
+    glm::vec4& m = moments[pixel];
+    // skip converged pixel, accumulated values are kept
+    if (isConverged(m)) return;
+
+    glm::vec3 radiance(0);
+    glm::vec2 lum_moments(0);
+    float ray_count = 0;
+    for (unsigned int k = 0; k < samples_per_pass; ++k) {
+      RNG rng(pixel, static_cast<std::uint32_t>(m.z) + k, seed);
+
+      // pixel center is at gl_FragCoord
+      const glm::vec2 frag_coord =
+          glm::vec2(x + 0.5f, y + 0.5f) + glm::vec2(rng(), rng());
+      glm::vec2 uv = (2.0f * frag_coord - glm::vec2(resolution)) /
+                     static_cast<float>(resolution.y);
+      uv.y = -uv.y;
+      float pdf;
+      const Ray ray = rayGen(uv, pdf);
+      const float cos_term = glm::dot(camera.camForward, ray.direction);
+
+      const glm::vec3 L = computeRadiance(ray, rng, ray_count) / pdf * cos_term;
+      radiance += L;
+
+      const float lum = luminance(L);
+      lum_moments += glm::vec2(lum, lum * lum);
+    }
+
+    accum[pixel] += glm::vec4(radiance, ray_count);
+    m += glm::vec4(lum_moments, samples_per_pass, 0);
+  }
+
+  void renderTile(unsigned int tile) {
+    const glm::uvec2 offset =
+        TILE_SIZE * glm::uvec2(tile % n_tiles.x, tile / n_tiles.x);
+    const glm::uvec2 end = glm::min(offset + TILE_SIZE, resolution);
+    for (unsigned int y = offset.y; y < end.y; ++y) {
+      for (unsigned int x = offset.x; x < end.x; ++x) {
+        renderPixel(x, y);
+      }
+    }
+  }
+
+  // own tiles first, then steal from others
+  void runTiles(unsigned int id) {
+    unsigned int tile;
+    while (queues[id].popFront(tile)) {
+      renderTile(tile);
+    }
+    for (unsigned int i = 1; i < queues.size(); ++i) {
+      TileQueue& victim = queues[(id + i) % queues.size()];
+      while (victim.popBack(tile)) {
+        renderTile(tile);
+      }
+    }
+  }
+
+  void workerLoop(unsigned int id) {
+    unsigned int seen_pass = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        start_cv.wait(lock, [&] { return quit || pass_id != seen_pass; });
+        if (quit) return;
+        seen_pass = pass_id;
+      }
+
+      runTiles(id);
+
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      if (--running == 0) done_cv.notify_one();
+    }
+  }
+
+ public:
+  // n_threads 0 uses all cores
+  CPURenderer(unsigned int width, unsigned int height,
+              unsigned int n_threads = 0)
+      : scene(nullptr),
+        camera(Camera().params),
+        nee(false),
+        samples_per_pass(1),
+        max_depth(100),
+        adaptive_threshold(0),
+        adaptive_min_samples(64),
+        seed(0),
+        samples(0),
+        use_packets(false),
+        has_triangles(false),
+        pass_id(0),
+        running(0),
+        quit(false) {
+    resize(width, height);
+
+    if (n_threads == 0) {
+      n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    queues = std::vector<TileQueue>(n_threads);
+    for (unsigned int i = 0; i < n_threads; ++i) {
+      workers.emplace_back(&CPURenderer::workerLoop, this, i);
+    }
+  }
+  CPURenderer(const CPURenderer&) = delete;
+  CPURenderer& operator=(const CPURenderer&) = delete;
+
+  ~CPURenderer() {
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      quit = true;
+    }
+    start_cv.notify_all();
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  }
+
+  void clear() {
+    std::fill(accum.begin(), accum.end(), glm::vec4(0));
+    std::fill(moments.begin(), moments.end(), glm::vec4(0));
+    samples = 0;
+  }
+
+  void resize(unsigned int width, unsigned int height) {
+    resolution = glm::uvec2(width, height);
+    n_tiles = (resolution + glm::uvec2(TILE_SIZE - 1)) / TILE_SIZE;
+    accum.assign(width * height, glm::vec4(0));
+    moments.assign(width * height, glm::vec4(0));
+    samples = 0;
+  }
+
+  // scene is referenced, call again after it is changed
+  void setScene(const Scene& scene) {
+    this->scene = &scene;
+    setupPackets();
+    clear();
+  }
+  void setCamera(const CameraBlock& camera) {
+    this->camera = camera;
+    clear();
+  }
+
+  bool getNEE() const { return nee; }
+  void setNEE(bool nee) {
+    this->nee = nee;
+    clear();
+  }
+
+  unsigned int getSamplesPerPass() const { return samples_per_pass; }
+  void setSamplesPerPass(unsigned int samples_per_pass) {
+    this->samples_per_pass = std::max(samples_per_pass, 1u);
+  }
+
+  void setMaxDepth(unsigned int max_depth) {
+    this->max_depth = max_depth;
+    clear();
+  }
+  void setSeed(unsigned int seed) {
+    this->seed = seed;
+    clear();
+  }
+  void setAdaptiveThreshold(float adaptive_threshold) {
+    this->adaptive_threshold = adaptive_threshold;
+  }
+  void setAdaptiveMinSamples(unsigned int adaptive_min_samples) {
+    this->adaptive_min_samples = std::max(adaptive_min_samples, 2u);
+  }
+
+  unsigned int getSamples() const { return samples; }
+  unsigned int getThreadCount() const { return workers.size(); }
+  // SIMD lanes of sphere and plane intersection
+  static constexpr int getSIMDWidth() { return W; }
+
+  // same layout as accumTexture and momentsTexture
+  const std::vector<glm::vec4>& getAccum() const { return accum; }
+  const std::vector<glm::vec4>& getMoments() const { return moments; }
+
+  // add samples_per_pass samples on every pixel
+  void accumulate() {
+    if (!scene) return;
+
+    // tiles are dealt round robin, idle workers steal the rest
+    const unsigned int n_tiles_total = n_tiles.x * n_tiles.y;
+    for (unsigned int i = 0; i < n_tiles_total; ++i) {
+      queues[i % queues.size()].tiles.push_back(i);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      pass_id++;
+      running = workers.size();
+    }
+    start_cv.notify_all();
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    done_cv.wait(lock, [&] { return running == 0; });
+
+    samples += samples_per_pass;
+  }
+
+  Image getImage() const {
+    Image image(resolution.x, resolution.y);
+    for (unsigned int i = 0; i < image.width * image.height; ++i) {
+      const float n = moments[i].z;
+      const float samplesInv = n > 0 ? 1.0f / n : 0.0f;
+      image.pixels[3 * i + 0] = accum[i].x * samplesInv;
+      image.pixels[3 * i + 1] = accum[i].y * samplesInv;
+      image.pixels[3 * i + 2] = accum[i].z * samplesInv;
+    }
+    return image;
+  }
+
+  // ratio of pixels which stopped sampling
+  float getConvergedRatio() const {
+    if (adaptive_threshold <= 0) return 0;
+    unsigned int n_converged = 0;
+    for (const glm::vec4& m : moments) {
+      if (isConverged(m)) n_converged++;
+    }
+    return static_cast<float>(n_converged) / moments.size();
+  }
+};
+
+#endif
\ No newline at end of file
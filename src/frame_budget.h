@@ -0,0 +1,55 @@
+#ifndef _FRAME_BUDGET_H
+#define _FRAME_BUDGET_H
+#include <algorithm>
+#include <cmath>
+
+// chooses samples per pass so that a frame takes target_ms
+class FrameBudget {
+ private:
+  float target_ms;
+  unsigned int max_samples_per_pass;
+  float ms_per_sample;  // smoothed estimate, 0 until first update
+
+ public:
+  FrameBudget(float target_ms, unsigned int max_samples_per_pass = 256)
+      : target_ms(target_ms),
+        max_samples_per_pass(max_samples_per_pass),
+        ms_per_sample(0) {}
+
+  float getTarget() const { return target_ms; }
+  void setTarget(float target_ms) { this->target_ms = target_ms; }
+
+  // frame_ms: measured time of the frame rendered with samples_per_pass
+  // return: samples per pass for next frame
+  unsigned int update(unsigned int samples_per_pass, float frame_ms) {
+    if (samples_per_pass == 0 || frame_ms <= 0) return 1;
+
+    // fixed overhead per frame is folded into the per sample cost, the
+    // estimate still converges to frame_ms == target_ms
+    const float measured = frame_ms / samples_per_pass;
+    ms_per_sample = ms_per_sample == 0
+                        ? measured
+                        : 0.8f * ms_per_sample + 0.2f * measured;
+
+    // limit the step so a single slow frame does not collapse the budget
+    const float next = std::clamp(target_ms / ms_per_sample,
+                                  0.5f * samples_per_pass,
+                                  2.0f * samples_per_pass);
+    return std::clamp(static_cast<unsigned int>(std::round(next)), 1u,
+                      max_samples_per_pass);
+  }
+
+  // tile size whose pass takes about target_ms, given frame_ms of a full
+  // pass with one sample per pixel
+  // power of two, so that tiles stay aligned when size changes
+  unsigned int getTileSize(unsigned int width, unsigned int height,
+                           float frame_ms) const {
+    const float n_tiles = std::max(frame_ms / target_ms, 1.0f);
+    const float size = std::sqrt(width * height / n_tiles);
+    const unsigned int log2_size =
+        static_cast<unsigned int>(std::max(std::floor(std::log2(size)), 5.0f));
+    return 1u << log2_size;
+  }
+};
+
+#endif
\ No newline at end of file
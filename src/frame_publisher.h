@@ -0,0 +1,404 @@
+#ifndef _FRAME_PUBLISHER_H
+#define _FRAME_PUBLISHER_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FRAME_PUBLISHER_POSIX
+#endif
+
+#include "image.h"
+
+// frames in POSIX shared memory, laid out as
+// SharedFrameHeader, then n_slots times (SharedFrameSlot, pixels)
+// each slot is guarded by a seqlock, so readers never block the publisher
+// and the publisher never waits for readers
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory frames require lock free 64bit atomics");
+
+enum class FrameFormat : uint32_t {
+  // tone mapped same as output.frag, alpha is 255
+  RGBA8 = 0,
+  // accumulation divided by number of samples, same as Renderer::getImage()
+  RGB32F = 1,
+};
+
+// metadata of a frame, rows of pixels are bottom to top
+struct SharedFrameInfo {
+  // 1 for first published frame
+  uint64_t frame;
+  // seconds since publisher was opened
+  double time;
+  uint32_t samples;
+  uint32_t width;
+  uint32_t height;
+  FrameFormat format;
+  float camera_position[3];
+  float camera_forward[3];
+  float camera_up[3];
+  // vertical, radians
+  float camera_fov;
+  char scene[128];
+};
+
+struct SharedFrameHeader {
+  static constexpr uint32_t MAGIC = 0x52464243;  // "CBFR"
+  static constexpr uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t n_slots;
+  uint32_t width;
+  uint32_t height;
+  FrameFormat format;
+  // bytes from start of one slot to the next
+  uint64_t slot_stride;
+  // number of published frames, newest is in slot (latest - 1) % n_slots
+  std::atomic<uint64_t> latest;
+  // set when publisher is closed or resized, readers should open again
+  std::atomic<uint32_t> closed;
+};
+
+struct SharedFrameSlot {
+  // odd while publisher writes this slot
+  std::atomic<uint64_t> sequence;
+  SharedFrameInfo info;
+};
+
+namespace shared_frame {
+
+// pixels start at cache line after SharedFrameSlot
+constexpr size_t PIXEL_OFFSET = (sizeof(SharedFrameSlot) + 63) / 64 * 64;
+constexpr size_t HEADER_SIZE = (sizeof(SharedFrameHeader) + 63) / 64 * 64;
+
+inline size_t bytesPerPixel(FrameFormat format) {
+  return format == FrameFormat::RGBA8 ? 4 : 3 * sizeof(float);
+}
+
+inline size_t slotStride(unsigned int width, unsigned int height,
+                         FrameFormat format) {
+  const size_t pixels = bytesPerPixel(format) * width * height;
+  return PIXEL_OFFSET + (pixels + 63) / 64 * 64;
+}
+
+}  // namespace shared_frame
+
+// writes frames into shared memory, called by one thread at a time
+class FramePublisher {
+ public:
+  // slots in ring, readers have n_slots - 1 frames of time to read one
+  static constexpr unsigned int DEFAULT_SLOTS = 3;
+
+ private:
+  std::string name;
+  FrameFormat format;
+  unsigned int n_slots;
+  unsigned char* memory;
+  size_t size;
+  // segment could not be created, not tried again until open()
+  bool failed;
+  std::chrono::steady_clock::time_point start;
+
+  std::atomic<uint64_t> n_published;
+  // total time spent in publish()
+  std::atomic<uint64_t> publish_ns;
+
+  SharedFrameHeader* header() const {
+    return reinterpret_cast<SharedFrameHeader*>(memory);
+  }
+  SharedFrameSlot* slot(unsigned int i) const {
+    return reinterpret_cast<SharedFrameSlot*>(
+        memory + shared_frame::HEADER_SIZE + i * header()->slot_stride);
+  }
+
+  // create segment for frames of given size, replaces existing segment
+  bool create(unsigned int width, unsigned int height) {
+#ifdef FRAME_PUBLISHER_POSIX
+    unmap();
+
+    const size_t stride = shared_frame::slotStride(width, height, format);
+    const size_t size = shared_frame::HEADER_SIZE + n_slots * stride;
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+      std::cerr << "failed to create shared memory " << name << std::endl;
+      return false;
+    }
+    if (ftruncate(fd, size) != 0) {
+      std::cerr << "failed to resize shared memory " << name << std::endl;
+      close(fd);
+      shm_unlink(name.c_str());
+      return false;
+    }
+    void* memory =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+      std::cerr << "failed to map shared memory " << name << std::endl;
+      shm_unlink(name.c_str());
+      return false;
+    }
+    this->memory = static_cast<unsigned char*>(memory);
+    this->size = size;
+
+    SharedFrameHeader* header = new (this->memory) SharedFrameHeader();
+    header->magic = SharedFrameHeader::MAGIC;
+    header->version = SharedFrameHeader::VERSION;
+    header->n_slots = n_slots;
+    header->width = width;
+    header->height = height;
+    header->format = format;
+    header->slot_stride = stride;
+    header->latest.store(0, std::memory_order_relaxed);
+    header->closed.store(0, std::memory_order_relaxed);
+    for (unsigned int i = 0; i < n_slots; ++i) {
+      new (slot(i)) SharedFrameSlot();
+      slot(i)->sequence.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+#else
+    (void)width;
+    (void)height;
+    std::cerr << "shared memory frames require POSIX" << std::endl;
+    return false;
+#endif
+  }
+
+  // readers still mapping segment see closed and open again
+  void unmap() {
+#ifdef FRAME_PUBLISHER_POSIX
+    if (!memory) return;
+    header()->closed.store(1, std::memory_order_release);
+    munmap(memory, size);
+    memory = nullptr;
+    size = 0;
+#endif
+  }
+
+  // pixels of image into slot, tone mapped when format is RGBA8
+  void writePixels(const Image& image, unsigned char* dst) const {
+    const unsigned int n_pixels = image.width * image.height;
+    if (format == FrameFormat::RGB32F) {
+      std::memcpy(dst, image.pixels.data(), n_pixels * 3 * sizeof(float));
+      return;
+    }
+    for (unsigned int i = 0; i < n_pixels; ++i) {
+      dst[4 * i + 0] = image.toneMap(3 * i + 0);
+      dst[4 * i + 1] = image.toneMap(3 * i + 1);
+      dst[4 * i + 2] = image.toneMap(3 * i + 2);
+      dst[4 * i + 3] = 255;
+    }
+  }
+
+ public:
+  FramePublisher()
+      : format(FrameFormat::RGBA8),
+        n_slots(DEFAULT_SLOTS),
+        memory(nullptr),
+        size(0),
+        failed(false),
+        n_published(0),
+        publish_ns(0) {}
+  FramePublisher(const FramePublisher&) = delete;
+  FramePublisher& operator=(const FramePublisher&) = delete;
+  ~FramePublisher() { destroy(); }
+
+  // name is name of shared memory object, e.g. /cornellbox
+  // segment is created by first publish() and recreated on resize
+  void open(const std::string& name, FrameFormat format,
+            unsigned int n_slots = DEFAULT_SLOTS) {
+    destroy();
+    this->name = name[0] == '/' ? name : "/" + name;
+    this->format = format;
+    this->n_slots = std::max(n_slots, 2u);
+    failed = false;
+    start = std::chrono::steady_clock::now();
+  }
+  bool isOpen() const { return !name.empty(); }
+  const std::string& getName() const { return name; }
+
+  // copy image into next slot and make it latest frame, never waits
+  bool publish(const Image& image, SharedFrameInfo info) {
+    if (!isOpen() || failed) return false;
+    const auto publish_start = std::chrono::steady_clock::now();
+    if (!memory || header()->width != image.width ||
+        header()->height != image.height) {
+      if (!create(image.width, image.height)) {
+        failed = true;
+        return false;
+      }
+    }
+
+    SharedFrameHeader* header = this->header();
+    const uint64_t frame = header->latest.load(std::memory_order_relaxed) + 1;
+    SharedFrameSlot* slot = this->slot((frame - 1) % n_slots);
+
+    // seqlock write, readers of this slot retry until sequence is even
+    const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    info.frame = frame;
+    info.time =
+        std::chrono::duration<double>(publish_start - start).count();
+    info.width = image.width;
+    info.height = image.height;
+    info.format = format;
+    slot->info = info;
+    writePixels(image, reinterpret_cast<unsigned char*>(slot) +
+                           shared_frame::PIXEL_OFFSET);
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    header->latest.store(frame, std::memory_order_release);
+
+    n_published.fetch_add(1, std::memory_order_relaxed);
+    publish_ns.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - publish_start)
+            .count(),
+        std::memory_order_relaxed);
+    return true;
+  }
+
+  uint64_t getPublishedCount() const {
+    return n_published.load(std::memory_order_relaxed);
+  }
+  // average time of publish() [ms]
+  double getAveragePublishTime() const {
+    const uint64_t n = getPublishedCount();
+    return n > 0 ? 1e-6 * publish_ns.load(std::memory_order_relaxed) / n : 0;
+  }
+
+  // readers are told to stop and shared memory object is removed
+  void destroy() {
+#ifdef FRAME_PUBLISHER_POSIX
+    unmap();
+    if (isOpen()) shm_unlink(name.c_str());
+#endif
+    name.clear();
+  }
+};
+
+// maps frames of FramePublisher read only
+class FrameReader {
+ public:
+  // latest frame at time of acquire(), pixels point into shared memory
+  struct View {
+    SharedFrameInfo info;
+    const unsigned char* pixels = nullptr;
+    const SharedFrameSlot* slot = nullptr;
+    uint64_t sequence = 0;
+  };
+
+ private:
+  const unsigned char* memory;
+  size_t size;
+
+  const SharedFrameHeader* header() const {
+    return reinterpret_cast<const SharedFrameHeader*>(memory);
+  }
+
+ public:
+  FrameReader() : memory(nullptr), size(0) {}
+  FrameReader(const FrameReader&) = delete;
+  FrameReader& operator=(const FrameReader&) = delete;
+  ~FrameReader() { destroy(); }
+
+  // false when publisher has not published yet
+  bool open(const std::string& name) {
+#ifdef FRAME_PUBLISHER_POSIX
+    destroy();
+    const std::string path = name[0] == '/' ? name : "/" + name;
+    const int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < shared_frame::HEADER_SIZE) {
+      close(fd);
+      return false;
+    }
+    void* memory = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) return false;
+    this->memory = static_cast<const unsigned char*>(memory);
+    this->size = st.st_size;
+
+    const SharedFrameHeader* header = this->header();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != SharedFrameHeader::MAGIC ||
+        header->version != SharedFrameHeader::VERSION ||
+        shared_frame::HEADER_SIZE + header->n_slots * header->slot_stride >
+            size) {
+      std::cerr << path << " is not a frame of this version" << std::endl;
+      destroy();
+      return false;
+    }
+    return true;
+#else
+    (void)name;
+    return false;
+#endif
+  }
+  bool isOpen() const { return memory != nullptr; }
+
+  // publisher was closed or resized, open() again
+  bool isClosed() const {
+    return !memory || header()->closed.load(std::memory_order_acquire);
+  }
+
+  // latest frame without copying pixels, false when there is none yet
+  // pixels may be overwritten while reading, check with validate() after
+  bool acquire(View& view) const {
+    if (isClosed()) return false;
+    const SharedFrameHeader* header = this->header();
+    // publisher can lap slow readers, try newer frame then
+    for (int retry = 0; retry < 16; ++retry) {
+      const uint64_t latest = header->latest.load(std::memory_order_acquire);
+      if (latest == 0) return false;
+      const SharedFrameSlot* slot = reinterpret_cast<const SharedFrameSlot*>(
+          memory + shared_frame::HEADER_SIZE +
+          (latest - 1) % header->n_slots * header->slot_stride);
+
+      const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+      if (sequence & 1) continue;
+      view.info = slot->info;
+      view.pixels =
+          reinterpret_cast<const unsigned char*>(slot) +
+          shared_frame::PIXEL_OFFSET;
+      view.slot = slot;
+      view.sequence = sequence;
+      if (validate(view)) return true;
+    }
+    return false;
+  }
+
+  // true when frame of view was not overwritten since acquire()
+  bool validate(const View& view) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return view.slot->sequence.load(std::memory_order_relaxed) ==
+           view.sequence;
+  }
+
+  void destroy() {
+#ifdef FRAME_PUBLISHER_POSIX
+    if (memory) munmap(const_cast<unsigned char*>(memory), size);
+#endif
+    memory = nullptr;
+    size = 0;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "frame_publisher.h"
+#include "image.h"
+
+// example reader of frames published by main or headless with --publish
+// pixels are read in place, nothing is copied out of shared memory
+
+struct Options {
+  std::string name = "/cornellbox";
+  double seconds = 10;
+  // publish synthetic frames in this process instead of reading renderer
+  bool bench = false;
+  unsigned int width = 512;
+  unsigned int height = 512;
+  FrameFormat format = FrameFormat::RGBA8;
+};
+
+void printUsage() {
+  std::cout << "Usage: frame_reader [options]\n"
+            << "  --name <name>                  shared memory object "
+               "(default: /cornellbox)\n"
+            << "  --seconds <s>                  time to read (default: 10)\n"
+            << "  --bench                        measure throughput with "
+               "synthetic frames\n"
+            << "  --resolution <WxH>             frame size of --bench "
+               "(default: 512x512)\n"
+            << "  --format <rgba8|rgb32f>        frame format of --bench "
+               "(default: rgba8)\n";
+}
+
+[[noreturn]] void invalidArgument(const std::string& arg) {
+  std::cerr << "invalid argument: " << arg << std::endl;
+  printUsage();
+  std::exit(EXIT_FAILURE);
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      printUsage();
+      std::exit(EXIT_SUCCESS);
+    } else if (arg == "--bench") {
+      options.bench = true;
+      continue;
+    }
+
+    if (i + 1 >= argc) invalidArgument(arg);
+    const std::string value = argv[++i];
+    if (arg == "--name") {
+      options.name = value;
+    } else if (arg == "--seconds") {
+      options.seconds = std::stod(value);
+    } else if (arg == "--resolution") {
+      const size_t x = value.find('x');
+      if (x == std::string::npos) invalidArgument(value);
+      options.width = std::stoul(value.substr(0, x));
+      options.height = std::stoul(value.substr(x + 1));
+    } else if (arg == "--format") {
+      if (value == "rgba8") {
+        options.format = FrameFormat::RGBA8;
+      } else if (value == "rgb32f") {
+        options.format = FrameFormat::RGB32F;
+      } else {
+        invalidArgument(value);
+      }
+    } else {
+      invalidArgument(arg);
+    }
+  }
+  return options;
+}
+
+// mean of RGB, reads every pixel of frame
+double meanValue(const FrameReader::View& view) {
+  const size_t n_pixels =
+      static_cast<size_t>(view.info.width) * view.info.height;
+  double sum = 0;
+  if (view.info.format == FrameFormat::RGBA8) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < n_pixels; ++i) {
+      total += view.pixels[4 * i + 0] + view.pixels[4 * i + 1] +
+               view.pixels[4 * i + 2];
+    }
+    sum = total / 255.0;
+  } else {
+    const float* pixels = reinterpret_cast<const float*>(view.pixels);
+    for (size_t i = 0; i < 3 * n_pixels; ++i) sum += pixels[i];
+  }
+  return n_pixels > 0 ? sum / (3 * n_pixels) : 0;
+}
+
+size_t frameBytes(const SharedFrameInfo& info) {
+  return shared_frame::bytesPerPixel(info.format) * info.width * info.height;
+}
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+
+  // publisher thread stands in for renderer, publishes as fast as it can
+  FramePublisher publisher;
+  std::atomic<bool> quit(false);
+  std::thread bench_thread;
+  if (options.bench) {
+    publisher.open(options.name, options.format);
+    bench_thread = std::thread([&] {
+      Image image(options.width, options.height);
+      SharedFrameInfo info = {};
+      std::strncpy(info.scene, "bench", sizeof(info.scene) - 1);
+      while (!quit) {
+        info.samples++;
+        for (float& v : image.pixels) v = 1.0f / info.samples;
+        if (!publisher.publish(image, info)) break;
+      }
+    });
+  }
+
+  FrameReader reader;
+  uint64_t last_frame = 0;
+  uint64_t n_frames = 0, n_skipped = 0, n_torn = 0;
+  double bytes = 0;
+  uint64_t total_frames = 0;
+  double total_bytes = 0;
+
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  auto report = start;
+  while (std::chrono::duration<double>(Clock::now() - start).count() <
+         options.seconds) {
+    // publisher is not running yet, or was resized or closed
+    if (reader.isClosed()) {
+      if (!reader.open(options.name)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+      last_frame = 0;
+    }
+
+    FrameReader::View view;
+    if (!reader.acquire(view) || view.info.frame == last_frame) {
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+      continue;
+    }
+    const double mean = meanValue(view);
+    // publisher overwrote frame while it was read, result is discarded
+    if (!reader.validate(view)) {
+      n_torn++;
+      continue;
+    }
+    if (last_frame > 0 && view.info.frame > last_frame + 1) {
+      n_skipped += view.info.frame - last_frame - 1;
+    }
+    last_frame = view.info.frame;
+    n_frames++;
+    bytes += frameBytes(view.info);
+
+    const auto now = Clock::now();
+    const double interval = std::chrono::duration<double>(now - report).count();
+    if (interval >= 1.0) {
+      std::cout << "frame " << view.info.frame << " (" << view.info.width
+                << "x" << view.info.height << ", " << view.info.samples
+                << " spp, " << view.info.scene << ") mean " << std::fixed
+                << std::setprecision(4) << mean << ": " << std::setprecision(1)
+                << n_frames / interval << " frames/s, "
+                << bytes / interval / (1 << 20) << " MiB/s, skipped "
+                << n_skipped << ", torn " << n_torn << std::endl;
+      std::cout.unsetf(std::ios::fixed);
+      std::cout << std::setprecision(6);
+      total_frames += n_frames;
+      total_bytes += bytes;
+      n_frames = n_skipped = n_torn = 0;
+      bytes = 0;
+      report = now;
+    }
+  }
+  total_frames += n_frames;
+  total_bytes += bytes;
+
+  const double elapsed =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << "read " << total_frames << " frames in " << elapsed << " s ("
+            << total_frames / elapsed << " frames/s, "
+            << total_bytes / elapsed / (1 << 20) << " MiB/s)" << std::endl;
+
+  if (options.bench) {
+    quit = true;
+    bench_thread.join();
+    std::cout << "published " << publisher.getPublishedCount() << " frames ("
+              << publisher.getAveragePublishTime() << " ms per frame)"
+              << std::endl;
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+#ifndef _GL_STATE_H
+#define _GL_STATE_H
+#include <array>
+
+#include "glad/glad.h"
+
+// cache of bound program, VAO, textures and UBOs
+// binds of already bound objects are skipped, so every bind of these has to
+// go through this class
+class GLState {
+ public:
+  // GL 3.3 has at least 48 combined texture units
+  static constexpr unsigned int MAX_TEXTURE_UNITS = 48;
+  // unit for creating and reading textures, never sampled by shaders
+  static constexpr unsigned int SCRATCH_UNIT = MAX_TEXTURE_UNITS - 1;
+  static constexpr unsigned int MAX_UNIFORM_BUFFERS = 16;
+
+  // GL calls issued and redundant calls skipped
+  struct Counters {
+    unsigned int calls = 0;
+    unsigned int skipped = 0;
+  };
+
+ private:
+  // 0 is a valid binding, unknown state is ~0u
+  static constexpr GLuint UNKNOWN = ~0u;
+
+  GLuint program;
+  GLuint vao;
+  unsigned int active_unit;
+  std::array<GLuint, MAX_TEXTURE_UNITS> textures_2d;
+  std::array<GLuint, MAX_TEXTURE_UNITS> texture_buffers;
+  std::array<GLuint, MAX_UNIFORM_BUFFERS> uniform_buffers;
+
+  Counters counters;
+  Counters last_frame;
+
+  GLState() { invalidate(); }
+
+  // return true when call is needed
+  bool update(GLuint& cached, GLuint value) {
+    if (cached == value) {
+      counters.skipped++;
+      return false;
+    }
+    cached = value;
+    counters.calls++;
+    return true;
+  }
+
+  void activeTexture(unsigned int unit) {
+    if (update(active_unit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+  }
+
+ public:
+  static GLState& get() {
+    static GLState state;
+    return state;
+  }
+
+  // forget cached state, e.g. after objects are deleted or state is changed
+  // outside of this class
+  void invalidate() {
+    program = UNKNOWN;
+    vao = UNKNOWN;
+    active_unit = UNKNOWN;
+    textures_2d.fill(UNKNOWN);
+    texture_buffers.fill(UNKNOWN);
+    uniform_buffers.fill(UNKNOWN);
+  }
+
+  void useProgram(GLuint program) {
+    if (update(this->program, program)) glUseProgram(program);
+  }
+
+  void bindVertexArray(GLuint vao) {
+    if (update(this->vao, vao)) glBindVertexArray(vao);
+  }
+
+  // bind texture to unit, unit becomes active when bind is needed
+  void bindTexture(unsigned int unit, GLenum target, GLuint texture) {
+    GLuint& cached = target == GL_TEXTURE_BUFFER ? texture_buffers[unit]
+                                                 : textures_2d[unit];
+    if (cached == texture) {
+      counters.skipped++;
+      return;
+    }
+    activeTexture(unit);
+    update(cached, texture);
+    glBindTexture(target, texture);
+  }
+
+  // bind for creating, resizing or reading texture
+  // glTexImage2D() and glGetTexImage() use active unit, so scratch unit is
+  // made active even when texture is already bound to it
+  void bindScratchTexture(GLenum target, GLuint texture) {
+    activeTexture(SCRATCH_UNIT);
+    bindTexture(SCRATCH_UNIT, target, texture);
+  }
+
+  void bindUniformBuffer(GLuint index, GLuint buffer) {
+    if (update(uniform_buffers[index], buffer)) {
+      glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer);
+    }
+  }
+
+  // count a call made by caller, e.g. glUniform*
+  void countCall() { counters.calls++; }
+  void countSkipped() { counters.skipped++; }
+
+  // call once per frame, counters of previous frame are kept
+  void beginFrame() {
+    last_frame = counters;
+    counters = Counters();
+  }
+  const Counters& getLastFrameCounters() const { return last_frame; }
+  const Counters& getCounters() const { return counters; }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,586 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// HEADLESS_CPU_ONLY builds CPU backend alone, without EGL and GL loader
+#ifndef HEADLESS_CPU_ONLY
+#include "glad/glad.h"
+#endif
+//
+#include "glm/glm.hpp"
+//
+#include "constant.h"
+#include "cpu_renderer.h"
+#include "frame_budget.h"
+#include "frame_publisher.h"
+#include "image.h"
+#include "render_types.h"
+#ifndef HEADLESS_CPU_ONLY
+#include "headless_context.h"
+#include "renderer.h"
+#endif
+
+enum class Backend {
+  GL,
+  CPU,
+};
+
+struct Options {
+#ifdef HEADLESS_CPU_ONLY
+  Backend backend = Backend::CPU;
+#else
+  Backend backend = Backend::GL;
+#endif
+  unsigned int threads = 0;
+  SceneType scene_type = SceneType::Original;
+  std::string scene_file;
+  std::string save_scene;
+  Integrator integrator = Integrator::PT;
+  SamplerType sampler_type = SamplerType::PCG;
+  unsigned int seed = 0;
+  unsigned int width = 512;
+  unsigned int height = 512;
+  unsigned int samples = 256;
+  unsigned int samples_per_pass = 1;
+  float target_ms = 0;
+  unsigned int tile_size = 0;
+  float adaptive_threshold = 0;
+  unsigned int adaptive_min_samples = 64;
+  bool set_camera = false;
+  glm::vec3 camPos = glm::vec3(278, 273, -900);
+  glm::vec3 lookat = glm::vec3(278, 273, 279.6);
+  float fov = 45.0f;
+  std::string output = "output.pfm";
+  unsigned int snapshot_every = 0;
+  std::string publish;
+  FrameFormat publish_format = FrameFormat::RGBA8;
+  std::string checkpoint;
+  // [s]
+  float checkpoint_every = 300;
+  std::string resume;
+  std::string obj;
+  float obj_scale = 1.0f;
+  glm::vec3 obj_offset = glm::vec3(0);
+  glm::vec3 obj_emission = glm::vec3(0);
+  // render on both backends, fail when RMSE between them exceeds this
+  float compare = 0;
+};
+
+void printUsage() {
+  std::cout
+      << "Usage: headless [options]\n"
+#ifdef HEADLESS_CPU_ONLY
+      << "  --backend <cpu>                     only CPU backend in this "
+         "build\n"
+#else
+      << "  --backend <gl|cpu>                  render on GPU or CPU (default: "
+         "gl)\n"
+      << "  --compare <rmse>                    render on GPU and CPU, fail "
+         "when RMSE\n"
+      << "                                      of them is above this\n"
+#endif
+      << "  --threads <n>                       CPU backend threads (default: "
+         "all cores)\n"
+      << "  --scene <original|sphere|indirect>  scene type (default: "
+         "original)\n"
+      << "  --scene-file <file>                 load text or compiled scene "
+         "file\n"
+      << "  --save-scene <file>                 write compiled scene of "
+         "loaded scene\n"
+      << "  --integrator <pt|ptnee|wavefront>   integrator (default: pt)\n"
+      << "  --sampler <name>                    xorshift, sobol, bluenoise or "
+         "pcg (default: pcg)\n"
+      << "  --seed <n>                          global RNG seed (default: 0)\n"
+      << "  --resolution <width>x<height>       resolution (default: 512x512)\n"
+      << "  --samples <n>                       samples per pixel (default: "
+         "256)\n"
+      << "  --samples-per-pass <n>              samples per accumulation pass "
+         "(default: 1)\n"
+      << "  --target-ms <ms>                    adjust samples per pass to "
+         "this pass time\n"
+      << "  --tile-size <n>                     split each pass into scissored "
+         "tiles\n"
+      << "  --adaptive-threshold <e>            stop sampling pixels below "
+         "this relative error\n"
+      << "  --adaptive-min-samples <n>          samples before a pixel can "
+         "stop (default: 64)\n"
+      << "  --camera-pos <x,y,z>                camera position\n"
+      << "  --camera-lookat <x,y,z>             camera look at point\n"
+      << "  --fov <degrees>                     vertical FOV (default: 45)\n"
+      << "  --output <file>                     .pfm, .exr or .png (default: "
+         "output.pfm)\n"
+      << "  --snapshot-every <n>                also save output every n "
+         "samples\n"
+      << "  --publish <name>                    publish passes to shared "
+         "memory (gl backend)\n"
+      << "  --publish-format <rgba8|rgb32f>     format of published frames "
+         "(default: rgba8)\n"
+      << "  --checkpoint <file>                 save state to continue later "
+         "(gl backend)\n"
+      << "  --checkpoint-every <seconds>        interval of checkpoints "
+         "(default: 300)\n"
+      << "  --resume <file>                     continue from checkpoint of "
+         "same scene,\n"
+      << "                                      camera and integrator\n"
+      << "  --obj <file>                        add OBJ mesh to scene\n"
+      << "  --obj-scale <s>                     scale of OBJ mesh (default: "
+         "1)\n"
+      << "  --obj-offset <x,y,z>                offset of OBJ mesh\n"
+      << "  --obj-emission <r,g,b>              make OBJ mesh an emitter\n";
+}
+
+[[noreturn]] void invalidArgument(const std::string& arg) {
+  std::cerr << "invalid argument: " << arg << std::endl;
+  printUsage();
+  std::exit(EXIT_FAILURE);
+}
+
+glm::vec3 parseVec3(const std::string& str) {
+  glm::vec3 v;
+  if (std::sscanf(str.c_str(), "%f,%f,%f", &v.x, &v.y, &v.z) != 3) {
+    invalidArgument(str);
+  }
+  return v;
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      printUsage();
+      std::exit(EXIT_SUCCESS);
+    }
+
+    if (i + 1 >= argc) invalidArgument(arg);
+    const std::string value = argv[++i];
+
+    if (arg == "--backend") {
+#ifndef HEADLESS_CPU_ONLY
+      if (value == "gl") {
+        options.backend = Backend::GL;
+        continue;
+      }
+#endif
+      if (value == "cpu") {
+        options.backend = Backend::CPU;
+      } else {
+        invalidArgument(value);
+      }
+#ifndef HEADLESS_CPU_ONLY
+    } else if (arg == "--compare") {
+      options.compare = std::stof(value);
+      if (!(options.compare > 0)) invalidArgument(value);
+#endif
+    } else if (arg == "--threads") {
+      options.threads = std::stoul(value);
+    } else if (arg == "--scene") {
+      if (value == "original") {
+        options.scene_type = SceneType::Original;
+      } else if (value == "sphere") {
+        options.scene_type = SceneType::Sphere;
+      } else if (value == "indirect") {
+        options.scene_type = SceneType::Indirect;
+      } else {
+        invalidArgument(value);
+      }
+    } else if (arg == "--scene-file") {
+      options.scene_file = value;
+    } else if (arg == "--save-scene") {
+      options.save_scene = value;
+    } else if (arg == "--integrator") {
+      if (value == "pt") {
+        options.integrator = Integrator::PT;
+      } else if (value == "ptnee") {
+        options.integrator = Integrator::PTNEE;
+      } else if (value == "wavefront") {
+        options.integrator = Integrator::Wavefront;
+      } else {
+        invalidArgument(value);
+      }
+    } else if (arg == "--sampler") {
+      if (value == "xorshift") {
+        options.sampler_type = SamplerType::XORShift;
+      } else if (value == "sobol") {
+        options.sampler_type = SamplerType::Sobol;
+      } else if (value == "bluenoise") {
+        options.sampler_type = SamplerType::BlueNoise;
+      } else if (value == "pcg") {
+        options.sampler_type = SamplerType::PCG;
+      } else {
+        invalidArgument(value);
+      }
+    } else if (arg == "--seed") {
+      options.seed = std::stoul(value);
+    } else if (arg == "--resolution") {
+      if (std::sscanf(value.c_str(), "%ux%u", &options.width,
+                      &options.height) != 2 ||
+          options.width == 0 || options.height == 0) {
+        invalidArgument(value);
+      }
+    } else if (arg == "--samples") {
+      options.samples = std::stoul(value);
+    } else if (arg == "--samples-per-pass") {
+      options.samples_per_pass = std::max(1ul, std::stoul(value));
+    } else if (arg == "--target-ms") {
+      options.target_ms = std::stof(value);
+    } else if (arg == "--tile-size") {
+      options.tile_size = std::stoul(value);
+    } else if (arg == "--adaptive-threshold") {
+      options.adaptive_threshold = std::max(0.0f, std::stof(value));
+    } else if (arg == "--adaptive-min-samples") {
+      options.adaptive_min_samples = std::max(2ul, std::stoul(value));
+    } else if (arg == "--camera-pos") {
+      options.camPos = parseVec3(value);
+      options.set_camera = true;
+    } else if (arg == "--camera-lookat") {
+      options.lookat = parseVec3(value);
+      options.set_camera = true;
+    } else if (arg == "--fov") {
+      options.fov = std::stof(value);
+    } else if (arg == "--output") {
+      options.output = value;
+    } else if (arg == "--snapshot-every") {
+      options.snapshot_every = std::stoul(value);
+    } else if (arg == "--publish") {
+      options.publish = value;
+    } else if (arg == "--publish-format") {
+      if (value == "rgba8") {
+        options.publish_format = FrameFormat::RGBA8;
+      } else if (value == "rgb32f") {
+        options.publish_format = FrameFormat::RGB32F;
+      } else {
+        invalidArgument(value);
+      }
+    } else if (arg == "--checkpoint") {
+      options.checkpoint = value;
+    } else if (arg == "--checkpoint-every") {
+      options.checkpoint_every = std::stof(value);
+    } else if (arg == "--resume") {
+      options.resume = value;
+    } else if (arg == "--obj") {
+      options.obj = value;
+    } else if (arg == "--obj-scale") {
+      options.obj_scale = std::stof(value);
+    } else if (arg == "--obj-offset") {
+      options.obj_offset = parseVec3(value);
+    } else if (arg == "--obj-emission") {
+      options.obj_emission = parseVec3(value);
+    } else {
+      invalidArgument(arg);
+    }
+  }
+  return options;
+}
+
+// render on CPU without GL context, wavefront is same as pt
+Image renderCPU(const Options& options) {
+  Scene scene;
+  scene.setScene(options.scene_type);
+  if (!options.scene_file.empty()) {
+    const auto load_start = std::chrono::steady_clock::now();
+    Scene loaded;
+    SceneBinary binary;
+    const bool loaded_ok = SceneBinary::isSceneBinary(options.scene_file)
+                               ? binary.open(options.scene_file) &&
+                                     loaded.loadBinary(binary)
+                               : loaded.loadText(options.scene_file);
+    if (!loaded_ok) {
+      std::cerr << "failed to load " << options.scene_file << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    scene = std::move(loaded);
+    const auto load_end = std::chrono::steady_clock::now();
+    std::cout << "loaded " << options.scene_file << " in "
+              << std::chrono::duration<double, std::milli>(load_end -
+                                                           load_start)
+                     .count()
+              << " ms" << std::endl;
+  }
+  if (!options.obj.empty()) {
+    const Material material =
+        options.obj_emission != glm::vec3(0)
+            ? Scene::createLight(options.obj_emission)
+            : Scene::createDiffuse(glm::vec3(0.8));
+    if (!scene.loadOBJ(options.obj, material, options.obj_scale,
+                       options.obj_offset)) {
+      std::cerr << "failed to load " << options.obj << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+  if (!options.save_scene.empty()) {
+    if (!scene.saveBinary(options.save_scene)) std::exit(EXIT_FAILURE);
+    std::cout << "saved " << options.save_scene << std::endl;
+  }
+
+  Camera camera;
+  camera.setFOV(options.fov / 180.0f * PI);
+  if (options.set_camera) camera.lookAt(options.camPos, options.lookat);
+
+  CPURenderer renderer(options.width, options.height, options.threads);
+  renderer.setScene(scene);
+  renderer.setCamera(camera.params);
+  renderer.setNEE(options.integrator == Integrator::PTNEE);
+  renderer.setSeed(options.seed);
+  renderer.setAdaptiveThreshold(options.adaptive_threshold);
+  renderer.setAdaptiveMinSamples(options.adaptive_min_samples);
+
+  std::cout << "renderer: CPU, " << renderer.getThreadCount()
+            << " threads, SIMD width " << CPURenderer::getSIMDWidth()
+            << std::endl;
+  std::cout << "rendering " << options.width << "x" << options.height
+            << " with " << options.samples << " samples" << std::endl;
+
+  // accumulation loop
+  FrameBudget budget(options.target_ms);
+  unsigned int samples_per_pass = options.samples_per_pass;
+  unsigned int passes = 0;
+  unsigned int next_snapshot = options.snapshot_every;
+  const auto start = std::chrono::steady_clock::now();
+  while (renderer.getSamples() < options.samples) {
+    // do not overshoot target number of samples
+    renderer.setSamplesPerPass(
+        std::min(samples_per_pass, options.samples - renderer.getSamples()));
+
+    const auto pass_start = std::chrono::steady_clock::now();
+    renderer.accumulate();
+    passes++;
+
+    const unsigned int samples = renderer.getSamples();
+    if (options.snapshot_every > 0 && samples >= next_snapshot) {
+      renderer.getImage().write(Image::snapshotPath(options.output, samples));
+      next_snapshot =
+          (samples / options.snapshot_every + 1) * options.snapshot_every;
+    }
+
+    if (options.target_ms > 0) {
+      const auto pass_end = std::chrono::steady_clock::now();
+      samples_per_pass = budget.update(
+          renderer.getSamplesPerPass(),
+          std::chrono::duration<float, std::milli>(pass_end - pass_start)
+              .count());
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  const double elapsed = std::chrono::duration<double>(end - start).count();
+  std::cout << "elapsed: " << elapsed << " s ("
+            << renderer.getSamples() / elapsed << " samples/s, " << passes
+            << " passes)" << std::endl;
+  if (options.adaptive_threshold > 0) {
+    std::cout << "converged: " << 100.0f * renderer.getConvergedRatio()
+              << " %" << std::endl;
+  }
+  return renderer.getImage();
+}
+
+#ifndef HEADLESS_CPU_ONLY
+Image renderGL(const Options& options) {
+  // setup offscreen context
+  HeadlessContext context;
+
+  // outlives renderer, frames are copied on its worker thread
+  FramePublisher publisher;
+  if (!options.publish.empty()) {
+    publisher.open(options.publish, options.publish_format);
+  }
+
+  // setup renderer
+  auto renderer = std::make_unique<Renderer>(options.width, options.height);
+  renderer->setSceneType(options.scene_type);
+  if (!options.scene_file.empty()) {
+    const auto load_start = std::chrono::steady_clock::now();
+    if (!renderer->loadScene(options.scene_file)) {
+      std::cerr << "failed to load " << options.scene_file << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    glFinish();
+    const auto load_end = std::chrono::steady_clock::now();
+    std::cout << "loaded " << options.scene_file << " in "
+              << std::chrono::duration<double, std::milli>(load_end -
+                                                           load_start)
+                     .count()
+              << " ms" << std::endl;
+  }
+  renderer->setIntegrator(options.integrator);
+  renderer->setSamplerType(options.sampler_type);
+  renderer->setSeed(options.seed);
+  renderer->setFOV(options.fov / 180.0f * PI);
+  // every pass covers all tiles so that tiles have same number of samples
+  renderer->setTileSize(options.tile_size);
+  renderer->setTilesPerPass(renderer->getTileCount());
+  renderer->setAdaptiveThreshold(options.adaptive_threshold);
+  renderer->setAdaptiveMinSamples(options.adaptive_min_samples);
+  if (options.set_camera) {
+    renderer->lookAtCamera(options.camPos, options.lookat);
+  }
+  if (!options.obj.empty()) {
+    const Material material =
+        options.obj_emission != glm::vec3(0)
+            ? Scene::createLight(options.obj_emission)
+            : Scene::createDiffuse(glm::vec3(0.8));
+    if (!renderer->loadOBJ(options.obj, material, options.obj_scale,
+                           options.obj_offset)) {
+      std::cerr << "failed to load " << options.obj << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+  if (!options.save_scene.empty()) {
+    if (!renderer->saveScene(options.save_scene)) std::exit(EXIT_FAILURE);
+    std::cout << "saved " << options.save_scene << std::endl;
+  }
+
+  // after scene, camera and integrator are set up, they are checked against
+  // checkpoint
+  if (!options.resume.empty()) {
+    if (!renderer->loadCheckpoint(options.resume)) {
+      std::cerr << "failed to resume from " << options.resume << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    std::cout << "resumed " << renderer->getSamples() << " samples from "
+              << options.resume << std::endl;
+  }
+
+  std::cout << "renderer: " << glGetString(GL_RENDERER) << std::endl;
+  std::cout << "rendering " << options.width << "x" << options.height
+            << " with " << options.samples << " samples" << std::endl;
+
+  // accumulation loop
+  FrameBudget budget(options.target_ms);
+  unsigned int samples_per_pass = options.samples_per_pass;
+  unsigned int passes = 0;
+  unsigned int next_snapshot =
+      options.snapshot_every > 0
+          ? (renderer->getSamples() / options.snapshot_every + 1) *
+                options.snapshot_every
+          : 0;
+  const auto start = std::chrono::steady_clock::now();
+  auto last_checkpoint = start;
+  while (renderer->getSamples() < options.samples) {
+    // do not overshoot target number of samples
+    renderer->setSamplesPerPass(
+        std::min(samples_per_pass, options.samples - renderer->getSamples()));
+
+    const auto pass_start = std::chrono::steady_clock::now();
+    renderer->accumulate();
+    passes++;
+
+    // snapshots are copied and written while rendering continues
+    const unsigned int samples = renderer->getSamples();
+    if (options.snapshot_every > 0 && samples >= next_snapshot) {
+      if (renderer->exportImage(
+              Image::snapshotPath(options.output, samples))) {
+        next_snapshot = (samples / options.snapshot_every + 1) *
+                        options.snapshot_every;
+      }
+    }
+    if (publisher.isOpen()) renderer->publishFrame(publisher);
+    renderer->pollExports();
+
+    // passes stay queued until a checkpoint is due, saving then waits for
+    // them, interval starts again after state is read back
+    if (!options.checkpoint.empty() &&
+        std::chrono::duration<float>(std::chrono::steady_clock::now() -
+                                     last_checkpoint)
+                .count() >= options.checkpoint_every) {
+      if (renderer->saveCheckpoint(options.checkpoint)) {
+        std::cout << "checkpoint " << renderer->getSamples() << " samples"
+                  << std::endl;
+      }
+      last_checkpoint = std::chrono::steady_clock::now();
+    }
+
+    if (options.target_ms > 0) {
+      glFinish();
+      const auto pass_end = std::chrono::steady_clock::now();
+      samples_per_pass = budget.update(
+          renderer->getSamplesPerPass(),
+          std::chrono::duration<float, std::milli>(pass_end - pass_start)
+              .count());
+    }
+  }
+  glFinish();
+  const auto end = std::chrono::steady_clock::now();
+  renderer->finishExports();
+  renderer->finishFrames();
+
+  const double elapsed = std::chrono::duration<double>(end - start).count();
+  std::cout << "elapsed: " << elapsed << " s ("
+            << renderer->getSamples() / elapsed << " samples/s, " << passes
+            << " passes)" << std::endl;
+  if (options.adaptive_threshold > 0) {
+    std::cout << "converged: " << 100.0f * renderer->getConvergedRatio()
+              << " %" << std::endl;
+  }
+  if (publisher.isOpen()) {
+    std::cout << "published " << publisher.getPublishedCount()
+              << " frames to " << publisher.getName() << " ("
+              << publisher.getAveragePublishTime() << " ms per frame)"
+              << std::endl;
+  }
+
+  // final state, rendering can be continued with more samples
+  if (!options.checkpoint.empty() &&
+      renderer->saveCheckpoint(options.checkpoint)) {
+    std::cout << "saved " << options.checkpoint << std::endl;
+  }
+
+  const Image image = renderer->getImage();
+  renderer->destroy();
+  context.destroy();
+  return image;
+}
+#endif
+
+int main(int argc, char** argv) {
+  const Options options = parseOptions(argc, argv);
+
+  if ((options.backend == Backend::CPU || options.compare > 0) &&
+      (!options.checkpoint.empty() || !options.resume.empty())) {
+    std::cerr << "checkpoints require gl backend" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+
+#ifdef HEADLESS_CPU_ONLY
+  const Image image = renderCPU(options);
+#else
+  const Image image = options.backend == Backend::CPU ? renderCPU(options)
+                                                      : renderGL(options);
+#endif
+
+  // write image
+  if (!image.write(options.output)) {
+    std::cerr << "failed to write " << options.output << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  std::cout << "saved " << options.output << std::endl;
+
+#ifndef HEADLESS_CPU_ONLY
+  // same samples per pixel on other backend, both are unbiased, so RMSE is
+  // noise of both when they agree
+  if (options.compare > 0) {
+    Options other = options;
+    other.backend =
+        options.backend == Backend::CPU ? Backend::GL : Backend::CPU;
+    other.snapshot_every = 0;
+    other.save_scene.clear();
+    other.publish.clear();
+    const Image other_image = other.backend == Backend::CPU
+                                  ? renderCPU(other)
+                                  : renderGL(other);
+    const double rmse = image.rmse(other_image);
+    std::cout << "rmse between gl and cpu: " << rmse << " (threshold "
+              << options.compare << ")" << std::endl;
+    if (!(rmse <= options.compare)) {
+      std::cerr << "backends differ" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+#endif
+
+  return 0;
+}
\ No newline at end of file
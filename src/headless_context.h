@@ -0,0 +1,79 @@
+#ifndef _HEADLESS_CONTEXT_H
+#define _HEADLESS_CONTEXT_H
+#include <cstdlib>
+#include <iostream>
+
+#include "EGL/egl.h"
+#include "EGL/eglext.h"
+#include "glad/glad.h"
+
+// OpenGL 3.3 core context without any window or display server
+// uses EGL surfaceless platform(Mesa llvmpipe, NVIDIA, ...)
+class HeadlessContext {
+ private:
+  EGLDisplay display;
+  EGLContext context;
+
+  static EGLDisplay getDisplay() {
+    // prefer surfaceless platform, it does not need X11 or GBM device
+    const auto eglGetPlatformDisplayEXT =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (eglGetPlatformDisplayEXT) {
+      EGLDisplay display = eglGetPlatformDisplayEXT(
+          EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+      if (display != EGL_NO_DISPLAY) return display;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+ public:
+  HeadlessContext() {
+    // init EGL
+    display = getDisplay();
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+      std::cerr << "failed to initialize EGL" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+      std::cerr << "failed to bind OpenGL API" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    // setup context
+    // no config and no surface, all rendering goes to FBOs
+    const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                      3,
+                                      EGL_CONTEXT_MINOR_VERSION,
+                                      3,
+                                      EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                      EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                      EGL_NONE};
+    context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT,
+                               context_attribs);
+    if (context == EGL_NO_CONTEXT) {
+      std::cerr << "failed to create EGL context" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+      std::cerr << "failed to make EGL context current" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+
+    // initialize glad
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+      std::cerr << "failed to initialize glad" << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  void destroy() {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+  }
+};
+
+#endif
\ No newline at end of file
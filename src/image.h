@@ -0,0 +1,245 @@
+#ifndef _IMAGE_H
+#define _IMAGE_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// RGB float image, rows are stored bottom to top(same as OpenGL textures)
+class Image {
+ private:
+  static void writeU32BE(std::ofstream& stream, uint32_t v) {
+    const char bytes[4] = {char(v >> 24), char(v >> 16), char(v >> 8),
+                           char(v)};
+    stream.write(bytes, 4);
+  }
+
+  template <typename T>
+  static void writeLE(std::ofstream& stream, const T& v) {
+    stream.write(reinterpret_cast<const char*>(&v), sizeof(T));
+  }
+
+  static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    static uint32_t table[256] = {};
+    if (table[1] == 0) {
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+          c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+      }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+      crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+  }
+
+  static void writePNGChunk(std::ofstream& stream, const char* type,
+                            const std::vector<uint8_t>& data) {
+    writeU32BE(stream, data.size());
+    stream.write(type, 4);
+    stream.write(reinterpret_cast<const char*>(data.data()), data.size());
+    uint32_t crc = crc32(reinterpret_cast<const uint8_t*>(type), 4, 0);
+    crc = crc32(data.data(), data.size(), crc);
+    writeU32BE(stream, crc);
+  }
+
+  static bool hasExtension(const std::string& filepath,
+                           const std::string& ext) {
+    return filepath.size() >= ext.size() &&
+           filepath.compare(filepath.size() - ext.size(), ext.size(), ext) ==
+               0;
+  }
+
+ public:
+  unsigned int width;
+  unsigned int height;
+  std::vector<float> pixels;
+
+  Image(unsigned int width, unsigned int height)
+      : width(width), height(height), pixels(3 * width * height) {}
+
+  // gamma corrected 8bit value, same as output.frag
+  uint8_t toneMap(unsigned int idx) const {
+    const float v = std::pow(std::max(pixels[idx], 0.0f), 0.4545f);
+    return static_cast<uint8_t>(std::min(v, 1.0f) * 255.0f + 0.5f);
+  }
+
+  // Portable Float Map(little endian, bottom to top)
+  bool writePFM(const std::string& filepath) const {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) return false;
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+    file.write(reinterpret_cast<const char*>(pixels.data()),
+               pixels.size() * sizeof(float));
+    return static_cast<bool>(file);
+  }
+
+  // 8bit PNG, zlib stream uses stored(uncompressed) deflate blocks
+  bool writePNG(const std::string& filepath) const {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) return false;
+
+    // raw scanlines with filter type 0, top to bottom
+    std::vector<uint8_t> raw;
+    raw.reserve((3 * width + 1) * height);
+    for (unsigned int j = 0; j < height; ++j) {
+      raw.push_back(0);
+      const unsigned int row = height - 1 - j;
+      for (unsigned int i = 0; i < 3 * width; ++i) {
+        raw.push_back(toneMap(3 * width * row + i));
+      }
+    }
+
+    // zlib stream
+    std::vector<uint8_t> idat = {0x78, 0x01};
+    const size_t max_block_size = 65535;
+    size_t pos = 0;
+    while (true) {
+      const size_t size = std::min(max_block_size, raw.size() - pos);
+      const bool last = pos + size == raw.size();
+      idat.push_back(last ? 1 : 0);
+      idat.push_back(size & 0xff);
+      idat.push_back(size >> 8);
+      idat.push_back(~size & 0xff);
+      idat.push_back((~size >> 8) & 0xff);
+      idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + size);
+      pos += size;
+      if (last) break;
+    }
+    uint32_t a = 1, b = 0;
+    for (const uint8_t v : raw) {
+      a = (a + v) % 65521;
+      b = (b + a) % 65521;
+    }
+    const uint32_t adler = (b << 16) | a;
+    for (int k = 3; k >= 0; --k) {
+      idat.push_back((adler >> (8 * k)) & 0xff);
+    }
+
+    // IHDR: 8bit RGB
+    std::vector<uint8_t> ihdr = {
+        uint8_t(width >> 24),  uint8_t(width >> 16),  uint8_t(width >> 8),
+        uint8_t(width),        uint8_t(height >> 24), uint8_t(height >> 16),
+        uint8_t(height >> 8),  uint8_t(height),       8,
+        2,                     0,                     0,
+        0};
+
+    const char signature[8] = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+    file.write(signature, 8);
+    writePNGChunk(file, "IHDR", ihdr);
+    writePNGChunk(file, "IDAT", idat);
+    writePNGChunk(file, "IEND", {});
+    return static_cast<bool>(file);
+  }
+
+  // OpenEXR, 32bit float scanlines without compression
+  bool writeEXR(const std::string& filepath) const {
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) return false;
+
+    const auto writeAttribute = [&](const std::string& name,
+                                    const std::string& type, int32_t size) {
+      file.write(name.c_str(), name.size() + 1);
+      file.write(type.c_str(), type.size() + 1);
+      writeLE(file, size);
+    };
+
+    // magic number and version
+    writeLE(file, int32_t(20000630));
+    writeLE(file, int32_t(2));
+
+    // channels are sorted by name
+    writeAttribute("channels", "chlist", 3 * 18 + 1);
+    for (const char* channel : {"B", "G", "R"}) {
+      file.write(channel, 2);
+      writeLE(file, int32_t(2));  // FLOAT
+      writeLE(file, int32_t(0));  // pLinear, reserved
+      writeLE(file, int32_t(1));  // xSampling
+      writeLE(file, int32_t(1));  // ySampling
+    }
+    file.put(0);
+    writeAttribute("compression", "compression", 1);
+    file.put(0);
+    for (const char* window : {"dataWindow", "displayWindow"}) {
+      writeAttribute(window, "box2i", 16);
+      writeLE(file, int32_t(0));
+      writeLE(file, int32_t(0));
+      writeLE(file, int32_t(width - 1));
+      writeLE(file, int32_t(height - 1));
+    }
+    writeAttribute("lineOrder", "lineOrder", 1);
+    file.put(0);
+    writeAttribute("pixelAspectRatio", "float", 4);
+    writeLE(file, 1.0f);
+    writeAttribute("screenWindowCenter", "v2f", 8);
+    writeLE(file, 0.0f);
+    writeLE(file, 0.0f);
+    writeAttribute("screenWindowWidth", "float", 4);
+    writeLE(file, 1.0f);
+    file.put(0);
+
+    // offset table
+    const uint64_t line_size = 8 + 3 * sizeof(float) * width;
+    const uint64_t offset = static_cast<uint64_t>(file.tellp()) + 8 * height;
+    for (unsigned int j = 0; j < height; ++j) {
+      writeLE(file, uint64_t(offset + j * line_size));
+    }
+
+    // scanlines, top to bottom
+    std::vector<float> line(3 * width);
+    for (unsigned int j = 0; j < height; ++j) {
+      const unsigned int row = height - 1 - j;
+      for (unsigned int i = 0; i < width; ++i) {
+        for (int c = 0; c < 3; ++c) {
+          line[c * width + i] = pixels[3 * (width * row + i) + (2 - c)];
+        }
+      }
+      writeLE(file, int32_t(j));
+      writeLE(file, int32_t(3 * sizeof(float) * width));
+      file.write(reinterpret_cast<const char*>(line.data()),
+                 line.size() * sizeof(float));
+    }
+    return static_cast<bool>(file);
+  }
+
+  // choose format by file extension
+  bool write(const std::string& filepath) const {
+    if (hasExtension(filepath, ".pfm")) {
+      return writePFM(filepath);
+    } else if (hasExtension(filepath, ".png")) {
+      return writePNG(filepath);
+    } else if (hasExtension(filepath, ".exr")) {
+      return writeEXR(filepath);
+    }
+    std::cerr << "unsupported image format: " << filepath << std::endl;
+    return false;
+  }
+
+  // root mean square error of RGB values, images have same size
+  double rmse(const Image& other) const {
+    double sum = 0;
+    for (size_t i = 0; i < pixels.size(); ++i) {
+      const double d = pixels[i] - other.pixels[i];
+      sum += d * d;
+    }
+    return pixels.empty() ? 0.0 : std::sqrt(sum / pixels.size());
+  }
+
+  // insert number of samples before extension, e.g. output_1024spp.png
+  static std::string snapshotPath(const std::string& filepath,
+                                  unsigned int samples) {
+    const size_t dot = filepath.find_last_of('.');
+    const std::string suffix = "_" + std::to_string(samples) + "spp";
+    if (dot == std::string::npos) return filepath + suffix;
+    return filepath.substr(0, dot) + suffix + filepath.substr(dot);
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,269 @@
+#ifndef _IMAGE_EXPORTER_H
+#define _IMAGE_EXPORTER_H
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "gl_state.h"
+#include "glad/glad.h"
+#include "image.h"
+
+// saves accumulation without stalling rendering
+// request() starts copies of accumulation into a pixel buffer object, poll()
+// maps it once its fence has signaled and a worker thread writes the file or
+// passes the image to another sink
+class ImageExporter {
+ public:
+  // copies in flight at once
+  static constexpr unsigned int N_SLOTS = 2;
+
+  // consumer of resolved image called on worker thread, false on failure
+  using Sink = std::function<bool(const Image&)>;
+
+ private:
+  // accumTexture and momentsTexture copied by one request
+  struct Slot {
+    GLuint accumPBO = 0;
+    GLuint momentsPBO = 0;
+    GLsync fence = nullptr;
+    Sink sink;
+  };
+
+  std::array<Slot, N_SLOTS> slots;
+  unsigned int width;
+  unsigned int height;
+
+  // images waiting for encoding
+  std::thread worker;
+  mutable std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::pair<Image, Sink>> jobs;
+  // job taken by worker and not written yet
+  bool writing;
+  bool quit;
+  unsigned int n_saved;
+  unsigned int n_failed;
+
+  void workerLoop() {
+    while (true) {
+      std::pair<Image, Sink> job(Image(0, 0), nullptr);
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return quit || !jobs.empty(); });
+        if (jobs.empty()) return;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        writing = true;
+      }
+
+      const bool saved = job.second(job.first);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      writing = false;
+      if (saved) {
+        n_saved++;
+      } else {
+        n_failed++;
+      }
+      cv.notify_all();
+    }
+  }
+
+  void deleteBuffers() {
+    for (Slot& slot : slots) {
+      if (slot.fence) glDeleteSync(slot.fence);
+      glDeleteBuffers(1, &slot.accumPBO);
+      glDeleteBuffers(1, &slot.momentsPBO);
+      slot = Slot();
+    }
+  }
+
+  // buffers are created on first request and recreated on resize
+  void setupBuffers(unsigned int width, unsigned int height) {
+    if (slots[0].accumPBO != 0 && this->width == width &&
+        this->height == height) {
+      return;
+    }
+    finish();
+    deleteBuffers();
+    this->width = width;
+    this->height = height;
+
+    const GLsizeiptr size = 4 * sizeof(GLfloat) * width * height;
+    for (Slot& slot : slots) {
+      for (GLuint* pbo : {&slot.accumPBO, &slot.momentsPBO}) {
+        glGenBuffers(1, pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, *pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+      }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  // copy texture into bound pixel pack buffer, returns immediately
+  static void readTextureAsync(GLuint pbo, GLuint texture) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, nullptr);
+  }
+
+  // divide accumulated radiance by number of samples, same as
+  // Renderer::getImage()
+  Image resolve(const Slot& slot) const {
+    const GLsizeiptr size = 4 * sizeof(GLfloat) * width * height;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.momentsPBO);
+    const GLfloat* moments = static_cast<const GLfloat*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.accumPBO);
+    const GLfloat* accum = static_cast<const GLfloat*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+
+    Image image(width, height);
+    if (accum && moments) {
+      for (unsigned int i = 0; i < width * height; ++i) {
+        const float n = moments[4 * i + 2];
+        const float samplesInv = n > 0 ? 1.0f / n : 0.0f;
+        image.pixels[3 * i + 0] = accum[4 * i + 0] * samplesInv;
+        image.pixels[3 * i + 1] = accum[4 * i + 1] * samplesInv;
+        image.pixels[3 * i + 2] = accum[4 * i + 2] * samplesInv;
+      }
+    } else {
+      std::cerr << "failed to map pixel buffer" << std::endl;
+    }
+
+    if (accum) glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.momentsPBO);
+    if (moments) glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return image;
+  }
+
+  // hand finished copy to worker, wait until GPU is done when blocking
+  bool complete(Slot& slot, bool blocking) {
+    const GLenum status =
+        glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                         blocking ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED) return false;
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    if (status == GL_WAIT_FAILED) {
+      std::cerr << "failed to wait for pixel buffer" << std::endl;
+      slot.sink = nullptr;
+      return true;
+    }
+
+    Image image = resolve(slot);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.emplace_back(std::move(image), std::move(slot.sink));
+      slot.sink = nullptr;
+    }
+    cv.notify_all();
+    return true;
+  }
+
+ public:
+  ImageExporter()
+      : width(0),
+        height(0),
+        writing(false),
+        quit(false),
+        n_saved(0),
+        n_failed(0) {
+    worker = std::thread(&ImageExporter::workerLoop, this);
+  }
+  ImageExporter(const ImageExporter&) = delete;
+  ImageExporter& operator=(const ImageExporter&) = delete;
+
+  ~ImageExporter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+  }
+
+  // start copy of accumulation, sink receives resolved image later
+  // false when every slot is still in flight, request again later
+  bool request(GLuint accumTexture, GLuint momentsTexture, unsigned int width,
+               unsigned int height, Sink sink) {
+    setupBuffers(width, height);
+
+    for (Slot& slot : slots) {
+      if (slot.fence) continue;
+
+      readTextureAsync(slot.accumPBO, accumTexture);
+      readTextureAsync(slot.momentsPBO, momentsTexture);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      slot.sink = std::move(sink);
+      return true;
+    }
+    return false;
+  }
+  // format is chosen by extension of filepath
+  bool request(GLuint accumTexture, GLuint momentsTexture, unsigned int width,
+               unsigned int height, const std::string& filepath) {
+    return request(accumTexture, momentsTexture, width, height,
+                   [filepath](const Image& image) {
+                     if (!image.write(filepath)) {
+                       std::cerr << "failed to write " << filepath
+                                 << std::endl;
+                       return false;
+                     }
+                     std::cout << "saved " << filepath << std::endl;
+                     return true;
+                   });
+  }
+
+  // call once per frame, never waits for GPU
+  void poll() {
+    for (Slot& slot : slots) {
+      if (slot.fence) complete(slot, false);
+    }
+  }
+
+  // number of requests not written yet
+  unsigned int getPendingCount() const {
+    unsigned int n_pending = 0;
+    for (const Slot& slot : slots) {
+      if (slot.fence) n_pending++;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return n_pending + jobs.size() + (writing ? 1 : 0);
+  }
+  unsigned int getSavedCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return n_saved;
+  }
+  unsigned int getFailedCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return n_failed;
+  }
+
+  // wait until every request is written
+  void finish() {
+    for (Slot& slot : slots) {
+      if (slot.fence) complete(slot, true);
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return jobs.empty() && !writing; });
+  }
+
+  // pending requests are written before buffers are deleted
+  void destroy() {
+    finish();
+    deleteBuffers();
+    width = 0;
+    height = 0;
+  }
+};
+
+#endif
\ No newline at end of file
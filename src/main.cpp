@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <string>
 
 #include "glad/glad.h"
 //
@@ -12,11 +17,17 @@
 #include "imgui_impl_opengl3.h"
 //
 #include "constant.h"
+#include "frame_budget.h"
+#include "frame_publisher.h"
+#include "gl_state.h"
+#include "profiler.h"
 #include "rectangle.h"
 #include "renderer.h"
 #include "shader.h"
 
 std::unique_ptr<Renderer> renderer;
+// primitive edited by Scene Inspector
+int selected_primitive = 0;
 
 void handleInput(GLFWwindow* window, const ImGuiIO& io) {
   // Close Application
@@ -29,6 +40,28 @@ void handleInput(GLFWwindow* window, const ImGuiIO& io) {
     renderer->clear();
   }
 
+  // Select Primitive, double click also orbits around hit point
+  if (!io.WantCaptureMouse && ImGui::IsMouseClicked(0)) {
+    // image is drawn at bottom left of framebuffer in its own resolution
+    int fb_w, fb_h;
+    glfwGetFramebufferSize(window, &fb_w, &fb_h);
+    const float x = io.MousePos.x / io.DisplaySize.x * fb_w;
+    const float y = io.MousePos.y / io.DisplaySize.y * fb_h -
+                    (fb_h - static_cast<float>(renderer->getHeight()));
+    const RayQuery::Hit hit =
+        x >= 0 && x < renderer->getWidth() && y >= 0 &&
+                y < renderer->getHeight()
+            ? renderer->pick(x, y)
+            : RayQuery::Hit();
+    if (hit.hit()) {
+      // triangles can not be edited, mesh only blocks what is behind it
+      if (hit.primitive < renderer->getScene().n_primitives) {
+        selected_primitive = hit.primitive;
+      }
+      if (ImGui::IsMouseDoubleClicked(0)) renderer->setOrbitPivot(hit.position);
+    }
+  }
+
   // Camera Movement
   if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS &&
       glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_MIDDLE) == GLFW_PRESS) {
@@ -46,7 +79,88 @@ void handleInput(GLFWwindow* window, const ImGuiIO& io) {
   }
 }
 
-int main() {
+// rolling pass time graph with average
+void plotTrack(const std::string& label, const Profiler::Track& track) {
+  char overlay[32];
+  std::snprintf(overlay, sizeof(overlay), "%.3f ms", track.average());
+  ImGui::PlotLines(label.c_str(), track.values.data(), Profiler::HISTORY_SIZE,
+                   track.offset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+}
+
+int main(int argc, char** argv) {
+  // parse command line
+  unsigned int samples_per_pass = 1;
+  bool auto_samples_per_pass = false;
+  float target_ms = 16.0f;
+  std::string obj;
+  float obj_scale = 1.0f;
+  std::string scene_file;
+  unsigned int tile_size = 0;
+  // split pass into tiles when one sample per pixel exceeds target frame time
+  bool auto_tile_size = true;
+  float adaptive_threshold = 0.0f;
+  SamplerType sampler_type = SamplerType::PCG;
+  std::string publish;
+  FrameFormat publish_format = FrameFormat::RGBA8;
+  const auto usage = []() {
+    std::cerr << "Usage: main [--samples-per-pass <n>] [--target-ms <ms>] "
+                 "[--tile-size <n|auto>] [--adaptive-threshold <e>] "
+                 "[--sampler <xorshift|sobol|bluenoise|pcg>] "
+                 "[--obj <file>] [--obj-scale <s>] [--scene-file <file>] "
+                 "[--publish <name>] [--publish-format <rgba8|rgb32f>]"
+              << std::endl;
+    std::exit(EXIT_FAILURE);
+  };
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--samples-per-pass" && i + 1 < argc) {
+      samples_per_pass = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--target-ms" && i + 1 < argc) {
+      target_ms = std::atof(argv[++i]);
+      auto_samples_per_pass = true;
+    } else if (arg == "--tile-size" && i + 1 < argc) {
+      const std::string value = argv[++i];
+      auto_tile_size = value == "auto";
+      tile_size = auto_tile_size ? 0 : std::max(0, std::atoi(value.c_str()));
+    } else if (arg == "--sampler" && i + 1 < argc) {
+      const std::string value = argv[++i];
+      if (value == "xorshift") {
+        sampler_type = SamplerType::XORShift;
+      } else if (value == "sobol") {
+        sampler_type = SamplerType::Sobol;
+      } else if (value == "bluenoise") {
+        sampler_type = SamplerType::BlueNoise;
+      } else if (value == "pcg") {
+        sampler_type = SamplerType::PCG;
+      } else {
+        std::cerr << "invalid sampler: " << value << std::endl;
+        usage();
+      }
+    } else if (arg == "--adaptive-threshold" && i + 1 < argc) {
+      adaptive_threshold = std::max(0.0, std::atof(argv[++i]));
+    } else if (arg == "--obj" && i + 1 < argc) {
+      obj = argv[++i];
+    } else if (arg == "--obj-scale" && i + 1 < argc) {
+      obj_scale = std::atof(argv[++i]);
+    } else if (arg == "--scene-file" && i + 1 < argc) {
+      scene_file = argv[++i];
+    } else if (arg == "--publish" && i + 1 < argc) {
+      publish = argv[++i];
+    } else if (arg == "--publish-format" && i + 1 < argc) {
+      const std::string value = argv[++i];
+      if (value == "rgba8") {
+        publish_format = FrameFormat::RGBA8;
+      } else if (value == "rgb32f") {
+        publish_format = FrameFormat::RGB32F;
+      } else {
+        std::cerr << "invalid publish format: " << value << std::endl;
+        usage();
+      }
+    } else {
+      usage();
+    }
+  }
+
   // init glfw
   if (!glfwInit()) {
     std::cerr << "failed to initialize GLFW" << std::endl;
@@ -95,11 +209,52 @@ int main() {
 
   // setup renderer
   renderer = std::make_unique<Renderer>(512, 512);
+  renderer->setSamplesPerPass(samples_per_pass);
+  renderer->setTileSize(tile_size);
+  renderer->setAdaptiveThreshold(adaptive_threshold);
+  renderer->setSamplerType(sampler_type);
+  if (!scene_file.empty() && !renderer->loadScene(scene_file)) {
+    std::cerr << "failed to load " << scene_file << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  if (!obj.empty() &&
+      !renderer->loadOBJ(obj, Scene::createDiffuse(glm::vec3(0.8)),
+                         obj_scale)) {
+    std::cerr << "failed to load " << obj << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  FrameBudget budget(target_ms);
+  // tiles per pass are adjusted instead of samples when tiled
+  FrameBudget tile_budget(target_ms, 1 << 16);
+  // consecutive frames over budget with one sample per pass, a single slow
+  // frame(e.g. shader compile) does not split pass into tiles
+  unsigned int slow_frames = 0;
+
+  // setup profiler
+  Profiler& profiler = renderer->getProfiler();
+  profiler.setEnabled(true);
+
+  // export, format is chosen by extension
+  char export_path[256] = "output.png";
+  // 0 disables periodic snapshots
+  int snapshot_every = 0;
+  unsigned int last_snapshot = 0;
+  char checkpoint_path[256] = "render.ckpt";
+
+  // frames for external viewers, see frame_reader
+  FramePublisher publisher;
+  if (!publish.empty()) publisher.open(publish, publish_format);
 
   // main app loop
   while (!glfwWindowShouldClose(window)) {
+    profiler.beginFrame();
+    profiler.beginCPU("frame");
+    GLState::get().beginFrame();
+
     glfwPollEvents();
 
+    profiler.beginCPU("imgui");
+
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -115,16 +270,22 @@ int main() {
 
       static RenderMode mode = renderer->getRenderMode();
       if (ImGui::Combo("Layer", reinterpret_cast<int*>(&mode),
-                       "Render\0Normal\0Depth\0Albedo\0UV\0\0")) {
+                       "Render\0Normal\0Depth\0Albedo\0UV\0Convergence\0\0")) {
         renderer->setRenderMode(mode);
       }
 
       static Integrator integrator = renderer->getIntegrator();
       if (ImGui::Combo("Integrator", reinterpret_cast<int*>(&integrator),
-                       "PT\0PTNEE\0\0")) {
+                       "PT\0PTNEE\0Wavefront\0\0")) {
         renderer->setIntegrator(integrator);
       }
 
+      static SamplerType sampler_type = renderer->getSamplerType();
+      if (ImGui::Combo("Sampler", reinterpret_cast<int*>(&sampler_type),
+                       "XORShift\0Sobol\0Blue Noise\0PCG\0\0")) {
+        renderer->setSamplerType(sampler_type);
+      }
+
       static SceneType scene_type = renderer->getSceneType();
       if (ImGui::Combo("Scene", reinterpret_cast<int*>(&scene_type),
                        "Original\0Sphere\0Indirect\0")) {
@@ -133,9 +294,201 @@ int main() {
 
       ImGui::Text("Samples: %d", renderer->getSamples());
 
+      // changed by auto tile size
+      int tile_size = renderer->getTileSize();
+      if (ImGui::InputInt("Tile Size (0: off)", &tile_size)) {
+        renderer->setTileSize(std::max(tile_size, 0));
+        auto_tile_size = false;
+      }
+      const bool tiled = renderer->getTileCount() > 1;
+
+      ImGui::Checkbox("Auto Samples per Pass", &auto_samples_per_pass);
+      if (auto_samples_per_pass) {
+        ImGui::Checkbox("Auto Tile Size", &auto_tile_size);
+
+        // io.DeltaTime is the time of previous frame
+        const float frame_ms = 1e3f * io.DeltaTime;
+        const float budget_ms = budget.getTarget();
+        slow_frames = renderer->getSamplesPerPass() == 1 &&
+                              frame_ms > 2.0f * budget_ms
+                          ? slow_frames + 1
+                          : 0;
+        if (tiled) {
+          renderer->setTilesPerPass(
+              tile_budget.update(renderer->getTilesPerPass(), frame_ms));
+          // whole image fits in budget again
+          if (auto_tile_size &&
+              renderer->getTilesPerPass() >= renderer->getTileCount() &&
+              frame_ms < 0.5f * budget_ms) {
+            renderer->setTileSize(0);
+          }
+        } else if (auto_tile_size && slow_frames >= 3) {
+          // one sample per pixel exceeds budget, tiles are sized so that
+          // one tile fits in it
+          renderer->setTileSize(budget.getTileSize(
+              renderer->getWidth(), renderer->getHeight(), frame_ms));
+          renderer->setTilesPerPass(1);
+          slow_frames = 0;
+        } else {
+          renderer->setSamplesPerPass(
+              budget.update(renderer->getSamplesPerPass(), frame_ms));
+        }
+
+        float target = budget.getTarget();
+        if (ImGui::InputFloat("Target Frame Time [ms]", &target)) {
+          budget.setTarget(std::max(target, 1.0f));
+          tile_budget.setTarget(std::max(target, 1.0f));
+        }
+        ImGui::Text("Samples per Pass: %d", renderer->getSamplesPerPass());
+      } else {
+        int spp = renderer->getSamplesPerPass();
+        if (ImGui::InputInt("Samples per Pass", &spp)) {
+          renderer->setSamplesPerPass(std::max(spp, 1));
+        }
+      }
+
+      if (tiled) {
+        if (auto_samples_per_pass) {
+          ImGui::Text("Tiles per Pass: %d / %d", renderer->getTilesPerPass(),
+                      renderer->getTileCount());
+        } else {
+          int tiles_per_pass = renderer->getTilesPerPass();
+          if (ImGui::InputInt("Tiles per Pass", &tiles_per_pass)) {
+            renderer->setTilesPerPass(std::max(tiles_per_pass, 1));
+          }
+        }
+      }
+
+      static float adaptive_threshold = renderer->getAdaptiveThreshold();
+      if (ImGui::InputFloat("Adaptive Threshold (0: off)",
+                            &adaptive_threshold, 0.001f, 0.01f, "%.4f")) {
+        adaptive_threshold = std::max(adaptive_threshold, 0.0f);
+        renderer->setAdaptiveThreshold(adaptive_threshold);
+      }
+      if (adaptive_threshold > 0) {
+        int min_samples = renderer->getAdaptiveMinSamples();
+        if (ImGui::InputInt("Adaptive Min Samples", &min_samples)) {
+          renderer->setAdaptiveMinSamples(std::max(min_samples, 2));
+        }
+      }
+
+      static bool specialize = renderer->getShaderSpecialization();
+      if (ImGui::Checkbox("Specialized Shaders", &specialize)) {
+        renderer->setShaderSpecialization(specialize);
+      }
+
+      static int max_depth = renderer->getMaxDepth();
+      if (ImGui::InputInt("Max Depth", &max_depth)) {
+        max_depth = std::max(max_depth, 1);
+        renderer->setMaxDepth(max_depth);
+      }
+
+      static bool primary_cache = renderer->getPrimaryCache();
+      if (ImGui::Checkbox("Cached Primary Hit", &primary_cache)) {
+        renderer->setPrimaryCache(primary_cache);
+      }
+
+      static bool denoise = renderer->getDenoise();
+      if (ImGui::Checkbox("Denoise", &denoise)) {
+        renderer->setDenoise(denoise);
+      }
+      if (denoise) {
+        int iterations = renderer->getDenoiseIterations();
+        if (ImGui::SliderInt("Denoise Iterations", &iterations, 1, 8)) {
+          renderer->setDenoiseIterations(iterations);
+        }
+      }
+
+      static bool reprojection = renderer->getReprojection();
+      if (ImGui::Checkbox("Reprojection", &reprojection)) {
+        renderer->setReprojection(reprojection);
+      }
+      if (reprojection) {
+        float max_history = renderer->getMaxHistory();
+        if (ImGui::InputFloat("Max History", &max_history, 1.0f, 8.0f,
+                              "%.0f")) {
+          renderer->setMaxHistory(std::max(max_history, 1.0f));
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Scene Inspector")) {
+        const Scene& scene = renderer->getScene();
+
+        // selection is UI only and keeps accumulation
+        int& selected = selected_primitive;
+        selected = std::clamp(selected, 0, std::max(scene.n_primitives - 1, 0));
+        ImGui::SliderInt("Primitive", &selected, 0, scene.n_primitives - 1);
+
+        if (scene.n_primitives > 0) {
+          Primitive primitive = scene.primitives[selected];
+          bool edited = false;
+          if (primitive.type == 0) {
+            ImGui::Text("Type: Sphere");
+            edited |= ImGui::DragFloat3("Center", &primitive.center[0]);
+            edited |= ImGui::DragFloat("Radius", &primitive.radius, 1.0f, 1.0f,
+                                       1e4f);
+          } else {
+            ImGui::Text("Type: Plane");
+            edited |=
+                ImGui::DragFloat3("Corner", &primitive.leftCornerPoint[0]);
+            edited |= ImGui::DragFloat3("Right", &primitive.right[0]);
+            edited |= ImGui::DragFloat3("Up", &primitive.up[0]);
+          }
+          edited |= ImGui::SliderInt("Material", &primitive.material_id, 0,
+                                     scene.n_materials - 1);
+          if (edited) renderer->setPrimitive(selected, primitive);
+
+          Material material = scene.block.materials[primitive.material_id];
+          bool material_edited = ImGui::Combo(
+              "BRDF", &material.brdf_type, "Lambert\0Mirror\0Glass\0\0");
+          material_edited |= ImGui::ColorEdit3("kd", &material.kd[0]);
+          material_edited |= ImGui::ColorEdit3(
+              "le", &material.le[0],
+              ImGuiColorEditFlags_HDR | ImGuiColorEditFlags_Float);
+          if (material_edited) {
+            renderer->setMaterial(primitive.material_id, material);
+          }
+
+          ImGui::Text("Last Upload: %zu bytes",
+                      renderer->getSceneEditUploadBytes());
+        }
+      }
+
+      if (ImGui::CollapsingHeader("Export")) {
+        ImGui::InputText("File", export_path, sizeof(export_path));
+        if (ImGui::Button("Save Image") &&
+            !renderer->exportImage(export_path)) {
+          std::cerr << "previous exports are in flight" << std::endl;
+        }
+        if (ImGui::InputInt("Snapshot Every", &snapshot_every, 256, 1024)) {
+          snapshot_every = std::max(snapshot_every, 0);
+        }
+        ImGui::Text("Pending Exports: %u", renderer->getPendingExports());
+
+        ImGui::InputText("Checkpoint", checkpoint_path,
+                         sizeof(checkpoint_path));
+        if (ImGui::Button("Save Checkpoint") &&
+            renderer->saveCheckpoint(checkpoint_path)) {
+          std::cout << "saved " << checkpoint_path << std::endl;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Resume") &&
+            !renderer->loadCheckpoint(checkpoint_path)) {
+          std::cerr << "failed to resume from " << checkpoint_path
+                    << std::endl;
+        }
+        if (publisher.isOpen()) {
+          ImGui::Text("Published Frames: %llu (%.3f ms)",
+                      static_cast<unsigned long long>(
+                          publisher.getPublishedCount()),
+                      publisher.getAveragePublishTime());
+        }
+      }
+
       glm::vec3 camPos = renderer->getCameraPosition();
       ImGui::Text("Camera Position: (%.3f, %.3f, %.3f)", camPos.x, camPos.y,
                   camPos.z);
+      ImGui::Text("Center Distance: %.3f", renderer->getCenterDistance());
 
       static float fov = renderer->getCameraFOV() / PI * 180.0f;
       if (ImGui::InputFloat("FOV", &fov)) {
@@ -144,14 +497,44 @@ int main() {
 
       ImGui::Text("FPS: %.1f", io.Framerate);
 
+      if (ImGui::CollapsingHeader("Profiler")) {
+        for (const auto& [name, track] : profiler.getGPUTracks()) {
+          plotTrack("GPU " + name, track);
+        }
+        for (const auto& [name, track] : profiler.getCPUTracks()) {
+          plotTrack("CPU " + name, track);
+        }
+
+        static bool recording = profiler.isRecording();
+        if (ImGui::Checkbox("Record Trace", &recording)) {
+          profiler.setRecording(recording);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Save Trace")) {
+          if (profiler.writeTrace("trace.json")) {
+            std::cout << "saved trace.json" << std::endl;
+          }
+        }
+        ImGui::Text("Trace Events: %zu", profiler.getTraceEventCount());
+
+        const GLState::Counters& gl_counters =
+            GLState::get().getLastFrameCounters();
+        ImGui::Text("GL Calls: %u (skipped %u)", gl_counters.calls,
+                    gl_counters.skipped);
+      }
+
       ImGui::Separator();
 
       ImGui::Text("Camera Rotate: [MMB Drag]");
       ImGui::Text("Camera Move: [LShift] + [MMB Drag]");
       ImGui::Text("Camera Zoom: [LCtrl] + [MMB Drag]");
+      ImGui::Text("Select: [LMB Click]");
+      ImGui::Text("Orbit Pivot: [LMB Double Click]");
     }
     ImGui::End();
 
+    profiler.endCPU("imgui");
+
     // Handle Input
     handleInput(window, io);
 
@@ -160,14 +543,33 @@ int main() {
 
     renderer->render();
 
+    // periodic snapshots, counted again after accumulation is cleared
+    const unsigned int samples = renderer->getSamples();
+    if (samples < last_snapshot) last_snapshot = 0;
+    if (snapshot_every > 0 && samples >= last_snapshot + snapshot_every &&
+        renderer->exportImage(
+            Image::snapshotPath(export_path, samples))) {
+      last_snapshot = samples - samples % snapshot_every;
+    }
+    if (publisher.isOpen()) renderer->publishFrame(publisher);
+    renderer->pollExports();
+
     // ImGui Rendering
     int display_w, display_h;
     glfwGetFramebufferSize(window, &display_w, &display_h);
     glViewport(0, 0, display_w, display_h);
+    profiler.beginGPU("imgui");
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    // imgui binds program, VAO and textures by itself
+    GLState::get().invalidate();
+    profiler.endGPU("imgui");
 
+    profiler.beginCPU("swap");
     glfwSwapBuffers(window);
+    profiler.endCPU("swap");
+
+    profiler.endCPU("frame");
   }
 
   // exit
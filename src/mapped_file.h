@@ -0,0 +1,77 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_MMAP
+#endif
+
+// read only memory mapping of whole file, read into memory without mmap
+class MappedFile {
+ private:
+  const char* ptr = nullptr;
+  size_t length = 0;
+#ifndef MAPPED_FILE_MMAP
+  std::vector<char> buffer;
+#endif
+
+ public:
+  MappedFile() {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile() { close(); }
+
+  // false when file is missing or empty
+  bool open(const std::string& filepath) {
+    close();
+#ifdef MAPPED_FILE_MMAP
+    const int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // mapping stays valid after fd is closed
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+    ptr = static_cast<const char*>(mapped);
+    length = st.st_size;
+#else
+    // no mmap, read whole file instead
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) return false;
+    buffer.assign(std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>());
+    if (buffer.empty()) return false;
+    ptr = buffer.data();
+    length = buffer.size();
+#endif
+    return true;
+  }
+
+  void close() {
+#ifdef MAPPED_FILE_MMAP
+    if (ptr) munmap(const_cast<char*>(ptr), length);
+#else
+    buffer.clear();
+#endif
+    ptr = nullptr;
+    length = 0;
+  }
+
+  bool isOpen() const { return ptr != nullptr; }
+  const char* data() const { return ptr; }
+  size_t size() const { return length; }
+};
+
+#endif
\ No newline at end of file
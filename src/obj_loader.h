@@ -0,0 +1,163 @@
+#ifndef _OBJ_LOADER_H
+#define _OBJ_LOADER_H
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// 32 bytes, uploaded to GPU as two RGBA32I texels
+// normal index -1 means geometric normal
+struct alignas(16) Triangle {
+  glm::ivec3 vertex;  // 12
+  int material_id;    // 16
+  glm::ivec3 normal;  // 28
+};
+
+// streaming Wavefront OBJ loader
+// reads one line at a time and appends positions, normals and triangles
+// directly to the output buffers, polygons are triangulated as fans
+class OBJLoader {
+ private:
+  std::vector<glm::vec4>& vertices;
+  std::vector<glm::vec4>& normals;
+  std::vector<Triangle>& triangles;
+
+  // offsets of this file in output buffers
+  const int vertex_offset;
+  const int normal_offset;
+
+  static bool parseFloats(const char* str, float* values, int n) {
+    for (int i = 0; i < n; ++i) {
+      char* end;
+      values[i] = std::strtof(str, &end);
+      if (end == str) return false;
+      str = end;
+    }
+    return true;
+  }
+
+  // OBJ index is 1-based, negative index is relative to the end
+  static int resolveIndex(int index, int offset, int size) {
+    if (index > 0) return offset + index - 1;
+    if (index < 0) return size + index;
+    return -1;
+  }
+
+  // v, v/vt, v//vn, v/vt/vn
+  bool parseCorner(const char*& str, int& vertex, int& normal) const {
+    char* end;
+    const int v = std::strtol(str, &end, 10);
+    if (end == str) return false;
+    str = end;
+
+    int vn = 0;
+    if (*str == '/') {
+      str++;
+      // skip texture coordinate
+      std::strtol(str, &end, 10);
+      str = end;
+      if (*str == '/') {
+        str++;
+        vn = std::strtol(str, &end, 10);
+        str = end;
+      }
+    }
+
+    vertex = resolveIndex(v, vertex_offset, vertices.size());
+    normal = resolveIndex(vn, normal_offset, normals.size());
+    return vertex >= vertex_offset &&
+           vertex < static_cast<int>(vertices.size()) &&
+           (normal == -1 || normal >= normal_offset) &&
+           normal < static_cast<int>(normals.size());
+  }
+
+ public:
+  OBJLoader(std::vector<glm::vec4>& vertices, std::vector<glm::vec4>& normals,
+            std::vector<Triangle>& triangles)
+      : vertices(vertices),
+        normals(normals),
+        triangles(triangles),
+        vertex_offset(vertices.size()),
+        normal_offset(normals.size()) {}
+
+  // positions are transformed by scale * p + offset
+  bool load(const std::string& filepath, int material_id, float scale,
+            const glm::vec3& offset) {
+    std::ifstream file(filepath);
+    if (!file) {
+      std::cerr << "failed to open " << filepath << std::endl;
+      return false;
+    }
+
+    std::string line;
+    unsigned int line_number = 0;
+    while (std::getline(file, line)) {
+      line_number++;
+      const char* str = line.c_str();
+      while (*str == ' ' || *str == '\t') str++;
+
+      if (std::strncmp(str, "v ", 2) == 0) {
+        float p[3];
+        if (!parseFloats(str + 2, p, 3)) {
+          std::cerr << filepath << ":" << line_number << ": invalid vertex"
+                    << std::endl;
+          return false;
+        }
+        vertices.emplace_back(scale * glm::vec3(p[0], p[1], p[2]) + offset,
+                              1.0f);
+      } else if (std::strncmp(str, "vn ", 3) == 0) {
+        float n[3];
+        if (!parseFloats(str + 3, n, 3)) {
+          std::cerr << filepath << ":" << line_number << ": invalid normal"
+                    << std::endl;
+          return false;
+        }
+        normals.emplace_back(glm::normalize(glm::vec3(n[0], n[1], n[2])),
+                             0.0f);
+      } else if (std::strncmp(str, "f ", 2) == 0) {
+        str += 2;
+
+        // triangulate polygon as a fan around the first corner
+        int first_v = 0, first_n = 0, prev_v = 0, prev_n = 0;
+        int n_corners = 0;
+        while (true) {
+          while (*str == ' ' || *str == '\t') str++;
+          if (*str == '\0' || *str == '\r') break;
+
+          int v, n;
+          if (!parseCorner(str, v, n)) {
+            std::cerr << filepath << ":" << line_number << ": invalid face"
+                      << std::endl;
+            return false;
+          }
+
+          if (n_corners == 0) {
+            first_v = v;
+            first_n = n;
+          } else if (n_corners >= 2) {
+            Triangle triangle;
+            triangle.vertex = glm::ivec3(first_v, prev_v, v);
+            triangle.material_id = material_id;
+            // use shading normal only when all corners have it
+            triangle.normal = first_n >= 0 && prev_n >= 0 && n >= 0
+                                  ? glm::ivec3(first_n, prev_n, n)
+                                  : glm::ivec3(-1);
+            triangles.push_back(triangle);
+          }
+          prev_v = v;
+          prev_n = n;
+          n_corners++;
+        }
+      }
+      // other statements(vt, o, g, s, usemtl, mtllib) are ignored
+    }
+
+    return true;
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,233 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "glad/glad.h"
+
+// CPU/GPU timeline profiler
+// GPU passes are measured with a ring of GL_TIME_ELAPSED queries, results are
+// read only when available so the pipeline never stalls
+class Profiler {
+ public:
+  static constexpr unsigned int N_QUERIES = 8;
+  static constexpr unsigned int HISTORY_SIZE = 256;
+  static constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+
+  // rolling history of one pass [ms]
+  struct Track {
+    std::array<float, HISTORY_SIZE> values{};
+    unsigned int offset = 0;
+    unsigned int count = 0;
+
+    void push(float value) {
+      values[offset] = value;
+      offset = (offset + 1) % HISTORY_SIZE;
+      if (count < HISTORY_SIZE) count++;
+    }
+
+    float average() const {
+      if (count == 0) return 0;
+      float sum = 0;
+      for (unsigned int i = 0; i < count; ++i) {
+        sum += values[(offset + HISTORY_SIZE - 1 - i) % HISTORY_SIZE];
+      }
+      return sum / count;
+    }
+  };
+
+ private:
+  struct GPUTimer {
+    std::array<GLuint, N_QUERIES> queries;
+    std::array<bool, N_QUERIES> pending{};
+    std::array<double, N_QUERIES> submit_time{};  // [us]
+    unsigned int next = 0;
+    int active = -1;
+    bool warm = false;
+  };
+
+  struct TraceEvent {
+    std::string name;
+    bool gpu;
+    double ts;   // [us]
+    double dur;  // [us]
+  };
+
+  bool enabled;
+  bool recording;
+  std::chrono::steady_clock::time_point epoch;
+
+  std::map<std::string, GPUTimer> gpu_timers;
+  std::map<std::string, double> cpu_begin;  // [us]
+  std::map<std::string, Track> gpu_tracks;
+  std::map<std::string, Track> cpu_tracks;
+
+  // GPU spans are serialized, a span starts after the previous one ends
+  double gpu_timeline_end;  // [us]
+  std::vector<TraceEvent> trace;
+
+  double now() const {
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - epoch)
+        .count();
+  }
+
+  void addTraceEvent(const std::string& name, bool gpu, double ts,
+                     double dur) {
+    if (!recording || trace.size() >= MAX_TRACE_EVENTS) return;
+    trace.push_back({name, gpu, ts, dur});
+  }
+
+  // read finished queries without waiting
+  void poll() {
+    std::vector<TraceEvent> finished;
+    for (auto& [name, timer] : gpu_timers) {
+      // oldest query first
+      for (unsigned int k = 0; k < N_QUERIES; ++k) {
+        const unsigned int slot = (timer.next + k) % N_QUERIES;
+        if (!timer.pending[slot]) continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(timer.queries[slot], GL_QUERY_RESULT_AVAILABLE,
+                           &available);
+        if (!available) break;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(timer.queries[slot], GL_QUERY_RESULT, &elapsed);
+        timer.pending[slot] = false;
+
+        // first pass includes shader JIT and driver warmup
+        if (!timer.warm) {
+          timer.warm = true;
+          continue;
+        }
+
+        gpu_tracks[name].push(1e-6 * elapsed);
+        finished.push_back(
+            {name, true, timer.submit_time[slot], 1e-3 * elapsed});
+      }
+    }
+
+    // place spans on GPU timeline in submission order
+    std::sort(finished.begin(), finished.end(),
+              [](const TraceEvent& a, const TraceEvent& b) {
+                return a.ts < b.ts;
+              });
+    for (TraceEvent& event : finished) {
+      event.ts = std::max(event.ts, gpu_timeline_end);
+      gpu_timeline_end = event.ts + event.dur;
+      addTraceEvent(event.name, true, event.ts, event.dur);
+    }
+  }
+
+ public:
+  Profiler()
+      : enabled(false),
+        recording(false),
+        epoch(std::chrono::steady_clock::now()),
+        gpu_timeline_end(0) {}
+
+  void destroy() {
+    for (auto& [name, timer] : gpu_timers) {
+      glDeleteQueries(N_QUERIES, timer.queries.data());
+    }
+    gpu_timers.clear();
+  }
+
+  bool isEnabled() const { return enabled; }
+  void setEnabled(bool enabled) { this->enabled = enabled; }
+
+  bool isRecording() const { return recording; }
+  void setRecording(bool recording) {
+    if (recording && !this->recording) trace.clear();
+    this->recording = recording;
+  }
+  size_t getTraceEventCount() const { return trace.size(); }
+
+  const std::map<std::string, Track>& getGPUTracks() const {
+    return gpu_tracks;
+  }
+  const std::map<std::string, Track>& getCPUTracks() const {
+    return cpu_tracks;
+  }
+
+  // call once per frame, collects results of previous frames
+  void beginFrame() {
+    if (!enabled) return;
+    poll();
+  }
+
+  void beginGPU(const std::string& name) {
+    if (!enabled) return;
+
+    auto it = gpu_timers.find(name);
+    if (it == gpu_timers.end()) {
+      it = gpu_timers.emplace(name, GPUTimer()).first;
+      glGenQueries(N_QUERIES, it->second.queries.data());
+    }
+    GPUTimer& timer = it->second;
+
+    // all queries in flight, skip this measurement instead of waiting
+    if (timer.pending[timer.next]) return;
+
+    glBeginQuery(GL_TIME_ELAPSED, timer.queries[timer.next]);
+    timer.submit_time[timer.next] = now();
+    timer.active = timer.next;
+  }
+
+  void endGPU(const std::string& name) {
+    if (!enabled) return;
+
+    auto it = gpu_timers.find(name);
+    if (it == gpu_timers.end() || it->second.active < 0) return;
+    GPUTimer& timer = it->second;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    timer.pending[timer.active] = true;
+    timer.next = (timer.next + 1) % N_QUERIES;
+    timer.active = -1;
+  }
+
+  void beginCPU(const std::string& name) {
+    if (!enabled) return;
+    cpu_begin[name] = now();
+  }
+
+  void endCPU(const std::string& name) {
+    if (!enabled) return;
+
+    const auto it = cpu_begin.find(name);
+    if (it == cpu_begin.end()) return;
+
+    const double dur = now() - it->second;
+    cpu_tracks[name].push(1e-3 * dur);
+    addTraceEvent(name, false, it->second, dur);
+  }
+
+  // Chrome trace event format(chrome://tracing, Perfetto)
+  bool writeTrace(const std::string& filepath) const {
+    std::ofstream file(filepath);
+    if (!file) return false;
+
+    file << "{\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,"
+            "\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,"
+            "\"args\":{\"name\":\"GPU\"}}";
+    for (const TraceEvent& event : trace) {
+      file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\""
+           << (event.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"ts\":"
+           << std::fixed << event.ts << ",\"dur\":" << event.dur
+           << ",\"pid\":0,\"tid\":" << (event.gpu ? 1 : 0) << "}";
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+  }
+};
+
+#endif
\ No newline at end of file
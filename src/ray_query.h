@@ -0,0 +1,451 @@
+#ifndef _RAY_QUERY_H
+#define _RAY_QUERY_H
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "scene.h"
+#include "simd.h"
+
+// closest hit and any hit queries against Scene on CPU
+// rays are traced simd::WIDTH at a time against spheres and planes stored SoA,
+// then one at a time against triangles through BVH of scene
+// same tests as intersectSphere(), intersectPlane() and intersectTriangle() in
+// intersect.frag
+class RayQuery {
+ public:
+  // same as RAY_TMIN, RAY_TMAX in global.frag
+  static constexpr float RAY_TMIN = 0.1f;
+  static constexpr float RAY_TMAX = 10000.0f;
+
+  struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tmax = RAY_TMAX;
+  };
+
+  // primitive is index of Scene::primitives, triangles follow primitives
+  // (Scene::n_primitives + index of Scene::triangles), -1 when ray missed
+  struct Hit {
+    float t = RAY_TMAX;
+    glm::vec3 position = glm::vec3(0);
+    glm::vec3 normal = glm::vec3(0);
+    int primitive = -1;
+
+    bool hit() const { return primitive >= 0; }
+  };
+
+ private:
+  static constexpr int W = simd::WIDTH;
+
+  // SoA records, same values as SphereRecord and PlaneRecord
+  std::vector<float> sphere_center[3];
+  std::vector<float> sphere_radius2;
+  std::vector<int> sphere_primitive;
+
+  std::vector<float> plane_origin[3];
+  std::vector<float> plane_normal[3];
+  std::vector<float> plane_right[3];
+  std::vector<float> plane_right_length_inv;
+  std::vector<float> plane_up[3];
+  std::vector<float> plane_up_length_inv;
+  std::vector<int> plane_primitive;
+
+  // triangles and BVH are read from scene, scene has to outlive this object
+  const Scene* scene = nullptr;
+
+  // W rays in SoA layout, unused lanes repeat first ray
+  struct RayPacket {
+    simd::FloatV origin[3];
+    simd::FloatV direction[3];
+    simd::FloatV tmax;
+    size_t count;
+
+    RayPacket(const Ray* rays, size_t count) : count(count) {
+      alignas(32) float values[7][W];
+      for (int i = 0; i < W; ++i) {
+        const Ray& ray = rays[static_cast<size_t>(i) < count ? i : 0];
+        for (int k = 0; k < 3; ++k) {
+          values[k][i] = ray.origin[k];
+          values[3 + k][i] = ray.direction[k];
+        }
+        values[6][i] = ray.tmax;
+      }
+      for (int k = 0; k < 3; ++k) {
+        origin[k] = simd::FloatV::load(values[k]);
+        direction[k] = simd::FloatV::load(values[3 + k]);
+      }
+      tmax = simd::FloatV::load(values[6]);
+    }
+
+    // mask of valid lanes
+    int laneMask() const { return (1 << count) - 1; }
+  };
+
+  // hit distance of every lane against sphere i, mask of lanes hit
+  simd::FloatV intersectSphere(const RayPacket& rays, size_t i,
+                               const simd::FloatV& tmax,
+                               simd::FloatV& t) const {
+    using simd::FloatV;
+    const FloatV ocx = rays.origin[0] - FloatV(sphere_center[0][i]);
+    const FloatV ocy = rays.origin[1] - FloatV(sphere_center[1][i]);
+    const FloatV ocz = rays.origin[2] - FloatV(sphere_center[2][i]);
+    const FloatV b = ocx * rays.direction[0] + ocy * rays.direction[1] +
+                     ocz * rays.direction[2];
+    const FloatV c =
+        ocx * ocx + ocy * ocy + ocz * ocz - FloatV(sphere_radius2[i]);
+    const FloatV D = b * b - c;
+    const FloatV sqrtD = simd::sqrt(simd::max(D, FloatV(0.0f)));
+    const FloatV t0 = -b - sqrtD;
+    const FloatV t1 = -b + sqrtD;
+
+    // nearer root unless it is out of range
+    const FloatV tmin(RAY_TMIN);
+    const FloatV traymax(RAY_TMAX);
+    t = simd::select((t0 >= tmin) & (t0 <= traymax), t0, t1);
+    return (D >= FloatV(0.0f)) & (t >= tmin) & (t <= traymax) & (t < tmax);
+  }
+
+  // hit distance of every lane against plane i, mask of lanes hit
+  simd::FloatV intersectPlane(const RayPacket& rays, size_t i,
+                              const simd::FloatV& tmax,
+                              simd::FloatV& t) const {
+    using simd::FloatV;
+    const FloatV nx(plane_normal[0][i]);
+    const FloatV ny(plane_normal[1][i]);
+    const FloatV nz(plane_normal[2][i]);
+    const FloatV px = rays.origin[0] - FloatV(plane_origin[0][i]);
+    const FloatV py = rays.origin[1] - FloatV(plane_origin[1][i]);
+    const FloatV pz = rays.origin[2] - FloatV(plane_origin[2][i]);
+    t = -(px * nx + py * ny + pz * nz) /
+        (rays.direction[0] * nx + rays.direction[1] * ny +
+         rays.direction[2] * nz);
+    FloatV mask =
+        (t >= FloatV(RAY_TMIN)) & (t <= FloatV(RAY_TMAX)) & (t < tmax);
+    if (!simd::movemask(mask)) return mask;
+
+    // hit position relative to plane origin
+    const FloatV hx = px + t * rays.direction[0];
+    const FloatV hy = py + t * rays.direction[1];
+    const FloatV hz = pz + t * rays.direction[2];
+    const FloatV u = (hx * FloatV(plane_right[0][i]) +
+                      hy * FloatV(plane_right[1][i]) +
+                      hz * FloatV(plane_right[2][i])) *
+                     FloatV(plane_right_length_inv[i]);
+    const FloatV v =
+        (hx * FloatV(plane_up[0][i]) + hy * FloatV(plane_up[1][i]) +
+         hz * FloatV(plane_up[2][i])) *
+        FloatV(plane_up_length_inv[i]);
+    const FloatV zero(0.0f), one(1.0f);
+    return mask & (u >= zero) & (u <= one) & (v >= zero) & (v <= one);
+  }
+
+  // watertight test, same as intersectTriangle() in intersect.frag
+  bool intersectTriangle(const Ray& ray, int triangle, float tmax, float& t,
+                         glm::vec3& normal) const {
+    const Triangle& record = scene->triangles[triangle];
+    const glm::vec3 p0(scene->vertices[record.vertex.x]);
+    const glm::vec3 p1(scene->vertices[record.vertex.y]);
+    const glm::vec3 p2(scene->vertices[record.vertex.z]);
+
+    // permute axes so that largest component of direction is z
+    const glm::vec3 absDir = glm::abs(ray.direction);
+    const int kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0 : 2)
+                                       : (absDir.y > absDir.z ? 1 : 2);
+    int kx = kz == 2 ? 0 : kz + 1;
+    int ky = kx == 2 ? 0 : kx + 1;
+    // preserve winding
+    if (ray.direction[kz] < 0) std::swap(kx, ky);
+
+    // shear constants
+    const float Sz = 1.0f / ray.direction[kz];
+    const float Sx = ray.direction[kx] * Sz;
+    const float Sy = ray.direction[ky] * Sz;
+
+    // vertices relative to ray origin, sheared
+    const glm::vec3 A = p0 - ray.origin;
+    const glm::vec3 B = p1 - ray.origin;
+    const glm::vec3 C = p2 - ray.origin;
+    const float Ax = A[kx] - Sx * A[kz];
+    const float Ay = A[ky] - Sy * A[kz];
+    const float Bx = B[kx] - Sx * B[kz];
+    const float By = B[ky] - Sy * B[kz];
+    const float Cx = C[kx] - Sx * C[kz];
+    const float Cy = C[ky] - Sy * C[kz];
+
+    // scaled barycentric coordinates
+    const float U = Cx * By - Cy * Bx;
+    const float V = Ax * Cy - Ay * Cx;
+    const float W_ = Bx * Ay - By * Ax;
+    if ((U < 0 || V < 0 || W_ < 0) && (U > 0 || V > 0 || W_ > 0)) {
+      return false;
+    }
+    const float det = U + V + W_;
+    if (det == 0) return false;
+
+    t = Sz * (U * A[kz] + V * B[kz] + W_ * C[kz]) / det;
+    if (!(t >= RAY_TMIN && t <= RAY_TMAX && t < tmax)) return false;
+
+    // geometric normal faces the ray like plane
+    normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+    if (glm::dot(-ray.direction, normal) < 0) normal = -normal;
+    return true;
+  }
+
+  // closest triangle nearer than hit, hit is replaced when found
+  // BVH also holds spheres and planes, their refs are skipped
+  // any_hit stops at first triangle found
+  bool intersectTriangles(const Ray& ray, Hit& hit, bool any_hit) const {
+    if (!scene || scene->triangles.empty()) return false;
+    const std::vector<BVHNode>& nodes = scene->bvh.nodes;
+    const std::vector<int>& indices = scene->bvh.indices;
+    const glm::vec3 invDir = 1.0f / ray.direction;
+    float tmax = std::min(hit.t, ray.tmax);
+
+    // return entry distance of ray, or -1 when ray misses box before tmax
+    const auto intersectNode = [&](int node) {
+      const glm::vec3 t0 = (nodes[node].bboxMin - ray.origin) * invDir;
+      const glm::vec3 t1 = (nodes[node].bboxMax - ray.origin) * invDir;
+      const glm::vec3 tmin3 = glm::min(t0, t1);
+      const glm::vec3 tmax3 = glm::max(t0, t1);
+      const float tnear =
+          std::max(std::max(tmin3.x, tmin3.y), std::max(tmin3.z, 0.0f));
+      const float tfar =
+          std::min(std::min(tmax3.x, tmax3.y), std::min(tmax3.z, tmax));
+      return tnear <= tfar ? tnear : -1.0f;
+    };
+
+    if (intersectNode(0) < 0) return false;
+
+    // stack of far children and their entry distance
+    int stack[BVH::MAX_DEPTH];
+    float stackT[BVH::MAX_DEPTH];
+    int sp = 0;
+
+    bool found = false;
+    int node = 0;
+    while (true) {
+      const BVHNode& current = nodes[node];
+
+      // leaf
+      if (current.count > 0) {
+        for (int i = current.leftOrFirst;
+             i < current.leftOrFirst + current.count; ++i) {
+          const int ref = indices[i];
+          if ((ref >> Scene::PRIMITIVE_TYPE_SHIFT) !=
+              Scene::PRIMITIVE_TRIANGLE) {
+            continue;
+          }
+          const int triangle = ref & ((1 << Scene::PRIMITIVE_TYPE_SHIFT) - 1);
+          float t;
+          glm::vec3 normal;
+          if (!intersectTriangle(ray, triangle, tmax, t, normal)) continue;
+          found = true;
+          tmax = t;
+          hit.t = t;
+          hit.position = ray.origin + t * ray.direction;
+          hit.normal = normal;
+          hit.primitive = scene->n_primitives + triangle;
+          if (any_hit) return true;
+        }
+      }
+      // interior, visit nearer child first
+      else {
+        const int left = node + 1;
+        const int right = current.leftOrFirst;
+        const float tl = intersectNode(left);
+        const float tr = intersectNode(right);
+        if (tl >= 0 && tr >= 0) {
+          const bool leftFirst = tl <= tr;
+          stack[sp] = leftFirst ? right : left;
+          stackT[sp] = leftFirst ? tr : tl;
+          sp++;
+          node = leftFirst ? left : right;
+          continue;
+        } else if (tl >= 0) {
+          node = left;
+          continue;
+        } else if (tr >= 0) {
+          node = right;
+          continue;
+        }
+      }
+
+      // pop next node, skip nodes behind closest hit
+      bool popped = false;
+      while (sp > 0) {
+        sp--;
+        if (stackT[sp] <= tmax) {
+          node = stack[sp];
+          popped = true;
+          break;
+        }
+      }
+      if (!popped) break;
+    }
+
+    return found;
+  }
+
+  void closestHitPacket(const Ray* rays, size_t count, Hit* hits) const {
+    using simd::FloatV;
+    const RayPacket packet(rays, count);
+
+    // spheres are 0 to n_spheres - 1, planes follow
+    FloatV best_t = packet.tmax;
+    FloatV best_index(-1.0f);
+    for (size_t i = 0; i < sphere_radius2.size(); ++i) {
+      FloatV t;
+      const FloatV mask = intersectSphere(packet, i, best_t, t);
+      best_t = simd::select(mask, t, best_t);
+      best_index =
+          simd::select(mask, FloatV(static_cast<float>(i)), best_index);
+    }
+    const size_t n_spheres = sphere_radius2.size();
+    for (size_t i = 0; i < plane_primitive.size(); ++i) {
+      FloatV t;
+      const FloatV mask = intersectPlane(packet, i, best_t, t);
+      best_t = simd::select(mask, t, best_t);
+      best_index = simd::select(
+          mask, FloatV(static_cast<float>(n_spheres + i)), best_index);
+    }
+
+    alignas(32) float ts[W];
+    alignas(32) float indices[W];
+    best_t.store(ts);
+    best_index.store(indices);
+    for (size_t lane = 0; lane < count; ++lane) {
+      Hit& hit = hits[lane];
+      hit = Hit();
+      if (indices[lane] < 0) continue;
+
+      const Ray& ray = rays[lane];
+      const size_t index = static_cast<size_t>(indices[lane]);
+      hit.t = ts[lane];
+      hit.position = ray.origin + hit.t * ray.direction;
+      if (index < n_spheres) {
+        const glm::vec3 center(sphere_center[0][index],
+                               sphere_center[1][index],
+                               sphere_center[2][index]);
+        hit.normal = glm::normalize(hit.position - center);
+        hit.primitive = sphere_primitive[index];
+      } else {
+        const size_t plane = index - n_spheres;
+        const glm::vec3 normal(plane_normal[0][plane], plane_normal[1][plane],
+                               plane_normal[2][plane]);
+        hit.normal = glm::dot(-ray.direction, normal) > 0 ? normal : -normal;
+        hit.primitive = plane_primitive[plane];
+      }
+    }
+
+    for (size_t lane = 0; lane < count; ++lane) {
+      intersectTriangles(rays[lane], hits[lane], false);
+    }
+  }
+
+  void anyHitPacket(const Ray* rays, size_t count,
+                    std::vector<bool>::iterator hits) const {
+    using simd::FloatV;
+    const RayPacket packet(rays, count);
+    const int lanes = packet.laneMask();
+
+    // stop as soon as every lane is occluded
+    int occluded = 0;
+    for (size_t i = 0; i < sphere_radius2.size() && occluded != lanes; ++i) {
+      FloatV t;
+      occluded |= simd::movemask(intersectSphere(packet, i, packet.tmax, t));
+      occluded &= lanes;
+    }
+    for (size_t i = 0; i < plane_primitive.size() && occluded != lanes; ++i) {
+      FloatV t;
+      occluded |= simd::movemask(intersectPlane(packet, i, packet.tmax, t));
+      occluded &= lanes;
+    }
+
+    for (size_t lane = 0; lane < count; ++lane) {
+      Hit hit;
+      hits[lane] = ((occluded >> lane) & 1) ||
+                   intersectTriangles(rays[lane], hit, true);
+    }
+  }
+
+ public:
+  RayQuery() {}
+  RayQuery(const Scene& scene) { build(scene); }
+
+  // call again after scene is changed, scene is kept for triangle tests
+  void build(const Scene& scene) {
+    for (int k = 0; k < 3; ++k) {
+      sphere_center[k].clear();
+      plane_origin[k].clear();
+      plane_normal[k].clear();
+      plane_right[k].clear();
+      plane_up[k].clear();
+    }
+    sphere_radius2.clear();
+    sphere_primitive.clear();
+    plane_right_length_inv.clear();
+    plane_up_length_inv.clear();
+    plane_primitive.clear();
+    this->scene = &scene;
+
+    // records are baked in order of primitives, see Scene::init()
+    size_t n_spheres = 0;
+    size_t n_planes = 0;
+    for (int i = 0; i < scene.n_primitives; ++i) {
+      if (scene.primitives[i].type == Scene::PRIMITIVE_SPHERE) {
+        const SphereRecord& sphere = scene.spheres[n_spheres++];
+        for (int k = 0; k < 3; ++k) {
+          sphere_center[k].push_back(sphere.center[k]);
+        }
+        sphere_radius2.push_back(sphere.radius2);
+        sphere_primitive.push_back(i);
+      } else {
+        const PlaneRecord& plane = scene.planes[n_planes++];
+        for (int k = 0; k < 3; ++k) {
+          plane_origin[k].push_back(plane.origin[k]);
+          plane_normal[k].push_back(plane.normal[k]);
+          plane_right[k].push_back(plane.rightDir[k]);
+          plane_up[k].push_back(plane.upDir[k]);
+        }
+        plane_right_length_inv.push_back(plane.rightLengthInv);
+        plane_up_length_inv.push_back(plane.upLengthInv);
+        plane_primitive.push_back(i);
+      }
+    }
+  }
+
+  // closest hit of each ray
+  std::vector<Hit> closestHit(const std::vector<Ray>& rays) const {
+    std::vector<Hit> hits(rays.size());
+    for (size_t i = 0; i < rays.size(); i += W) {
+      closestHitPacket(rays.data() + i, std::min<size_t>(W, rays.size() - i),
+                       hits.data() + i);
+    }
+    return hits;
+  }
+  Hit closestHit(const Ray& ray) const {
+    Hit hit;
+    closestHitPacket(&ray, 1, &hit);
+    return hit;
+  }
+
+  // true when anything is hit before tmax of each ray
+  std::vector<bool> anyHit(const std::vector<Ray>& rays) const {
+    std::vector<bool> hits(rays.size());
+    for (size_t i = 0; i < rays.size(); i += W) {
+      anyHitPacket(rays.data() + i, std::min<size_t>(W, rays.size() - i),
+                   hits.begin() + i);
+    }
+    return hits;
+  }
+  bool anyHit(const Ray& ray) const {
+    std::vector<bool> hit(1);
+    anyHitPacket(&ray, 1, hit.begin());
+    return hit[0];
+  }
+};
+
+#endif
\ No newline at end of file
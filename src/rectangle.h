@@ -1,6 +1,7 @@
 #ifndef _RECTANGLE_H
 #define _RECTANGLE_H
 
+#include "gl_state.h"
 #include "glad/glad.h"
 #include "shader.h"
 
@@ -14,7 +15,7 @@ class Rectangle {
   Rectangle() {
     // setup VAO
     glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    GLState::get().bindVertexArray(VAO);
 
     // setup VBO;
     // positions and texture coords
@@ -41,7 +42,8 @@ class Rectangle {
                           (GLvoid*)(3 * sizeof(float)));
 
     // unbind VAO, VBO, EBO
-    glBindVertexArray(0);
+    // VAO first, otherwise unbinding EBO detaches it from VAO
+    GLState::get().bindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   }
@@ -50,14 +52,15 @@ class Rectangle {
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
     glDeleteVertexArrays(1, &VAO);
+    GLState::get().invalidate();
   }
 
-  void draw(const Shader& shader) const {
-    shader.activate();
-    glBindVertexArray(VAO);
+  void draw(Shader& shader) const {
+    // draw is skipped while shader fails to build
+    if (!shader.activate()) return;
+    // VAO stays bound, EBO must not be rebound elsewhere
+    GLState::get().bindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-    shader.deactivate();
   }
 };
 
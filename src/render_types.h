@@ -0,0 +1,21 @@
+#ifndef _RENDER_TYPES_H
+#define _RENDER_TYPES_H
+
+// settings shared by GL and CPU renderers
+
+enum class Integrator {
+  PT,
+  PTNEE,
+  // PT advancing every path one bounce per draw
+  Wavefront,
+};
+
+// same as SAMPLER_* in rng.frag
+enum class SamplerType {
+  XORShift,   // stateful, needs stateTexture
+  Sobol,      // Owen scrambled Sobol
+  BlueNoise,  // Sobol rotated by blue noise per pixel
+  PCG,        // hash of pixel, sample index and dimension
+};
+
+#endif
\ No newline at end of file
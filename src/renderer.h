@@ -1,15 +1,27 @@
 #ifndef _RENDERER_H
 #define _RENDERER_H
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
-#include <limits>
-#include <random>
+#include <cstring>
+#include <string>
 #include <vector>
 
+#include "blue_noise.h"
 #include "camera.h"
+#include "checkpoint.h"
+#include "frame_publisher.h"
+#include "gl_state.h"
 #include "glad/glad.h"
+#include "image.h"
+#include "image_exporter.h"
+#include "profiler.h"
+#include "ray_query.h"
 #include "rectangle.h"
+#include "render_types.h"
 #include "scene.h"
 #include "shader.h"
+#include "tile_scheduler.h"
 
 enum class RenderMode {
   Render,
@@ -17,11 +29,7 @@ enum class RenderMode {
   Depth,
   Albedo,
   UV,
-};
-
-enum class Integrator {
-  PT,
-  PTNEE,
+  Convergence,
 };
 
 class Renderer {
@@ -38,76 +46,680 @@ class Renderer {
     }
   };
 
-  unsigned int samples;
+  unsigned int samples_per_pass;
+  unsigned int tiles_per_pass;
+  float adaptive_threshold;
+  unsigned int adaptive_min_samples;
+  SamplerType sampler_type;
+  unsigned int seed;
+  // keep accumulation on camera moves by reprojecting it
+  bool reprojection;
+  float max_history;
+  // filter output with a-trous wavelet, accumulation is kept as is
+  bool denoise;
+  unsigned int denoise_iterations;
+  // start PT/PTNEE paths from G-buffer, pixel center only
+  bool primary_cache;
+  // compile integrators for primitive and BRDF types of current scene
+  bool specialize_shaders;
+  unsigned int max_depth;
+  // count rays in accumTexture alpha, see getRays()
+  bool count_rays;
+  // mean number of finished paths per pixel in wavefront mode
+  float wavefront_samples;
+  TileScheduler tiles;
   GlobalBlock global;
   Camera camera;
   Scene scene;
+  // spheres and planes of scene for picking on CPU
+  RayQuery ray_query;
+  // asynchronous readback and encoding of accumulation
+  ImageExporter exporter;
+  // same readback for frames published to shared memory, kept apart so
+  // publishing every frame never takes slots of exports
+  ImageExporter frame_exporter;
 
   GLuint accumTexture;
   GLuint stateTexture;
+  // luminance moments and number of samples of each pixel
+  GLuint momentsTexture;
   GLuint accumFBO;
 
+  // path state of wavefront integrator, see wavefront.frag
+  GLuint pathOriginTexture;
+  GLuint pathDirectionTexture;
+  GLuint pathThroughputTexture;
+  GLuint wavefrontFBO;
+
+  // number of samples summed over blocks of pixels, read back one pass
+  // later for wavefront_samples, see startSampleSum()
+  static constexpr unsigned int SAMPLE_SUM_BLOCK_SIZE = 16;
+  GLuint sampleSumTexture;
+  GLuint sampleSumFBO;
+  GLuint sampleSumPBO[2];
+  GLsync sample_sum_fence[2];
+  // slot of next sum
+  int sample_sum_index;
+
+  GLuint blueNoiseTexture;
+
+  // G-buffer of current and previous view, see common/gbuffer.frag
+  GLuint gbufferPositionTexture[2];
+  GLuint gbufferNormalTexture[2];
+  GLuint gbufferAlbedoTexture[2];
+  GLuint gbufferUVTexture[2];
+  GLuint gbufferPrimitiveTexture[2];
+  GLuint gbufferFBO[2];
+  int gbuffer_index;
+  // camera of current G-buffer
+  CameraBlock gbuffer_camera;
+  // reprojected accumulation, copied to accumTexture and momentsTexture
+  GLuint historyAccumTexture;
+  GLuint historyMomentsTexture;
+  GLuint reprojectFBO;
+  GLuint copyFBO;
+
+  // ping-pong buffers of denoiser, see atrous.frag
+  GLuint denoiseTexture[2];
+  GLuint denoiseFBO[2];
+
   GLuint globalUBO;
   GLuint cameraUBO;
   GLuint sceneUBO;
 
+  // scene primitives and BVH on texture buffers
+  GLuint sphereBuffer;
+  GLuint sphereTexture;
+  GLuint planeBuffer;
+  GLuint planeTexture;
+  GLuint bvhNodeBuffer;
+  GLuint bvhNodeTexture;
+  GLuint bvhIndexBuffer;
+  GLuint bvhIndexTexture;
+  GLuint vertexBuffer;
+  GLuint vertexTexture;
+  GLuint normalBuffer;
+  GLuint normalTexture;
+  GLuint triangleBuffer;
+  GLuint triangleTexture;
+  GLuint lightCDFBuffer;
+  GLuint lightCDFTexture;
+
   Rectangle rectangle;
 
   Shader pt_shader;
   Shader pt_nee_shader;
+  Shader wavefront_shader;
   Shader bdpt_shader;
   Shader output_shader;
   Shader normal_shader;
   Shader depth_shader;
   Shader albedo_shader;
   Shader uv_shader;
+  Shader convergence_shader;
+  Shader gbuffer_shader;
+  Shader reproject_shader;
+  Shader denoise_input_shader;
+  Shader atrous_shader;
+  Shader sample_sum_shader;
 
   RenderMode mode;
   Integrator integrator;
   SceneType scene_type;
+  // built-in scene or path of loaded scene file
+  std::string scene_name;
 
+  // camera is changed, accumulation is cleared or reprojected
   bool clear_flag;
 
+  // bytes sent by last scene edit
+  size_t scene_edit_upload_bytes = 0;
+
+  Profiler profiler;
+
+  static void createTextureBuffer(GLuint& buffer, GLuint& texture,
+                                  GLenum internal_format) {
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &texture);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STATIC_DRAW);
+    GLState::get().bindScratchTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, internal_format, buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  static void uploadTextureBuffer(GLuint buffer, size_t size,
+                                  const void* data) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    // empty buffer is not allowed
+    if (size > 0) {
+      glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STATIC_DRAW);
+    } else {
+      glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  }
+
+  // send primitives and BVH
+  void uploadScene() {
+    glBindBuffer(GL_UNIFORM_BUFFER, sceneUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SceneBlock), &scene.block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    uploadTextureBuffer(sphereBuffer,
+                        sizeof(SphereRecord) * scene.spheres.size(),
+                        scene.spheres.data());
+    uploadTextureBuffer(planeBuffer,
+                        sizeof(PlaneRecord) * scene.planes.size(),
+                        scene.planes.data());
+    uploadTextureBuffer(bvhNodeBuffer,
+                        sizeof(BVHNode) * scene.bvh.nodes.size(),
+                        scene.bvh.nodes.data());
+    uploadTextureBuffer(bvhIndexBuffer,
+                        sizeof(int) * scene.bvh.indices.size(),
+                        scene.bvh.indices.data());
+    uploadTextureBuffer(vertexBuffer,
+                        sizeof(glm::vec4) * scene.vertices.size(),
+                        scene.vertices.data());
+    uploadTextureBuffer(normalBuffer,
+                        sizeof(glm::vec4) * scene.normals.size(),
+                        scene.normals.data());
+    uploadTextureBuffer(triangleBuffer,
+                        sizeof(Triangle) * scene.triangles.size(),
+                        scene.triangles.data());
+    uploadTextureBuffer(lightCDFBuffer,
+                        sizeof(float) * scene.light_cdf.size(),
+                        scene.light_cdf.data());
+
+    ray_query.build(scene);
+    updateShaderDefines();
+  }
+
+  // send compiled scene straight from its file mapping
+  void uploadScene(const SceneBinary& binary) {
+    using namespace SceneBinaryFormat;
+    glBindBuffer(GL_UNIFORM_BUFFER, sceneUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SceneBlock),
+                    binary.getSection(BLOCK).data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    const auto upload = [&](GLuint buffer, Section section) {
+      const SceneSection& data = binary.getSection(section);
+      uploadTextureBuffer(buffer, data.size, data.data);
+    };
+    upload(sphereBuffer, SPHERES);
+    upload(planeBuffer, PLANES);
+    upload(bvhNodeBuffer, BVH_NODES);
+    upload(bvhIndexBuffer, BVH_INDICES);
+    upload(vertexBuffer, VERTICES);
+    upload(normalBuffer, NORMALS);
+    upload(triangleBuffer, TRIANGLES);
+    upload(lightCDFBuffer, LIGHT_CDF);
+
+    ray_query.build(scene);
+    updateShaderDefines();
+  }
+
+  static void uploadDirtyRanges(GLenum target, GLuint buffer,
+                                const DirtyRanges& dirty, const void* data) {
+    if (dirty.empty()) return;
+    glBindBuffer(target, buffer);
+    for (const auto& [begin, end] : dirty.ranges) {
+      glBufferSubData(target, begin, end - begin,
+                      static_cast<const char*>(data) + begin);
+    }
+    glBindBuffer(target, 0);
+  }
+
+  // send only bytes modified by scene edits, sizes of buffers are unchanged
+  void uploadSceneEdits() {
+    uploadDirtyRanges(GL_UNIFORM_BUFFER, sceneUBO, scene.block_dirty,
+                      &scene.block);
+    uploadDirtyRanges(GL_TEXTURE_BUFFER, sphereBuffer, scene.spheres_dirty,
+                      scene.spheres.data());
+    uploadDirtyRanges(GL_TEXTURE_BUFFER, planeBuffer, scene.planes_dirty,
+                      scene.planes.data());
+    uploadDirtyRanges(GL_TEXTURE_BUFFER, bvhNodeBuffer,
+                      scene.bvh_nodes_dirty, scene.bvh.nodes.data());
+    scene_edit_upload_bytes =
+        scene.block_dirty.size() + scene.spheres_dirty.size() +
+        scene.planes_dirty.size() + scene.bvh_nodes_dirty.size();
+    // lights of emission edits, size of CDF may change
+    if (scene.light_cdf_dirty) {
+      uploadTextureBuffer(lightCDFBuffer,
+                          sizeof(float) * scene.light_cdf.size(),
+                          scene.light_cdf.data());
+      scene_edit_upload_bytes += sizeof(float) * scene.light_cdf.size();
+    }
+    if (!scene.spheres_dirty.empty() || !scene.planes_dirty.empty()) {
+      ray_query.build(scene);
+    }
+    // BRDF types are changed only by material edits
+    const bool materials_changed = !scene.block_dirty.empty();
+    scene.clearDirty();
+
+    if (materials_changed) updateShaderDefines();
+  }
+
+  // compile time constants of scene tracing shaders, see global.frag
+  // each variant is compiled once and kept, counts and max depth are
+  // uniforms so that edits do not recompile
+  void updateShaderDefines() {
+    std::string defines;
+    if (specialize_shaders) defines += scene.getShaderDefines();
+    if (count_rays) defines += "#define COUNT_RAYS\n";
+
+    for (Shader* shader :
+         {&pt_shader, &pt_nee_shader, &wavefront_shader, &gbuffer_shader}) {
+      shader->setDefines(defines);
+    }
+
+    // subpath arrays of bdpt are sized at compile time, bound is rounded up
+    // to power of two so that most depth edits reuse program
+    unsigned int depth_bound = 16;
+    while (depth_bound < max_depth) depth_bound *= 2;
+    bdpt_shader.setDefines(defines + "#define MAX_DEPTH " +
+                           std::to_string(depth_bound) + "\n");
+  }
+
+  void setMaxDepthUniforms() {
+    for (Shader* shader :
+         {&pt_shader, &pt_nee_shader, &wavefront_shader, &bdpt_shader}) {
+      shader->setUniform("maxDepth", static_cast<GLint>(max_depth));
+    }
+  }
+
+  static const char* getIntegratorName(Integrator integrator) {
+    switch (integrator) {
+      case Integrator::PT:
+        return "pt";
+      case Integrator::PTNEE:
+        return "ptnee";
+      case Integrator::Wavefront:
+        return "wavefront";
+    }
+    return "";
+  }
+
+  // RNG state is written only by xorshift32, other samplers are stateless
+  void setupDrawBuffers() const {
+    const GLenum state_attachment = sampler_type == SamplerType::XORShift
+                                        ? GL_COLOR_ATTACHMENT1
+                                        : GL_NONE;
+    const GLenum attachments[6] = {
+        GL_COLOR_ATTACHMENT0, state_attachment,     GL_COLOR_ATTACHMENT2,
+        GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4, GL_COLOR_ATTACHMENT5};
+
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+    glDrawBuffers(3, attachments);
+    glBindFramebuffer(GL_FRAMEBUFFER, wavefrontFBO);
+    glDrawBuffers(6, attachments);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  // accumulation and path state are sampled while they are rendered to,
+  // writes of previous draws are visible to texture fetches only after a
+  // barrier
+  static void textureBarrier() {
+    if (GLAD_GL_ARB_texture_barrier) {
+      glTextureBarrier();
+    } else if (GLAD_GL_NV_texture_barrier) {
+      glTextureBarrierNV();
+    }
+  }
+
+  // zero state makes xorshift32 seed itself from pixel and seed
+  void clearRNGState() const {
+    const GLenum attachment = GL_COLOR_ATTACHMENT1;
+    const GLuint zero[4] = {0, 0, 0, 0};
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+    glDrawBuffers(1, &attachment);
+    glClearBufferuiv(GL_COLOR, 0, zero);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    setupDrawBuffers();
+  }
+
+  void setGBufferUniforms(Shader& shader) const {
+    shader.setUniformTexture("gbufferPosition",
+                             gbufferPositionTexture[gbuffer_index], 20);
+    shader.setUniformTexture("gbufferNormal",
+                             gbufferNormalTexture[gbuffer_index], 21);
+    shader.setUniformTexture("gbufferAlbedo",
+                             gbufferAlbedoTexture[gbuffer_index], 22);
+    shader.setUniformTexture("gbufferUV", gbufferUVTexture[gbuffer_index],
+                             23);
+    shader.setUniformTexture("gbufferPrimitive",
+                             gbufferPrimitiveTexture[gbuffer_index], 26);
+  }
+
+  // trace primary hits of current view in one pass, previous G-buffer is
+  // kept for reprojection
+  void renderGBuffer() {
+    gbuffer_index = 1 - gbuffer_index;
+    glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO[gbuffer_index]);
+    rectangle.draw(gbuffer_shader);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gbuffer_camera = camera.params;
+
+    setGBufferUniforms(pt_shader);
+    setGBufferUniforms(pt_nee_shader);
+    setGBufferUniforms(normal_shader);
+    setGBufferUniforms(depth_shader);
+    setGBufferUniforms(albedo_shader);
+    setGBufferUniforms(uv_shader);
+    setGBufferUniforms(reproject_shader);
+    setGBufferUniforms(atrous_shader);
+  }
+
+  // copy attachment of reprojectFBO to texture
+  void copyHistory(GLenum attachment, GLuint texture) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, reprojectFBO);
+    glReadBuffer(attachment);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copyFBO);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, texture, 0);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glBlitFramebuffer(0, 0, global.resolution.x, global.resolution.y, 0, 0,
+                      global.resolution.x, global.resolution.y,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  // move accumulation of previous view to current view, pixels whose
+  // primary hit does not match previous view start from zero
+  void reproject() {
+    profiler.beginCPU("reproject");
+    profiler.beginGPU("reproject");
+
+    glViewport(0, 0, global.resolution.x, global.resolution.y);
+
+    // keep previous camera while tracing current view
+    const CameraBlock previous = gbuffer_camera;
+    renderGBuffer();
+
+    const int prev_index = 1 - gbuffer_index;
+    reproject_shader.setUniformTexture(
+        "previousPosition", gbufferPositionTexture[prev_index], 24);
+    reproject_shader.setUniformTexture("previousNormal",
+                                       gbufferNormalTexture[prev_index], 25);
+    reproject_shader.setUniform("prevCamPos", previous.camPos);
+    reproject_shader.setUniform("prevCamForward", previous.camForward);
+    reproject_shader.setUniform("prevCamRight", previous.camRight);
+    reproject_shader.setUniform("prevCamUp", previous.camUp);
+    reproject_shader.setUniform("prevCamA", previous.a);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, reprojectFBO);
+    rectangle.draw(reproject_shader);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    copyHistory(GL_COLOR_ATTACHMENT0, accumTexture);
+    copyHistory(GL_COLOR_ATTACHMENT1, momentsTexture);
+
+    // paths in flight belong to previous view
+    const GLfloat zero[4] = {0, 0, 0, 0};
+    glBindFramebuffer(GL_FRAMEBUFFER, wavefrontFBO);
+    glClearBufferfv(GL_COLOR, 5, zero);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // count samples from here
+    tiles.reset();
+    wavefront_samples = 0;
+    cancelSampleSums();
+
+    profiler.endGPU("reproject");
+    profiler.endCPU("reproject");
+  }
+
+  // filter mean of accumTexture into denoiseTexture and set it on
+  // output_shader
+  void applyDenoise() {
+    profiler.beginCPU("denoise");
+
+    profiler.beginGPU("denoise input");
+    glBindFramebuffer(GL_FRAMEBUFFER, denoiseFBO[0]);
+    rectangle.draw(denoise_input_shader);
+    profiler.endGPU("denoise input");
+
+    // ping-pong between denoiseTexture, step size doubles every iteration
+    int src = 0;
+    for (unsigned int i = 0; i < denoise_iterations; ++i) {
+      const std::string pass_name = "atrous " + std::to_string(i);
+      profiler.beginGPU(pass_name);
+      atrous_shader.setUniformTexture("colorTexture", denoiseTexture[src],
+                                      16);
+      atrous_shader.setUniform("stepSize", GLint(1 << i));
+      glBindFramebuffer(GL_FRAMEBUFFER, denoiseFBO[1 - src]);
+      rectangle.draw(atrous_shader);
+      profiler.endGPU(pass_name);
+      src = 1 - src;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    output_shader.setUniformTexture("denoisedTexture", denoiseTexture[src],
+                                    19);
+
+    profiler.endCPU("denoise");
+  }
+
+  // apply camera change
+  void updateCamera() {
+    if (!clear_flag) return;
+    if (reprojection) {
+      reproject();
+    } else {
+      clear();
+    }
+    clear_flag = false;
+  }
+
+  static void setupFloatTexture(GLuint texture, unsigned int width,
+                                unsigned int height) {
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA,
+                 GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  }
+
+  static void setupUintTexture(GLuint texture, unsigned int width,
+                               unsigned int height) {
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0,
+                 GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  }
+
+  glm::uvec2 getSampleSumSize() const {
+    return (global.resolution + glm::uvec2(SAMPLE_SUM_BLOCK_SIZE - 1)) /
+           SAMPLE_SUM_BLOCK_SIZE;
+  }
+
+  // texture and pixel buffers of sums at current resolution
+  void setupSampleSum() {
+    cancelSampleSums();
+    const glm::uvec2 size = getSampleSumSize();
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, sampleSumTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size.x, size.y, 0, GL_RED,
+                 GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    for (const GLuint pbo : sampleSumPBO) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+      glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(GLfloat) * size.x * size.y,
+                   nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  // sum samples of blocks on GPU and start copy of sums into pixel buffer
+  // of sample_sum_index, returns without waiting
+  void startSampleSum() {
+    const glm::uvec2 size = getSampleSumSize();
+    glViewport(0, 0, size.x, size.y);
+    glBindFramebuffer(GL_FRAMEBUFFER, sampleSumFBO);
+    rectangle.draw(sample_sum_shader);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, sampleSumPBO[sample_sum_index]);
+    glReadPixels(0, 0, size.x, size.y, GL_RED, GL_FLOAT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, global.resolution.x, global.resolution.y);
+
+    GLsync& fence = sample_sum_fence[sample_sum_index];
+    if (fence) glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    sample_sum_index = 1 - sample_sum_index;
+  }
+
+  // mean number of samples from sums started before last startSampleSum()
+  // GPU still has the pass after them queued, so waiting does not leave it
+  // idle
+  void readSampleSum() {
+    GLsync& fence = sample_sum_fence[sample_sum_index];
+    if (!fence) return;
+    const GLenum status =
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(fence);
+    fence = nullptr;
+    if (status == GL_WAIT_FAILED) return;
+
+    const glm::uvec2 size = getSampleSumSize();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, sampleSumPBO[sample_sum_index]);
+    const GLfloat* sums = static_cast<const GLfloat*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                         sizeof(GLfloat) * size.x * size.y, GL_MAP_READ_BIT));
+    if (sums) {
+      double sum = 0;
+      for (unsigned int i = 0; i < size.x * size.y; ++i) sum += sums[i];
+      wavefront_samples =
+          sum / (static_cast<double>(global.resolution.x) *
+                 global.resolution.y);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+
+  // sums in flight belong to accumulation before clear
+  void cancelSampleSums() {
+    for (GLsync& fence : sample_sum_fence) {
+      if (fence) glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+
+  void setSamplerUniforms(Shader& shader) const {
+    shader.setUniform("samplerType", static_cast<GLint>(sampler_type));
+    shader.setUniform("randomSeed", static_cast<GLuint>(seed));
+    shader.setUniformTexture("blueNoiseTexture", blueNoiseTexture, 13);
+  }
+
+  void setAdaptiveUniforms(Shader& shader) const {
+    shader.setUniform("adaptiveThreshold", adaptive_threshold);
+    shader.setUniform("adaptiveMinSamples",
+                      static_cast<GLint>(adaptive_min_samples));
+  }
+
+  // read back RGBA32F texture
+  std::vector<GLfloat> readTexture(GLuint texture) const {
+    std::vector<GLfloat> data(4 * global.resolution.x * global.resolution.y);
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, data.data());
+    return data;
+  }
+
+  void setSceneUniforms(Shader& shader) const {
+    shader.setUniformTextureBuffer("sphereBuffer", sphereTexture, 2);
+    shader.setUniformTextureBuffer("planeBuffer", planeTexture, 3);
+    shader.setUniformTextureBuffer("bvhNodeBuffer", bvhNodeTexture, 4);
+    shader.setUniformTextureBuffer("bvhIndexBuffer", bvhIndexTexture, 5);
+    shader.setUniformTextureBuffer("vertexBuffer", vertexTexture, 6);
+    shader.setUniformTextureBuffer("normalBuffer", normalTexture, 7);
+    shader.setUniformTextureBuffer("triangleBuffer", triangleTexture, 8);
+    shader.setUniformTextureBuffer("lightCDFBuffer", lightCDFTexture, 14);
+    shader.setUBO("GlobalBlock", 0);
+    shader.setUBO("CameraBlock", 1);
+    shader.setUBO("SceneBlock", 2);
+  }
+
  public:
   Renderer(unsigned int width, unsigned int height)
-      : samples(0),
+      : samples_per_pass(1),
+        tiles_per_pass(1),
+        adaptive_threshold(0),
+        adaptive_min_samples(64),
+        sampler_type(SamplerType::PCG),
+        seed(0),
+        reprojection(false),
+        max_history(32),
+        denoise(false),
+        denoise_iterations(5),
+        primary_cache(false),
+        specialize_shaders(true),
+        max_depth(100),
+        count_rays(false),
+        wavefront_samples(0),
+        tiles({width, height}),
         global({width, height}),
+        sample_sum_fence{nullptr, nullptr},
+        sample_sum_index(0),
+        gbuffer_index(0),
+        gbuffer_camera(camera.params),
         pt_shader({"./shaders/rect.vert", "./shaders/pt.frag"}),
         pt_nee_shader({"./shaders/rect.vert", "./shaders/pt-nee.frag"}),
+        wavefront_shader({"./shaders/rect.vert", "./shaders/wavefront.frag"}),
         bdpt_shader({"./shaders/rect.vert", "./shaders/bdpt.frag"}),
         output_shader({"./shaders/rect.vert", "./shaders/output.frag"}),
         normal_shader({"./shaders/rect.vert", "./shaders/normal.frag"}),
         depth_shader({"./shaders/rect.vert", "./shaders/depth.frag"}),
         albedo_shader({"./shaders/rect.vert", "./shaders/albedo.frag"}),
         uv_shader({"./shaders/rect.vert", "./shaders/uv.frag"}),
+        convergence_shader(
+            {"./shaders/rect.vert", "./shaders/convergence.frag"}),
+        gbuffer_shader({"./shaders/rect.vert", "./shaders/gbuffer.frag"}),
+        reproject_shader({"./shaders/rect.vert", "./shaders/reproject.frag"}),
+        denoise_input_shader(
+            {"./shaders/rect.vert", "./shaders/denoise-input.frag"}),
+        atrous_shader({"./shaders/rect.vert", "./shaders/atrous.frag"}),
+        sample_sum_shader(
+            {"./shaders/rect.vert", "./shaders/sample-sum.frag"}),
         mode(RenderMode::Render),
         integrator(Integrator::PT),
-        scene_type(SceneType::Original) {
+        scene_type(SceneType::Original),
+        scene_name("original"),
+        clear_flag(false) {
     // setup accumulate texture
     glGenTextures(1, &accumTexture);
-    glBindTexture(GL_TEXTURE_2D, accumTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB,
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, accumTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA,
                  GL_FLOAT, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
 
-    // setup RNG state texture
+    // setup RNG state texture, seeded on GPU by first pass
     glGenTextures(1, &stateTexture);
-    glBindTexture(GL_TEXTURE_2D, stateTexture);
-    std::vector<uint32_t> seed(width * height);
-    std::random_device rnd_dev;
-    std::mt19937 mt(rnd_dev());
-    std::uniform_int_distribution<uint32_t> dist(
-        1, std::numeric_limits<uint32_t>::max());
-    for (unsigned int i = 0; i < seed.size(); ++i) {
-      seed[i] = dist(mt);
-    }
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, stateTexture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER,
-                 GL_UNSIGNED_INT, seed.data());
+                 GL_UNSIGNED_INT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    // setup moments texture
+    glGenTextures(1, &momentsTexture);
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, momentsTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA,
+                 GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    // setup blue noise texture
+    glGenTextures(1, &blueNoiseTexture);
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, blueNoiseTexture);
+    const std::vector<float> blue_noise =
+        BlueNoise::load(Shader::cache_directory);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, BlueNoise::SIZE, BlueNoise::SIZE,
+                 0, GL_RED, GL_FLOAT, blue_noise.data());
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
 
     // setup accumulate FBO
     glGenFramebuffers(1, &accumFBO);
@@ -116,8 +728,102 @@ class Renderer {
                            accumTexture, 0);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
                            stateTexture, 0);
-    GLuint attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
-    glDrawBuffers(2, attachments);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D,
+                           momentsTexture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // setup path state textures
+    glGenTextures(1, &pathOriginTexture);
+    setupFloatTexture(pathOriginTexture, width, height);
+    glGenTextures(1, &pathDirectionTexture);
+    setupFloatTexture(pathDirectionTexture, width, height);
+    glGenTextures(1, &pathThroughputTexture);
+    setupFloatTexture(pathThroughputTexture, width, height);
+
+    // setup wavefront FBO, accumFBO with path state
+    glGenFramebuffers(1, &wavefrontFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, wavefrontFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           accumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                           stateTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D,
+                           momentsTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D,
+                           pathOriginTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D,
+                           pathDirectionTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT5, GL_TEXTURE_2D,
+                           pathThroughputTexture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    setupDrawBuffers();
+    clearRNGState();
+
+    // setup sums of samples
+    glGenTextures(1, &sampleSumTexture);
+    glGenBuffers(2, sampleSumPBO);
+    setupSampleSum();
+    glGenFramebuffers(1, &sampleSumFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, sampleSumFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           sampleSumTexture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // setup G-buffer
+    // primitive id is last attachment, integer so every id is exact
+    const GLenum gbuffer_attachments[5] = {
+        GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2,
+        GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4};
+    for (int i = 0; i < 2; ++i) {
+      GLuint* textures[5] = {&gbufferPositionTexture[i],
+                             &gbufferNormalTexture[i],
+                             &gbufferAlbedoTexture[i], &gbufferUVTexture[i],
+                             &gbufferPrimitiveTexture[i]};
+      glGenFramebuffers(1, &gbufferFBO[i]);
+      for (int j = 0; j < 5; ++j) {
+        glGenTextures(1, textures[j]);
+        if (j < 4) {
+          setupFloatTexture(*textures[j], width, height);
+        } else {
+          setupUintTexture(*textures[j], width, height);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, gbuffer_attachments[j],
+                               GL_TEXTURE_2D, *textures[j], 0);
+      }
+      glDrawBuffers(5, gbuffer_attachments);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // setup reprojection textures
+    glGenTextures(1, &historyAccumTexture);
+    setupFloatTexture(historyAccumTexture, width, height);
+    glGenTextures(1, &historyMomentsTexture);
+    setupFloatTexture(historyMomentsTexture, width, height);
+
+    glGenFramebuffers(1, &reprojectFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, reprojectFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           historyAccumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                           historyMomentsTexture, 0);
+    const GLenum reproject_attachments[2] = {GL_COLOR_ATTACHMENT0,
+                                             GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, reproject_attachments);
+
+    // attachment is set at each copy
+    glGenFramebuffers(1, &copyFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // setup denoise textures
+    for (int i = 0; i < 2; ++i) {
+      glGenTextures(1, &denoiseTexture[i]);
+      setupFloatTexture(denoiseTexture[i], width, height);
+      glGenFramebuffers(1, &denoiseFBO[i]);
+      glBindFramebuffer(GL_FRAMEBUFFER, denoiseFBO[i]);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, denoiseTexture[i], 0);
+    }
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // setup UBO
@@ -139,73 +845,301 @@ class Renderer {
                  GL_DYNAMIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, globalUBO);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 1, cameraUBO);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 2, sceneUBO);
+    GLState::get().bindUniformBuffer(0, globalUBO);
+    GLState::get().bindUniformBuffer(1, cameraUBO);
+    GLState::get().bindUniformBuffer(2, sceneUBO);
+
+    // setup texture buffers
+    // records and BVHNode are read as RGBA32I texels, floats are
+    // reinterpreted by intBitsToFloat
+    createTextureBuffer(sphereBuffer, sphereTexture, GL_RGBA32I);
+    createTextureBuffer(planeBuffer, planeTexture, GL_RGBA32I);
+    createTextureBuffer(bvhNodeBuffer, bvhNodeTexture, GL_RGBA32I);
+    createTextureBuffer(bvhIndexBuffer, bvhIndexTexture, GL_R32I);
+    createTextureBuffer(vertexBuffer, vertexTexture, GL_RGBA32F);
+    createTextureBuffer(normalBuffer, normalTexture, GL_RGBA32F);
+    createTextureBuffer(triangleBuffer, triangleTexture, GL_RGBA32I);
+    createTextureBuffer(lightCDFBuffer, lightCDFTexture, GL_R32F);
+    uploadScene();
 
     // set uniforms
     pt_shader.setUniformTexture("accumTexture", accumTexture, 0);
     pt_shader.setUniformTexture("stateTexture", stateTexture, 1);
-    pt_shader.setUBO("GlobalBlock", 0);
-    pt_shader.setUBO("CameraBlock", 1);
-    pt_shader.setUBO("SceneBlock", 2);
+    pt_shader.setUniformTexture("momentsTexture", momentsTexture, 9);
+    pt_shader.setUniform("samplesPerPass",
+                         static_cast<GLint>(samples_per_pass));
+    setAdaptiveUniforms(pt_shader);
+    setSamplerUniforms(pt_shader);
+    setSceneUniforms(pt_shader);
 
     pt_nee_shader.setUniformTexture("accumTexture", accumTexture, 0);
     pt_nee_shader.setUniformTexture("stateTexture", stateTexture, 1);
-    pt_nee_shader.setUBO("GlobalBlock", 0);
-    pt_nee_shader.setUBO("CameraBlock", 1);
-    pt_nee_shader.setUBO("SceneBlock", 2);
+    pt_nee_shader.setUniformTexture("momentsTexture", momentsTexture, 9);
+    pt_nee_shader.setUniform("samplesPerPass",
+                             static_cast<GLint>(samples_per_pass));
+    setAdaptiveUniforms(pt_nee_shader);
+    setSamplerUniforms(pt_nee_shader);
+    setSceneUniforms(pt_nee_shader);
+
+    wavefront_shader.setUniformTexture("accumTexture", accumTexture, 0);
+    wavefront_shader.setUniformTexture("stateTexture", stateTexture, 1);
+    wavefront_shader.setUniformTexture("momentsTexture", momentsTexture, 9);
+    wavefront_shader.setUniformTexture("pathOriginTexture", pathOriginTexture,
+                                       10);
+    wavefront_shader.setUniformTexture("pathDirectionTexture",
+                                       pathDirectionTexture, 11);
+    wavefront_shader.setUniformTexture("pathThroughputTexture",
+                                       pathThroughputTexture, 12);
+    setAdaptiveUniforms(wavefront_shader);
+    setSamplerUniforms(wavefront_shader);
+    setSceneUniforms(wavefront_shader);
 
     bdpt_shader.setUniformTexture("accumTexture", accumTexture, 0);
     bdpt_shader.setUniformTexture("stateTexture", stateTexture, 1);
-    bdpt_shader.setUBO("GlobalBlock", 0);
-    bdpt_shader.setUBO("CameraBlock", 1);
-    bdpt_shader.setUBO("SceneBlock", 2);
+    setSceneUniforms(bdpt_shader);
+    setMaxDepthUniforms();
 
     output_shader.setUniformTexture("accumTexture", accumTexture, 0);
+    output_shader.setUniformTexture("momentsTexture", momentsTexture, 9);
+
+    convergence_shader.setUniformTexture("momentsTexture", momentsTexture, 9);
+    setAdaptiveUniforms(convergence_shader);
 
-    normal_shader.setUBO("GlobalBlock", 0);
-    normal_shader.setUBO("CameraBlock", 1);
-    normal_shader.setUBO("SceneBlock", 2);
+    setSceneUniforms(gbuffer_shader);
 
-    depth_shader.setUBO("GlobalBlock", 0);
-    depth_shader.setUBO("CameraBlock", 1);
-    depth_shader.setUBO("SceneBlock", 2);
+    reproject_shader.setUniformTexture("accumTexture", accumTexture, 0);
+    reproject_shader.setUniformTexture("momentsTexture", momentsTexture, 9);
+    reproject_shader.setUniform("maxHistory", max_history);
+    setSceneUniforms(reproject_shader);
 
-    albedo_shader.setUBO("GlobalBlock", 0);
-    albedo_shader.setUBO("CameraBlock", 1);
-    albedo_shader.setUBO("SceneBlock", 2);
+    // units above 15 are used by G-buffer and denoiser, GL 3.3 has at least
+    // 48 combined units while a stage samples at most 16 of them
+    denoise_input_shader.setUniformTexture("accumTexture", accumTexture, 0);
+    denoise_input_shader.setUniformTexture("momentsTexture", momentsTexture,
+                                           9);
+    sample_sum_shader.setUniformTexture("momentsTexture", momentsTexture, 9);
+    output_shader.setUniform("denoise", GLint(0));
 
-    uv_shader.setUBO("GlobalBlock", 0);
-    uv_shader.setUBO("CameraBlock", 1);
-    uv_shader.setUBO("SceneBlock", 2);
+    // clear textures
+    clear();
   }
 
   void destroy() {
+    exporter.destroy();
+    frame_exporter.destroy();
+
     glDeleteTextures(1, &accumTexture);
     glDeleteTextures(1, &stateTexture);
+    glDeleteTextures(1, &momentsTexture);
 
     glDeleteFramebuffers(1, &accumFBO);
 
+    glDeleteTextures(1, &pathOriginTexture);
+    glDeleteTextures(1, &pathDirectionTexture);
+    glDeleteTextures(1, &pathThroughputTexture);
+    glDeleteFramebuffers(1, &wavefrontFBO);
+
+    cancelSampleSums();
+    glDeleteTextures(1, &sampleSumTexture);
+    glDeleteFramebuffers(1, &sampleSumFBO);
+    glDeleteBuffers(2, sampleSumPBO);
+
+    glDeleteTextures(1, &blueNoiseTexture);
+
+    glDeleteTextures(2, gbufferPositionTexture);
+    glDeleteTextures(2, gbufferNormalTexture);
+    glDeleteTextures(2, gbufferAlbedoTexture);
+    glDeleteTextures(2, gbufferUVTexture);
+    glDeleteTextures(2, gbufferPrimitiveTexture);
+    glDeleteFramebuffers(2, gbufferFBO);
+    glDeleteTextures(1, &historyAccumTexture);
+    glDeleteTextures(1, &historyMomentsTexture);
+    glDeleteFramebuffers(1, &reprojectFBO);
+    glDeleteFramebuffers(1, &copyFBO);
+
+    glDeleteTextures(2, denoiseTexture);
+    glDeleteFramebuffers(2, denoiseFBO);
+
     glDeleteBuffers(1, &globalUBO);
     glDeleteBuffers(1, &cameraUBO);
     glDeleteBuffers(1, &sceneUBO);
 
+    glDeleteTextures(1, &sphereTexture);
+    glDeleteBuffers(1, &sphereBuffer);
+    glDeleteTextures(1, &planeTexture);
+    glDeleteBuffers(1, &planeBuffer);
+    glDeleteTextures(1, &bvhNodeTexture);
+    glDeleteBuffers(1, &bvhNodeBuffer);
+    glDeleteTextures(1, &bvhIndexTexture);
+    glDeleteBuffers(1, &bvhIndexBuffer);
+    glDeleteTextures(1, &vertexTexture);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteTextures(1, &normalTexture);
+    glDeleteBuffers(1, &normalBuffer);
+    glDeleteTextures(1, &triangleTexture);
+    glDeleteBuffers(1, &triangleBuffer);
+    glDeleteTextures(1, &lightCDFTexture);
+    glDeleteBuffers(1, &lightCDFBuffer);
+
     pt_shader.destroy();
     pt_nee_shader.destroy();
+    wavefront_shader.destroy();
     bdpt_shader.destroy();
     output_shader.destroy();
     normal_shader.destroy();
     depth_shader.destroy();
     albedo_shader.destroy();
     uv_shader.destroy();
+    convergence_shader.destroy();
+    gbuffer_shader.destroy();
+    reproject_shader.destroy();
+    denoise_input_shader.destroy();
+    atrous_shader.destroy();
+    sample_sum_shader.destroy();
 
     rectangle.destroy();
+
+    profiler.destroy();
+
+    // deleted names may be reused
+    GLState::get().invalidate();
   }
 
   unsigned int getWidth() const { return global.resolution.x; }
   unsigned int getHeight() const { return global.resolution.y; }
-  unsigned int getSamples() const { return samples; }
+  // number of samples every pixel has at least
+  // wavefront paths finish at different passes, mean after previous pass is
+  // returned instead
+  unsigned int getSamples() const {
+    return integrator == Integrator::Wavefront ? wavefront_samples
+                                               : tiles.getMinSamples();
+  }
+
+  // number of bounces per pass in wavefront mode
+  unsigned int getSamplesPerPass() const { return samples_per_pass; }
+  void setSamplesPerPass(unsigned int samples_per_pass) {
+    if (samples_per_pass == this->samples_per_pass) return;
+    this->samples_per_pass = samples_per_pass;
+    pt_shader.setUniform("samplesPerPass",
+                         static_cast<GLint>(samples_per_pass));
+    pt_nee_shader.setUniform("samplesPerPass",
+                             static_cast<GLint>(samples_per_pass));
+  }
+
+  // tile_size 0 renders whole image in one pass
+  // accumulation is kept, pixels are normalized by their own number of
+  // samples in momentsTexture
+  unsigned int getTileSize() const {
+    return tiles.getTileCount() > 1 ? tiles.getTileSize().x : 0;
+  }
+  void setTileSize(unsigned int tile_size) {
+    if (tile_size == getTileSize()) return;
+    tiles.retile(tile_size);
+  }
+  unsigned int getTileCount() const { return tiles.getTileCount(); }
+
+  unsigned int getTilesPerPass() const { return tiles_per_pass; }
+  void setTilesPerPass(unsigned int tiles_per_pass) {
+    this->tiles_per_pass = std::max(tiles_per_pass, 1u);
+  }
+
+  // pixels stop sampling when relative error of luminance is below
+  // threshold, 0 disables adaptive sampling
+  float getAdaptiveThreshold() const { return adaptive_threshold; }
+  void setAdaptiveThreshold(float threshold) {
+    adaptive_threshold = threshold;
+    setAdaptiveUniforms(pt_shader);
+    setAdaptiveUniforms(pt_nee_shader);
+    setAdaptiveUniforms(wavefront_shader);
+    setAdaptiveUniforms(convergence_shader);
+  }
+  unsigned int getAdaptiveMinSamples() const { return adaptive_min_samples; }
+  void setAdaptiveMinSamples(unsigned int min_samples) {
+    adaptive_min_samples = min_samples;
+    setAdaptiveUniforms(pt_shader);
+    setAdaptiveUniforms(pt_nee_shader);
+    setAdaptiveUniforms(wavefront_shader);
+    setAdaptiveUniforms(convergence_shader);
+  }
+
+  SamplerType getSamplerType() const { return sampler_type; }
+  void setSamplerType(const SamplerType& sampler_type) {
+    this->sampler_type = sampler_type;
+    setSamplerUniforms(pt_shader);
+    setSamplerUniforms(pt_nee_shader);
+    setSamplerUniforms(wavefront_shader);
+    setupDrawBuffers();
+    clear();
+  }
+
+  // image is reproducible from seed and number of samples, except for
+  // xorshift32 which depends on pass history
+  unsigned int getSeed() const { return seed; }
+  void setSeed(unsigned int seed) {
+    this->seed = seed;
+    setSamplerUniforms(pt_shader);
+    setSamplerUniforms(pt_nee_shader);
+    setSamplerUniforms(wavefront_shader);
+    clearRNGState();
+    clear();
+  }
+
+  bool getDenoise() const { return denoise; }
+  void setDenoise(bool denoise) {
+    this->denoise = denoise;
+    output_shader.setUniform("denoise", GLint(denoise));
+  }
+  unsigned int getDenoiseIterations() const { return denoise_iterations; }
+  void setDenoiseIterations(unsigned int denoise_iterations) {
+    this->denoise_iterations = denoise_iterations;
+  }
+
+  bool getShaderSpecialization() const { return specialize_shaders; }
+  void setShaderSpecialization(bool specialize_shaders) {
+    this->specialize_shaders = specialize_shaders;
+    updateShaderDefines();
+    clear();
+  }
+  // max number of bounces
+  unsigned int getMaxDepth() const { return max_depth; }
+  void setMaxDepth(unsigned int max_depth) {
+    max_depth = std::max(max_depth, 1u);
+    if (max_depth == this->max_depth) return;
+    this->max_depth = max_depth;
+    setMaxDepthUniforms();
+    updateShaderDefines();
+    clear();
+  }
+
+  // off by default, counting costs every interactive pass
+  bool getRayCounting() const { return count_rays; }
+  void setRayCounting(bool count_rays) {
+    this->count_rays = count_rays;
+    updateShaderDefines();
+    clear();
+  }
+
+  bool getPrimaryCache() const { return primary_cache; }
+  void setPrimaryCache(bool primary_cache) {
+    this->primary_cache = primary_cache;
+    pt_shader.setUniform("primaryCache", GLint(primary_cache));
+    pt_nee_shader.setUniform("primaryCache", GLint(primary_cache));
+    clear();
+  }
+
+  bool getReprojection() const { return reprojection; }
+  void setReprojection(bool reprojection) {
+    this->reprojection = reprojection;
+    clear();
+  }
+  // samples per pixel kept on reprojection
+  float getMaxHistory() const { return max_history; }
+  void setMaxHistory(float max_history) {
+    this->max_history = max_history;
+    reproject_shader.setUniform("maxHistory", max_history);
+  }
+
+  Profiler& getProfiler() { return profiler; }
 
   glm::vec3 getCameraPosition() const { return camera.params.camPos; }
   float getCameraFOV() const { return camera.fov; }
@@ -231,6 +1165,47 @@ class Renderer {
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
     clear_flag = true;
   }
+  void lookAtCamera(const glm::vec3& camPos, const glm::vec3& lookat) {
+    camera.lookAt(camPos, lookat);
+    glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &camera.params);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    clear_flag = true;
+  }
+
+  // orbit around pivot, camera turns to look at it
+  void setOrbitPivot(const glm::vec3& pivot) {
+    lookAtCamera(camera.params.camPos, pivot);
+  }
+
+  // ray through pixel (x, y) from top left, same as pixel center of
+  // rayGen() in raygen.frag
+  RayQuery::Ray getCameraRay(float x, float y) const {
+    // gl_FragCoord is from bottom left
+    const glm::vec2 fragCoord(x, global.resolution.y - y);
+    glm::vec2 uv = (2.0f * fragCoord - glm::vec2(global.resolution)) *
+                   global.resolutionYInv;
+    uv.y = -uv.y;
+
+    RayQuery::Ray ray;
+    ray.origin = camera.params.camPos;
+    ray.direction = camera.getRayDirection(uv);
+    return ray;
+  }
+
+  // surface under pixel (x, y) from top left, traced on CPU
+  RayQuery::Hit pick(float x, float y) const {
+    return ray_query.closestHit(getCameraRay(x, y));
+  }
+
+  // distance to surface at center of view, -1 when nothing is hit
+  float getCenterDistance() const {
+    const RayQuery::Hit hit =
+        pick(0.5f * global.resolution.x, 0.5f * global.resolution.y);
+    return hit.hit() ? hit.t : -1.0f;
+  }
+
+  const RayQuery& getRayQuery() const { return ray_query; }
 
   RenderMode getRenderMode() const { return mode; }
   void setRenderMode(const RenderMode& mode) {
@@ -247,45 +1222,163 @@ class Renderer {
   SceneType getSceneType() const { return scene_type; }
   void setSceneType(const SceneType& scene_type) {
     this->scene_type = scene_type;
+    static const char* names[] = {"original", "sphere", "indirect"};
+    scene_name = names[static_cast<int>(scene_type)];
 
     // recreate scene
     scene.setScene(scene_type);
 
     // send scene data
-    glBindBuffer(GL_UNIFORM_BUFFER, sceneUBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SceneBlock), &scene.block);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    uploadScene();
 
     clear();
   }
 
-  void render() {
-    if (clear_flag) {
-      clear();
-      clear_flag = false;
+  const Scene& getScene() const { return scene; }
+  const std::string& getSceneName() const { return scene_name; }
+
+  // edit material or primitive, accumulation is restarted only when scene
+  // is changed
+  void setMaterial(int material_id, const Material& material) {
+    if (!scene.setMaterial(material_id, material)) return;
+    uploadSceneEdits();
+    clear();
+  }
+  void setPrimitive(int primID, const Primitive& primitive) {
+    if (!scene.setPrimitive(primID, primitive)) return;
+    uploadSceneEdits();
+    clear();
+  }
+  size_t getSceneEditUploadBytes() const { return scene_edit_upload_bytes; }
+
+  // load text scene or compiled scene, see Scene::loadText()
+  // scene is kept when file is invalid
+  bool loadScene(const std::string& filepath) {
+    Scene loaded;
+    if (SceneBinary::isSceneBinary(filepath)) {
+      SceneBinary binary;
+      if (!binary.open(filepath) || !loaded.loadBinary(binary)) return false;
+      scene = std::move(loaded);
+      uploadScene(binary);
+    } else {
+      if (!loaded.loadText(filepath)) return false;
+      scene = std::move(loaded);
+      uploadScene();
     }
+    scene_name = filepath;
+
+    clear();
+    return true;
+  }
+  // write compiled scene, loaded by loadScene() without building BVH
+  bool saveScene(const std::string& filepath) const {
+    return scene.saveBinary(filepath);
+  }
+
+  // add triangle mesh to scene, kept when scene type is changed
+  bool loadOBJ(const std::string& filepath, const Material& material,
+               float scale = 1.0f, const glm::vec3& offset = glm::vec3(0)) {
+    if (!scene.loadOBJ(filepath, material, scale, offset)) return false;
+
+    // send scene data
+    uploadScene();
+
+    clear();
+    return true;
+  }
+
+  // add samples_per_pass samples per pixel on tiles_per_pass tiles of
+  // accumTexture
+  void accumulate() {
+    updateCamera();
+
+    glViewport(0, 0, global.resolution.x, global.resolution.y);
+
+    const std::string pass_name = getIntegratorName(integrator);
+    profiler.beginCPU(pass_name);
+    profiler.beginGPU(pass_name);
+
+    if (integrator == Integrator::Wavefront) {
+      accumulateWavefront();
+
+      profiler.endGPU(pass_name);
+      profiler.endCPU(pass_name);
+      return;
+    }
+
+    // each tile is a scissored draw, tile is not drawn twice in a pass
+    const unsigned int n_tiles =
+        std::min(tiles_per_pass, tiles.getTileCount());
+    glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
+    // tiles of a pass are disjoint, only previous pass is waited for
+    textureBarrier();
+    glEnable(GL_SCISSOR_TEST);
+    for (unsigned int i = 0; i < n_tiles; ++i) {
+      const unsigned int index = tiles.next();
+      const TileScheduler::Tile tile = tiles.getTile(index);
+      glScissor(tile.offset.x, tile.offset.y, tile.size.x, tile.size.y);
+
+      switch (integrator) {
+        case Integrator::PT:
+          rectangle.draw(pt_shader);
+          break;
+        case Integrator::PTNEE:
+          rectangle.draw(pt_nee_shader);
+          break;
+        case Integrator::Wavefront:
+          // drawn by accumulateWavefront()
+          break;
+      }
+
+      // update samples
+      tiles.addSamples(index, samples_per_pass);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    profiler.endGPU(pass_name);
+    profiler.endCPU(pass_name);
+  }
+
+  // advance paths samples_per_pass bounces on tiles_per_pass tiles
+  // terminated paths are regenerated in the same draw
+  void accumulateWavefront() {
+    const unsigned int n_tiles =
+        std::min(tiles_per_pass, tiles.getTileCount());
+    glBindFramebuffer(GL_FRAMEBUFFER, wavefrontFBO);
+    glEnable(GL_SCISSOR_TEST);
+    for (unsigned int i = 0; i < n_tiles; ++i) {
+      const TileScheduler::Tile tile = tiles.getTile(tiles.next());
+      glScissor(tile.offset.x, tile.offset.y, tile.size.x, tile.size.y);
+      // each bounce continues from path state written by previous one
+      for (unsigned int k = 0; k < samples_per_pass; ++k) {
+        textureBarrier();
+        rectangle.draw(wavefront_shader);
+      }
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // count of previous pass, read while this pass is queued
+    startSampleSum();
+    readSampleSum();
+  }
+
+  void render() {
+    updateCamera();
 
     glViewport(0, 0, global.resolution.x, global.resolution.y);
 
     switch (mode) {
       case RenderMode::Render:
-        glBindFramebuffer(GL_FRAMEBUFFER, accumFBO);
-        switch (integrator) {
-          case Integrator::PT:
-            rectangle.draw(pt_shader);
-            break;
-          case Integrator::PTNEE:
-            rectangle.draw(pt_nee_shader);
-            break;
-        }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        accumulate();
 
-        // update samples
-        samples++;
+        if (denoise) applyDenoise();
 
         // output
-        output_shader.setUniform("samplesInv", 1.0f / samples);
+        profiler.beginGPU("output");
         rectangle.draw(output_shader);
+        profiler.endGPU("output");
         break;
 
       case RenderMode::Normal:
@@ -303,25 +1396,291 @@ class Renderer {
       case RenderMode::UV:
         rectangle.draw(uv_shader);
         break;
+
+      case RenderMode::Convergence:
+        accumulate();
+        rectangle.draw(convergence_shader);
+        break;
+    }
+  }
+
+  // read back accumTexture divided by number of samples of each pixel
+  Image getImage() const {
+    const std::vector<GLfloat> accum = readTexture(accumTexture);
+    const std::vector<GLfloat> moments = readTexture(momentsTexture);
+
+    Image image(global.resolution.x, global.resolution.y);
+    for (unsigned int i = 0; i < image.width * image.height; ++i) {
+      const float n = moments[4 * i + 2];
+      const float samplesInv = n > 0 ? 1.0f / n : 0.0f;
+      image.pixels[3 * i + 0] = accum[4 * i + 0] * samplesInv;
+      image.pixels[3 * i + 1] = accum[4 * i + 1] * samplesInv;
+      image.pixels[3 * i + 2] = accum[4 * i + 2] * samplesInv;
+    }
+    return image;
+  }
+
+  // same image as getImage() without waiting for GPU, see ImageExporter
+  // false when previous exports are still being copied, try again later
+  bool exportImage(const std::string& filepath) {
+    return exporter.request(accumTexture, momentsTexture, global.resolution.x,
+                            global.resolution.y, filepath);
+  }
+  // call once per frame to hand finished copies to encoder or publisher
+  void pollExports() {
+    exporter.poll();
+    frame_exporter.poll();
+  }
+  // wait until every export is written
+  void finishExports() { exporter.finish(); }
+  unsigned int getPendingExports() const {
+    return exporter.getPendingCount();
+  }
+
+  // copy current image to shared memory without waiting for GPU
+  // publisher is used on worker thread of exporter until finishFrames()
+  // false when previous frames are still being copied, skip this frame
+  bool publishFrame(FramePublisher& publisher) {
+    SharedFrameInfo info = {};
+    info.samples = getSamples();
+    for (int k = 0; k < 3; ++k) {
+      info.camera_position[k] = camera.params.camPos[k];
+      info.camera_forward[k] = camera.params.camForward[k];
+      info.camera_up[k] = camera.params.camUp[k];
+    }
+    info.camera_fov = camera.fov;
+    std::strncpy(info.scene, scene_name.c_str(), sizeof(info.scene) - 1);
+
+    return frame_exporter.request(
+        accumTexture, momentsTexture, global.resolution.x, global.resolution.y,
+        [&publisher, info](const Image& image) {
+          return publisher.publish(image, info);
+        });
+  }
+  // wait until every published frame is copied
+  void finishFrames() { frame_exporter.finish(); }
+
+  // ratio of pixels which stopped sampling
+  float getConvergedRatio() const {
+    if (adaptive_threshold <= 0) return 0;
+
+    const std::vector<GLfloat> moments = readTexture(momentsTexture);
+    const unsigned int n_pixels = global.resolution.x * global.resolution.y;
+    unsigned int n_converged = 0;
+    for (unsigned int i = 0; i < n_pixels; ++i) {
+      // same as relativeError() in adaptive.frag
+      const float n = moments[4 * i + 2];
+      if (n < 2 || n < adaptive_min_samples) continue;
+      const float mean = moments[4 * i] / n;
+      const float variance = std::max(moments[4 * i + 1] / n - mean * mean,
+                                      0.0f) *
+                             n / (n - 1);
+      if (std::sqrt(variance / n) / std::max(mean, 1e-3f) <
+          adaptive_threshold) {
+        n_converged++;
+      }
+    }
+    return static_cast<float>(n_converged) / n_pixels;
+  }
+
+  // total number of rays traced since last clear, 0 without setRayCounting()
+  // accumTexture alpha holds number of rays of each pixel, exact while each
+  // pixel has less than 2^24 rays
+  double getRays() const {
+    const std::vector<GLfloat> data = readTexture(accumTexture);
+
+    double rays = 0;
+    for (unsigned int i = 3; i < data.size(); i += 4) {
+      rays += data[i];
     }
+    return rays;
+  }
+
+  // write accumulation, RNG state and samples of tiles with settings which
+  // must match to resume, see Checkpoint
+  bool saveCheckpoint(const std::string& filepath) const {
+    using namespace CheckpointFormat;
+    Header header = {};
+    header.width = global.resolution.x;
+    header.height = global.resolution.y;
+    header.integrator = static_cast<std::uint32_t>(integrator);
+    header.sampler_type = static_cast<std::uint32_t>(sampler_type);
+    header.seed = seed;
+    header.max_depth = max_depth;
+    header.scene_hash = scene.computeHash();
+    for (int k = 0; k < 3; ++k) {
+      header.camera_position[k] = camera.params.camPos[k];
+      header.camera_forward[k] = camera.params.camForward[k];
+      header.camera_right[k] = camera.params.camRight[k];
+      header.camera_up[k] = camera.params.camUp[k];
+    }
+    header.camera_fov = camera.fov;
+    header.tile_size = getTileSize();
+    header.tile_cursor = tiles.getCursor();
+    header.wavefront_samples = wavefront_samples;
+    header.samples = getSamples();
+    std::strncpy(header.scene_name, scene_name.c_str(),
+                 sizeof(header.scene_name) - 1);
+
+    const std::vector<GLfloat> accum = readTexture(accumTexture);
+    const std::vector<GLfloat> moments = readTexture(momentsTexture);
+    std::vector<GLuint> state(global.resolution.x * global.resolution.y);
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, stateTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                  state.data());
+    // paths in flight are only kept by wavefront
+    std::vector<GLfloat> path_origin, path_direction, path_throughput;
+    if (integrator == Integrator::Wavefront) {
+      path_origin = readTexture(pathOriginTexture);
+      path_direction = readTexture(pathDirectionTexture);
+      path_throughput = readTexture(pathThroughputTexture);
+    }
+    const std::vector<float>& tile_samples = tiles.getSamples();
+
+    const auto rgba = [](const std::vector<GLfloat>& v) {
+      return CheckpointPlane{v.data(), sizeof(GLfloat) * v.size(),
+                             4 * sizeof(GLfloat)};
+    };
+    // same order as CheckpointFormat::Plane
+    const std::vector<CheckpointPlane> planes = {
+        rgba(accum),
+        rgba(moments),
+        {state.data(), sizeof(GLuint) * state.size(), sizeof(GLuint)},
+        rgba(path_origin),
+        rgba(path_direction),
+        rgba(path_throughput),
+        {tile_samples.data(), sizeof(float) * tile_samples.size(),
+         sizeof(float)},
+    };
+    if (!Checkpoint::write(filepath, header, planes)) {
+      std::cerr << "failed to write " << filepath << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // continue accumulation of checkpoint, textures are uploaded from mapping
+  // refused when resolution, scene, camera or integrator settings differ
+  bool loadCheckpoint(const std::string& filepath) {
+    using namespace CheckpointFormat;
+    Checkpoint checkpoint;
+    if (!checkpoint.open(filepath)) return false;
+    const Header& header = checkpoint.getHeader();
+
+    if (header.width != global.resolution.x ||
+        header.height != global.resolution.y) {
+      std::cerr << "checkpoint resolution " << header.width << "x"
+                << header.height << " differs from " << global.resolution.x
+                << "x" << global.resolution.y << std::endl;
+      return false;
+    }
+    if (header.scene_hash != scene.computeHash()) {
+      std::cerr << "checkpoint scene " << header.scene_name
+                << " differs from current scene " << scene_name << std::endl;
+      return false;
+    }
+    const auto same = [](const float* a, const glm::vec3& b) {
+      for (int k = 0; k < 3; ++k) {
+        if (std::abs(a[k] - b[k]) > 1e-4f * std::max(std::abs(b[k]), 1.0f)) {
+          return false;
+        }
+      }
+      return true;
+    };
+    if (!same(header.camera_position, camera.params.camPos) ||
+        !same(header.camera_forward, camera.params.camForward) ||
+        !same(header.camera_right, camera.params.camRight) ||
+        !same(header.camera_up, camera.params.camUp) ||
+        std::abs(header.camera_fov - camera.fov) > 1e-5f) {
+      std::cerr << "checkpoint camera differs from current camera"
+                << std::endl;
+      return false;
+    }
+    if (header.integrator != static_cast<std::uint32_t>(integrator) ||
+        header.sampler_type != static_cast<std::uint32_t>(sampler_type) ||
+        header.seed != seed || header.max_depth != max_depth) {
+      std::cerr << "checkpoint integrator, sampler, seed or max depth "
+                   "differs from current settings"
+                << std::endl;
+      return false;
+    }
+
+    const size_t n_pixels = global.resolution.x * global.resolution.y;
+    const size_t n_path_pixels =
+        integrator == Integrator::Wavefront ? n_pixels : 0;
+    const auto valid = [&](Plane plane, size_t element_size, size_t count) {
+      const CheckpointPlane& p = checkpoint.getPlane(plane);
+      return p.element_size == element_size && p.count() == count;
+    };
+    const CheckpointPlane& samples_plane = checkpoint.getPlane(TILE_SAMPLES);
+    TileScheduler restored(global.resolution, header.tile_size);
+    if (!valid(ACCUM, 4 * sizeof(GLfloat), n_pixels) ||
+        !valid(MOMENTS, 4 * sizeof(GLfloat), n_pixels) ||
+        !valid(RNG_STATE, sizeof(GLuint), n_pixels) ||
+        !valid(PATH_ORIGIN, 4 * sizeof(GLfloat), n_path_pixels) ||
+        !valid(PATH_DIRECTION, 4 * sizeof(GLfloat), n_path_pixels) ||
+        !valid(PATH_THROUGHPUT, 4 * sizeof(GLfloat), n_path_pixels) ||
+        samples_plane.element_size != sizeof(float) ||
+        !restored.restore(
+            std::vector<float>(
+                samples_plane.as<float>(),
+                samples_plane.as<float>() + samples_plane.count()),
+            header.tile_cursor)) {
+      std::cerr << "corrupted checkpoint " << filepath << std::endl;
+      return false;
+    }
+
+    // pending camera change must not clear restored accumulation, G-buffer
+    // of this view is rendered by clear()
+    updateCamera();
+    clear();
+    tiles = restored;
+    wavefront_samples = header.wavefront_samples;
+
+    const auto upload = [&](GLuint texture, Plane plane, GLenum format,
+                            GLenum type) {
+      GLState::get().bindScratchTexture(GL_TEXTURE_2D, texture);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, global.resolution.x,
+                      global.resolution.y, format, type,
+                      checkpoint.getPlane(plane).data);
+    };
+    upload(accumTexture, ACCUM, GL_RGBA, GL_FLOAT);
+    upload(momentsTexture, MOMENTS, GL_RGBA, GL_FLOAT);
+    upload(stateTexture, RNG_STATE, GL_RED_INTEGER, GL_UNSIGNED_INT);
+    if (integrator == Integrator::Wavefront) {
+      upload(pathOriginTexture, PATH_ORIGIN, GL_RGBA, GL_FLOAT);
+      upload(pathDirectionTexture, PATH_DIRECTION, GL_RGBA, GL_FLOAT);
+      upload(pathThroughputTexture, PATH_THROUGHPUT, GL_RGBA, GL_FLOAT);
+      // sums of saved pass, read by next pass as in uninterrupted render
+      startSampleSum();
+    }
+    return true;
   }
 
   void clear() {
-    // clear accumTexture
-    glBindTexture(GL_TEXTURE_2D, accumTexture);
-    std::vector<GLfloat> data(3 * global.resolution.x * global.resolution.y);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, global.resolution.x,
-                    global.resolution.y, GL_RGB, GL_FLOAT, data.data());
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // update texture uniforms
-    pt_shader.setUniformTexture("accumTexture", accumTexture, 0);
-    pt_nee_shader.setUniformTexture("accumTexture", accumTexture, 0);
-    bdpt_shader.setUniformTexture("accumTexture", accumTexture, 0);
-    output_shader.setUniformTexture("accumTexture", accumTexture, 0);
+    profiler.beginCPU("clear");
+    profiler.beginGPU("clear");
+
+    // clear accumTexture and momentsTexture
+    // kill all paths, they are regenerated at next wavefront pass
+    const GLfloat zero[4] = {0, 0, 0, 0};
+    glBindFramebuffer(GL_FRAMEBUFFER, wavefrontFBO);
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 2, zero);
+    glClearBufferfv(GL_COLOR, 5, zero);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // reset samples, restart tiles from the center
+    tiles.reset();
+    wavefront_samples = 0;
+    cancelSampleSums();
+
+    // primary hits of this view
+    glViewport(0, 0, global.resolution.x, global.resolution.y);
+    renderGBuffer();
 
-    // reset samples
-    samples = 0;
+    profiler.endGPU("clear");
+    profiler.endCPU("clear");
   }
 
   void resize(unsigned int width, unsigned int height) {
@@ -332,22 +1691,40 @@ class Renderer {
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
     // resize textures
-    glBindTexture(GL_TEXTURE_2D, accumTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB,
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, accumTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA,
                  GL_FLOAT, 0);
 
-    glBindTexture(GL_TEXTURE_2D, stateTexture);
-    std::vector<uint32_t> seed(width * height);
-    std::random_device rnd_dev;
-    std::mt19937 mt(rnd_dev());
-    std::uniform_int_distribution<uint32_t> dist(
-        1, std::numeric_limits<uint32_t>::max());
-    for (unsigned int i = 0; i < seed.size(); ++i) {
-      seed[i] = dist(mt);
-    }
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, stateTexture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER,
-                 GL_UNSIGNED_INT, seed.data());
-    glBindTexture(GL_TEXTURE_2D, 0);
+                 GL_UNSIGNED_INT, 0);
+
+    GLState::get().bindScratchTexture(GL_TEXTURE_2D, momentsTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA,
+                 GL_FLOAT, 0);
+
+    setupFloatTexture(pathOriginTexture, width, height);
+    setupFloatTexture(pathDirectionTexture, width, height);
+    setupFloatTexture(pathThroughputTexture, width, height);
+    clearRNGState();
+
+    for (int i = 0; i < 2; ++i) {
+      setupFloatTexture(gbufferPositionTexture[i], width, height);
+      setupFloatTexture(gbufferNormalTexture[i], width, height);
+      setupFloatTexture(gbufferAlbedoTexture[i], width, height);
+      setupFloatTexture(gbufferUVTexture[i], width, height);
+      setupUintTexture(gbufferPrimitiveTexture[i], width, height);
+    }
+    setupFloatTexture(historyAccumTexture, width, height);
+    setupFloatTexture(historyMomentsTexture, width, height);
+
+    setupFloatTexture(denoiseTexture[0], width, height);
+    setupFloatTexture(denoiseTexture[1], width, height);
+
+    setupSampleSum();
+
+    // keep tile size
+    tiles.resize(global.resolution, getTileSize());
 
     // clear textures
     clear();
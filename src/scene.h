@@ -1,18 +1,57 @@
 #ifndef _SCENE_H
 #define _SCENE_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "bvh.h"
 #include "glm/glm.hpp"
+#include "obj_loader.h"
+#include "scene_binary.h"
 
-struct alignas(16) Primitive {
-  int id;                                 // 4
-  int type;                               // 8
-  alignas(16) glm::vec3 center;           // 24
-  float radius;                           // 28
-  alignas(16) glm::vec3 leftCornerPoint;  // 44
-  alignas(16) glm::vec3 up;               // 60
-  alignas(16) glm::vec3 right;            // 76
-  int material_id;                        // 80
+// scene description of sphere and plane
+// baked into SphereRecord and PlaneRecord by Scene::init()
+struct Primitive {
+  int id;
+  int type;
+  glm::vec3 center;
+  float radius;
+  glm::vec3 leftCornerPoint;
+  glm::vec3 up;
+  glm::vec3 right;
+  int material_id;
+};
+
+// 32 bytes, uploaded to GPU as two RGBA32I texels
+struct alignas(16) SphereRecord {
+  glm::vec3 center;  // 12
+  float radius2;     // 16
+  float radius;      // 20
+  float radiusInv;   // 24
+  int material_id;   // 28
+};
+
+// 64 bytes, uploaded to GPU as four RGBA32I texels
+// axes are not required to be orthogonal, same as before baking
+struct alignas(16) PlaneRecord {
+  glm::vec3 origin;                // 12
+  int material_id;                 // 16
+  alignas(16) glm::vec3 normal;    // 28
+  alignas(16) glm::vec3 rightDir;  // 44
+  float rightLengthInv;            // 48
+  glm::vec3 upDir;                 // 60
+  float upLengthInv;               // 64
 };
 
 struct alignas(16) Material {
@@ -21,20 +60,66 @@ struct alignas(16) Material {
   alignas(16) glm::vec3 le;  // 36
 };
 
+// emissive sphere or plane, or run of consecutive triangles with the same
+// emissive material (a mesh) sampled by area, see Scene::light_cdf
 struct alignas(16) Light {
-  int primID;
-  alignas(16) glm::vec3 le;
+  int primID;                // 4, first triangle of mesh light
+  int n_triangles;           // 8, 0 for sphere and plane
+  int cdf_offset;            // 12, first entry of mesh light in light_cdf
+  alignas(16) glm::vec3 le;  // 28
 };
 
+// primitives are stored on texture buffers, not in SceneBlock
+// n_primitives counts spheres, planes and triangles
 struct alignas(16) SceneBlock {
   int n_materials;
   int n_primitives;
   int n_lights;
   Material materials[100];
-  Primitive primitives[100];
   Light lights[100];
 };
 
+// byte ranges of GPU data modified since last upload
+struct DirtyRanges {
+  // sorted and disjoint [begin, end)
+  std::vector<std::pair<size_t, size_t>> ranges;
+
+  bool empty() const { return ranges.empty(); }
+  size_t size() const {
+    size_t ret = 0;
+    for (const auto& [begin, end] : ranges) {
+      ret += end - begin;
+    }
+    return ret;
+  }
+
+  // overlapping or adjacent ranges are merged
+  void add(size_t offset, size_t size) {
+    size_t begin = offset;
+    size_t end = offset + size;
+    std::vector<std::pair<size_t, size_t>> merged;
+    for (const auto& range : ranges) {
+      if (range.second < begin || range.first > end) {
+        merged.push_back(range);
+      } else {
+        begin = std::min(begin, range.first);
+        end = std::max(end, range.second);
+      }
+    }
+    merged.emplace_back(begin, end);
+    std::sort(merged.begin(), merged.end());
+    ranges = std::move(merged);
+  }
+  void clear() { ranges.clear(); }
+};
+
+struct Mesh {
+  std::string filepath;
+  Material material;
+  float scale;
+  glm::vec3 offset;
+};
+
 enum class SceneType {
   Original,
   Sphere,
@@ -43,6 +128,12 @@ enum class SceneType {
 
 class Scene {
  private:
+  // record reference of each primitive id, see makePrimitiveRef()
+  std::vector<int> primitive_refs;
+  // bounding box of each primitive id, primitive ids of bvh.indices
+  std::vector<AABB> bboxes;
+  std::vector<int> bvh_primitive_ids;
+
   void setupCornellBoxOriginal() {
     // setup material
     const Material white = createDiffuse(glm::vec3(0.8));
@@ -261,51 +352,360 @@ class Scene {
     addPrimitive(light);
   }
 
+  static AABB computeBBox(const Primitive& primitive) {
+    AABB bbox;
+    switch (primitive.type) {
+      // Sphere
+      case 0:
+        bbox.extend(primitive.center - glm::vec3(primitive.radius));
+        bbox.extend(primitive.center + glm::vec3(primitive.radius));
+        break;
+      // Plane
+      case 1:
+        bbox.extend(primitive.leftCornerPoint);
+        bbox.extend(primitive.leftCornerPoint + primitive.right);
+        bbox.extend(primitive.leftCornerPoint + primitive.up);
+        bbox.extend(primitive.leftCornerPoint + primitive.right +
+                    primitive.up);
+        break;
+    }
+
+    // pad flat boxes of axis aligned planes
+    bbox.pMin -= glm::vec3(BBOX_PADDING);
+    bbox.pMax += glm::vec3(BBOX_PADDING);
+    return bbox;
+  }
+
+  AABB computeBBox(const Triangle& triangle) const {
+    AABB bbox;
+    for (int k = 0; k < 3; ++k) {
+      bbox.extend(glm::vec3(vertices[triangle.vertex[k]]));
+    }
+    bbox.pMin -= glm::vec3(BBOX_PADDING);
+    bbox.pMax += glm::vec3(BBOX_PADDING);
+    return bbox;
+  }
+
+  float triangleArea(const Triangle& triangle) const {
+    const glm::vec3 p0(vertices[triangle.vertex.x]);
+    const glm::vec3 p1(vertices[triangle.vertex.y]);
+    const glm::vec3 p2(vertices[triangle.vertex.z]);
+    return 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+  }
+
+  // collect primitives and triangles with emissive material
+  // callers check countLights() first and reject loads and edits beyond
+  // MAX_N_LIGHTS, lights beyond it are dropped
+  void setupLights() {
+    const int prev_n_lights = block.n_lights;
+
+    int n_lights = 0;
+    const auto add = [&](const Light& light) {
+      if (n_lights < MAX_N_LIGHTS) block.lights[n_lights++] = light;
+    };
+    for (int i = 0; i < n_primitives; ++i) {
+      const Material& material = block.materials[primitives[i].material_id];
+      if (material.le != glm::vec3(0)) {
+        add({primitive_refs[i], 0, 0, material.le});
+      }
+    }
+
+    // cumulative area of each run of emissive triangles, normalized to 1
+    light_cdf.clear();
+    for (size_t begin = 0; begin < triangles.size();) {
+      const int material_id = triangles[begin].material_id;
+      size_t end = begin + 1;
+      while (end < triangles.size() &&
+             triangles[end].material_id == material_id) {
+        end++;
+      }
+
+      const Material& material = block.materials[material_id];
+      if (material.le != glm::vec3(0)) {
+        const size_t cdf_offset = light_cdf.size();
+        float area = 0;
+        for (size_t i = begin; i < end; ++i) {
+          area += triangleArea(triangles[i]);
+          light_cdf.push_back(area);
+        }
+        if (area > 0) {
+          for (size_t i = cdf_offset; i < light_cdf.size(); ++i) {
+            light_cdf[i] /= area;
+          }
+          light_cdf.back() = 1.0f;
+          add({primitive_refs[n_primitives + begin],
+               static_cast<int>(end - begin), static_cast<int>(cdf_offset),
+               material.le});
+        } else {
+          // nothing to sample on degenerate mesh
+          light_cdf.resize(cdf_offset);
+        }
+      }
+      begin = end;
+    }
+    block.n_lights = n_lights;
+    light_cdf_dirty = true;
+
+    markBlockDirty(&block.n_lights, sizeof(block.n_lights));
+    markBlockDirty(block.lights,
+                   sizeof(Light) * std::max(n_lights, prev_n_lights));
+  }
+
+  void markBlockDirty(const void* ptr, size_t size) {
+    const size_t offset = static_cast<const char*>(ptr) -
+                          reinterpret_cast<const char*>(&block);
+    block_dirty.add(offset, size);
+  }
+
+  // bake record of primitive again after it is edited
+  void updateRecord(int primID) {
+    const Primitive& primitive = primitives[primID];
+    const int index =
+        primitive_refs[primID] & ((1 << PRIMITIVE_TYPE_SHIFT) - 1);
+    switch (primitive.type) {
+      // Sphere
+      case 0:
+        spheres[index] = bakeSphere(primitive);
+        spheres_dirty.add(sizeof(SphereRecord) * index, sizeof(SphereRecord));
+        break;
+      // Plane
+      case 1:
+        planes[index] = bakePlane(primitive);
+        planes_dirty.add(sizeof(PlaneRecord) * index, sizeof(PlaneRecord));
+        break;
+    }
+  }
+
+  // refit path from leaf of moved primitive to root, only changed nodes are
+  // marked
+  void refitBVH(int primID) {
+    const auto it = std::find(bvh_primitive_ids.begin(),
+                              bvh_primitive_ids.end(), primID);
+    if (it == bvh_primitive_ids.end()) return;
+    const int position = it - bvh_primitive_ids.begin();
+    for (const int node : bvh.refit(position, bboxes, bvh_primitive_ids)) {
+      bvh_nodes_dirty.add(sizeof(BVHNode) * node, sizeof(BVHNode));
+    }
+  }
+
+  static bool isSameGeometry(const Primitive& p1, const Primitive& p2) {
+    switch (p1.type) {
+      // Sphere
+      case 0:
+        return p1.center == p2.center && p1.radius == p2.radius;
+      // Plane
+      case 1:
+        return p1.leftCornerPoint == p2.leftCornerPoint && p1.up == p2.up &&
+               p1.right == p2.right;
+    }
+    return true;
+  }
+
+  // return false and keep scene when mesh can not be loaded or exceeds
+  // number of materials or lights
+  bool addMesh(const Mesh& mesh) {
+    const size_t n_vertices = vertices.size();
+    const size_t n_normals = normals.size();
+    const size_t n_triangles = triangles.size();
+
+    const int material_id = n_materials;
+    if (!addMaterial(mesh.material)) return false;
+
+    OBJLoader loader(vertices, normals, triangles);
+    bool loaded =
+        loader.load(mesh.filepath, material_id, mesh.scale, mesh.offset);
+    if (loaded && countLights(block.materials) > MAX_N_LIGHTS) {
+      std::cerr << "number of lights exceeds " << MAX_N_LIGHTS << std::endl;
+      loaded = false;
+    }
+    if (!loaded) {
+      // discard partially loaded mesh
+      vertices.resize(n_vertices);
+      normals.resize(n_normals);
+      triangles.resize(n_triangles);
+      n_materials--;
+      return false;
+    }
+    return true;
+  }
+
+  static int makePrimitiveRef(int type, int index) {
+    return (type << PRIMITIVE_TYPE_SHIFT) | index;
+  }
+
+  static SphereRecord bakeSphere(const Primitive& primitive) {
+    SphereRecord ret;
+    ret.center = primitive.center;
+    ret.radius2 = primitive.radius * primitive.radius;
+    ret.radius = primitive.radius;
+    ret.radiusInv = 1.0f / primitive.radius;
+    ret.material_id = primitive.material_id;
+    return ret;
+  }
+
+  static PlaneRecord bakePlane(const Primitive& primitive) {
+    PlaneRecord ret;
+    ret.origin = primitive.leftCornerPoint;
+    ret.material_id = primitive.material_id;
+    ret.normal = glm::normalize(glm::cross(primitive.right, primitive.up));
+    ret.rightDir = glm::normalize(primitive.right);
+    ret.rightLengthInv = 1.0f / glm::length(primitive.right);
+    ret.upDir = glm::normalize(primitive.up);
+    ret.upLengthInv = 1.0f / glm::length(primitive.up);
+    return ret;
+  }
+
   void init() {
     // set primitive id
     for (int i = 0; i < n_primitives; ++i) {
-      block.primitives[i].id = i;
+      primitives[i].id = i;
+    }
+
+    // bake records of each primitive type
+    // primitive reference holds type and index of its record
+    // triangles follow primitives in primitive id
+    std::vector<int>& refs = primitive_refs;
+    refs.resize(n_primitives + triangles.size());
+    spheres.clear();
+    planes.clear();
+    for (int i = 0; i < n_primitives; ++i) {
+      const Primitive& primitive = primitives[i];
+      switch (primitive.type) {
+        // Sphere
+        case 0:
+          refs[i] = makePrimitiveRef(PRIMITIVE_SPHERE, spheres.size());
+          spheres.push_back(bakeSphere(primitive));
+          break;
+        // Plane
+        case 1:
+          refs[i] = makePrimitiveRef(PRIMITIVE_PLANE, planes.size());
+          planes.push_back(bakePlane(primitive));
+          break;
+      }
+    }
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      refs[n_primitives + i] = makePrimitiveRef(PRIMITIVE_TRIANGLE, i);
     }
 
     // set lights
-    int n_lights = 0;
+    setupLights();
+
+    // build BVH
+    bboxes.resize(n_primitives + triangles.size());
     for (int i = 0; i < n_primitives; ++i) {
-      const Primitive& primitive = block.primitives[i];
-      const Material& material = block.materials[primitive.material_id];
-      if (material.le != glm::vec3(0)) {
-        Light light;
-        light.primID = primitive.id;
-        light.le = material.le;
+      bboxes[i] = computeBBox(primitives[i]);
+    }
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      bboxes[n_primitives + i] = computeBBox(triangles[i]);
+    }
+    bvh.build(bboxes);
 
-        block.lights[n_lights] = light;
-        n_lights++;
-      }
+    // BVH leaves refer to records directly, primitive ids are kept for refit
+    bvh_primitive_ids = bvh.indices;
+    for (int& index : bvh.indices) {
+      index = refs[index];
     }
 
-    // set number of materials, primitives, lights
+    // set number of materials, primitives
     block.n_materials = n_materials;
-    block.n_primitives = n_primitives;
-    block.n_lights = n_lights;
+    block.n_primitives = refs.size();
+
+    // everything is uploaded after init()
+    clearDirty();
   }
 
   void clear() {
     n_primitives = 0;
     n_materials = 0;
+    primitives.clear();
+    vertices.clear();
+    normals.clear();
+    triangles.clear();
   }
 
  public:
+  // same as MAX_N_MATERIALS, MAX_N_LIGHTS in uniform.frag
+  static constexpr int MAX_N_MATERIALS = 100;
+  static constexpr int MAX_N_LIGHTS = 100;
+  static constexpr float BBOX_PADDING = 1e-3f;
+
+  // same as PRIMITIVE_* in global.frag
+  static constexpr int PRIMITIVE_TYPE_SHIFT = 28;
+  static constexpr int PRIMITIVE_SPHERE = 0;
+  static constexpr int PRIMITIVE_PLANE = 1;
+  static constexpr int PRIMITIVE_TRIANGLE = 2;
+
+  // lambert, mirror and glass, see brdf.frag
+  static constexpr int N_BRDF_TYPES = 3;
+
   int n_primitives;
   int n_materials;
   SceneBlock block;
+  std::vector<Primitive> primitives;
+  BVH bvh;
+
+  // baked by init()
+  std::vector<SphereRecord> spheres;
+  std::vector<PlaneRecord> planes;
+
+  // triangle meshes, vec4 since RGB32F texture buffer requires GL 4.0
+  std::vector<glm::vec4> vertices;
+  std::vector<glm::vec4> normals;
+  std::vector<Triangle> triangles;
+
+  // area CDF of triangles of each mesh light, baked by init()
+  std::vector<float> light_cdf;
+
+  // meshes are kept when scene type is changed
+  std::vector<Mesh> meshes;
+
+  // modified by edits since last upload, cleared by Renderer
+  DirtyRanges block_dirty;
+  DirtyRanges spheres_dirty;
+  DirtyRanges planes_dirty;
+  DirtyRanges bvh_nodes_dirty;
+  // light_cdf changed size, uploaded whole
+  bool light_cdf_dirty = false;
+
+  // number of lights setupLights() makes with materials, material of
+  // primitive primID can be replaced to count lights of an edit
+  // upper bound, degenerate meshes are not counted by setupLights()
+  int countLights(const Material* materials, int primID = -1,
+                  int material_id = -1) const {
+    const auto is_emissive = [&](int id) {
+      return materials[id].le != glm::vec3(0);
+    };
+    int count = 0;
+    for (int i = 0; i < n_primitives; ++i) {
+      if (is_emissive(i == primID ? material_id : primitives[i].material_id)) {
+        count++;
+      }
+    }
+    // one light per run of triangles
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      const int id = triangles[i].material_id;
+      if (is_emissive(id) && (i == 0 || triangles[i - 1].material_id != id)) {
+        count++;
+      }
+    }
+    return count;
+  }
 
   void addPrimitive(const Primitive& primitive) {
-    block.primitives[n_primitives] = primitive;
+    primitives.push_back(primitive);
     n_primitives++;
   }
 
-  void addMaterial(const Material& material) {
+  // return false when number of materials exceeds MAX_N_MATERIALS
+  bool addMaterial(const Material& material) {
+    if (n_materials >= MAX_N_MATERIALS) {
+      std::cerr << "number of materials exceeds " << MAX_N_MATERIALS
+                << std::endl;
+      return false;
+    }
     block.materials[n_materials] = material;
     n_materials++;
+    return true;
   }
 
   static Primitive createSphere(const glm::vec3& center, float radius) {
@@ -359,6 +759,7 @@ class Scene {
   }
 
   Scene() : n_primitives(0), n_materials(0) {
+    block.n_lights = 0;
     setupCornellBoxOriginal();
 
     // initialize scene
@@ -381,8 +782,487 @@ class Scene {
         break;
     }
 
+    // reload meshes
+    for (const Mesh& mesh : meshes) {
+      addMesh(mesh);
+    }
+
+    // initialize scene
+    init();
+  }
+
+  // load OBJ file with a single material
+  bool loadOBJ(const std::string& filepath, const Material& material,
+               float scale = 1.0f, const glm::vec3& offset = glm::vec3(0)) {
+    const Mesh mesh = {filepath, material, scale, offset};
+    if (!addMesh(mesh)) return false;
+    meshes.push_back(mesh);
+
+    // initialize scene
+    init();
+    return true;
+  }
+
+  // load text scene description, lines are
+  //   material <name> <lambert|mirror|glass> <kd r g b> [<le r g b>]
+  //   sphere <center x y z> <radius> <material name>
+  //   plane <corner x y z> <right x y z> <up x y z> <material name>
+  //   mesh <OBJ file> <material name> [<scale> [<offset x y z>]]
+  // OBJ files are relative to scene file, # starts comment
+  bool loadText(const std::string& filepath) {
+    std::ifstream file(filepath);
+    if (!file) {
+      std::cerr << "failed to open " << filepath << std::endl;
+      return false;
+    }
+
+    clear();
+    meshes.clear();
+    const std::filesystem::path directory =
+        std::filesystem::path(filepath).parent_path();
+    std::map<std::string, int> material_ids;
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+      line_number++;
+      const auto fail = [&](const std::string& message) {
+        std::cerr << filepath << ":" << line_number << ": " << message
+                  << std::endl;
+        return false;
+      };
+
+      std::istringstream ss(line);
+      std::string keyword;
+      if (!(ss >> keyword) || keyword[0] == '#') continue;
+
+      const auto readVec3 = [&](glm::vec3& v) {
+        return static_cast<bool>(ss >> v.x >> v.y >> v.z);
+      };
+      const auto readMaterial = [&](int& material_id) {
+        std::string name;
+        if (!(ss >> name)) return false;
+        const auto it = material_ids.find(name);
+        if (it == material_ids.end()) return false;
+        material_id = it->second;
+        return true;
+      };
+
+      if (keyword == "material") {
+        std::string name, type;
+        glm::vec3 kd;
+        if (!(ss >> name >> type) || !readVec3(kd)) {
+          return fail("invalid material");
+        }
+        if (material_ids.count(name)) {
+          return fail("duplicate material " + name);
+        }
+
+        Material material;
+        if (type == "lambert") {
+          material = createDiffuse(kd);
+        } else if (type == "mirror") {
+          material = createMirror(kd);
+        } else if (type == "glass") {
+          material = createGlass(kd);
+        } else {
+          return fail("unknown BRDF " + type);
+        }
+        glm::vec3 le;
+        if (readVec3(le)) material.le = le;
+
+        material_ids[name] = n_materials;
+        if (!addMaterial(material)) return fail("too many materials");
+      } else if (keyword == "sphere") {
+        glm::vec3 center;
+        float radius;
+        int material_id;
+        if (!readVec3(center) || !(ss >> radius) || !(radius > 0) ||
+            !readMaterial(material_id)) {
+          return fail("invalid sphere");
+        }
+        Primitive sphere = createSphere(center, radius);
+        sphere.material_id = material_id;
+        addPrimitive(sphere);
+      } else if (keyword == "plane") {
+        glm::vec3 corner, right, up;
+        int material_id;
+        if (!readVec3(corner) || !readVec3(right) || !readVec3(up) ||
+            !readMaterial(material_id)) {
+          return fail("invalid plane");
+        }
+        Primitive plane = createPlane(corner, right, up);
+        plane.material_id = material_id;
+        addPrimitive(plane);
+      } else if (keyword == "mesh") {
+        std::string obj;
+        int material_id;
+        if (!(ss >> obj) || !readMaterial(material_id)) {
+          return fail("invalid mesh");
+        }
+        float scale = 1.0f;
+        glm::vec3 offset(0);
+        if (ss >> scale) readVec3(offset);
+
+        // mesh of scene file is not kept when scene type is changed
+        const Mesh mesh = {(directory / obj).string(),
+                           block.materials[material_id], scale, offset};
+        if (!addMesh(mesh)) return fail("failed to load " + mesh.filepath);
+      } else {
+        return fail("unknown keyword " + keyword);
+      }
+    }
+
+    if (countLights(block.materials) > MAX_N_LIGHTS) {
+      std::cerr << filepath << ": number of lights exceeds " << MAX_N_LIGHTS
+                << std::endl;
+      return false;
+    }
+
     // initialize scene
     init();
+    return true;
+  }
+
+  // write compiled scene, sections are the arrays uploaded to GPU and the
+  // state needed for editing
+  bool saveBinary(const std::string& filepath) const {
+    const auto section = [](const auto& v) {
+      using T = typename std::decay_t<decltype(v)>::value_type;
+      return SceneSection{v.data(), sizeof(T) * v.size(), sizeof(T)};
+    };
+    // same order as SceneBinaryFormat::Section
+    const std::vector<SceneSection> sections = {
+        {&block, sizeof(SceneBlock), sizeof(SceneBlock)},
+        section(primitives),
+        section(primitive_refs),
+        section(bboxes),
+        section(spheres),
+        section(planes),
+        section(bvh.nodes),
+        section(bvh.indices),
+        section(bvh_primitive_ids),
+        section(vertices),
+        section(normals),
+        section(triangles),
+        section(light_cdf),
+    };
+    if (!SceneBinary::write(filepath, sections)) {
+      std::cerr << "failed to write " << filepath << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // FNV-1a of materials and geometry, padding of records and fields unused
+  // by primitive type are skipped
+  // same for built-in, text and compiled scene with same contents
+  std::uint64_t computeHash() const {
+    std::uint64_t hash = 14695981039346656037ull;
+    const auto add = [&](const auto& value) {
+      const unsigned char* bytes =
+          reinterpret_cast<const unsigned char*>(&value);
+      for (size_t i = 0; i < sizeof(value); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+      }
+    };
+
+    add(n_materials);
+    for (int i = 0; i < n_materials; ++i) {
+      const Material& material = block.materials[i];
+      add(material.brdf_type);
+      add(material.kd);
+      add(material.le);
+    }
+    for (const Primitive& primitive : primitives) {
+      add(primitive.type);
+      if (primitive.type == PRIMITIVE_SPHERE) {
+        add(primitive.center);
+        add(primitive.radius);
+      } else {
+        add(primitive.leftCornerPoint);
+        add(primitive.up);
+        add(primitive.right);
+      }
+      add(primitive.material_id);
+    }
+    for (const glm::vec4& vertex : vertices) add(vertex);
+    for (const glm::vec4& normal : normals) add(normal);
+    for (const Triangle& triangle : triangles) {
+      add(triangle.vertex);
+      add(triangle.material_id);
+      add(triangle.normal);
+    }
+    return hash;
+  }
+
+  // every id and index of loaded compiled scene is in range, so that shaders
+  // and edits never read out of bounds
+  bool validateBinary() const {
+    if (block.n_materials < 0 || block.n_materials > MAX_N_MATERIALS ||
+        block.n_lights < 0 || block.n_lights > MAX_N_LIGHTS) {
+      return false;
+    }
+    for (int i = 0; i < block.n_materials; ++i) {
+      const int brdf_type = block.materials[i].brdf_type;
+      if (brdf_type < 0 || brdf_type >= N_BRDF_TYPES) return false;
+    }
+    const auto is_material = [&](int material_id) {
+      return material_id >= 0 && material_id < block.n_materials;
+    };
+    const auto is_ref = [&](int ref) {
+      if (ref < 0) return false;
+      const size_t index = ref & ((1 << PRIMITIVE_TYPE_SHIFT) - 1);
+      switch (ref >> PRIMITIVE_TYPE_SHIFT) {
+        case PRIMITIVE_SPHERE:
+          return index < spheres.size();
+        case PRIMITIVE_PLANE:
+          return index < planes.size();
+        case PRIMITIVE_TRIANGLE:
+          return index < triangles.size();
+      }
+      return false;
+    };
+
+    // triangles follow primitives in primitive id
+    const size_t n_refs = primitives.size() + triangles.size();
+    if (primitive_refs.size() != n_refs || bboxes.size() != n_refs ||
+        static_cast<size_t>(block.n_primitives) != n_refs) {
+      return false;
+    }
+    for (size_t i = 0; i < primitives.size(); ++i) {
+      const Primitive& primitive = primitives[i];
+      if ((primitive.type != PRIMITIVE_SPHERE &&
+           primitive.type != PRIMITIVE_PLANE) ||
+          !is_material(primitive.material_id) || !is_ref(primitive_refs[i]) ||
+          primitive_refs[i] >> PRIMITIVE_TYPE_SHIFT != primitive.type) {
+        return false;
+      }
+    }
+    const auto is_vertex = [&](int index) {
+      return index >= 0 && static_cast<size_t>(index) < vertices.size();
+    };
+    const auto is_normal = [&](int index) {
+      return index >= 0 && static_cast<size_t>(index) < normals.size();
+    };
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      const Triangle& triangle = triangles[i];
+      const int ref = primitive_refs[primitives.size() + i];
+      // shading normal is used only when all corners have it
+      const bool has_normal = is_normal(triangle.normal.x) &&
+                              is_normal(triangle.normal.y) &&
+                              is_normal(triangle.normal.z);
+      if (!is_material(triangle.material_id) ||
+          !is_vertex(triangle.vertex.x) || !is_vertex(triangle.vertex.y) ||
+          !is_vertex(triangle.vertex.z) ||
+          (!has_normal && triangle.normal.x >= 0) || !is_ref(ref) ||
+          ref >> PRIMITIVE_TYPE_SHIFT != PRIMITIVE_TRIANGLE) {
+        return false;
+      }
+    }
+    for (const SphereRecord& sphere : spheres) {
+      if (!is_material(sphere.material_id)) return false;
+    }
+    for (const PlaneRecord& plane : planes) {
+      if (!is_material(plane.material_id)) return false;
+    }
+    for (int i = 0; i < block.n_lights; ++i) {
+      const Light& light = block.lights[i];
+      if (!is_ref(light.primID)) return false;
+      const bool is_triangle =
+          light.primID >> PRIMITIVE_TYPE_SHIFT == PRIMITIVE_TRIANGLE;
+      if (!is_triangle) {
+        if (light.n_triangles != 0) return false;
+        continue;
+      }
+      // mesh light, triangles and CDF entries are consecutive
+      const size_t first = light.primID & ((1 << PRIMITIVE_TYPE_SHIFT) - 1);
+      if (light.n_triangles <= 0 || light.cdf_offset < 0 ||
+          static_cast<size_t>(light.n_triangles) > triangles.size() - first ||
+          static_cast<size_t>(light.cdf_offset) > light_cdf.size() ||
+          static_cast<size_t>(light.n_triangles) >
+              light_cdf.size() - light.cdf_offset) {
+        return false;
+      }
+    }
+
+    // leaves refer to records, primitive ids are kept for refit
+    if (bvh.indices.size() != n_refs || bvh_primitive_ids.size() != n_refs) {
+      return false;
+    }
+    for (size_t i = 0; i < n_refs; ++i) {
+      const int primID = bvh_primitive_ids[i];
+      if (primID < 0 || static_cast<size_t>(primID) >= n_refs ||
+          bvh.indices[i] != primitive_refs[primID]) {
+        return false;
+      }
+    }
+    return bvh.validate();
+  }
+
+  // copy compiled scene, BVH is not rebuilt
+  bool loadBinary(const SceneBinary& binary) {
+    using namespace SceneBinaryFormat;
+    const auto load = [&](Section id, auto& v) {
+      using T = typename std::decay_t<decltype(v)>::value_type;
+      const SceneSection& section = binary.getSection(id);
+      if (section.element_size != sizeof(T)) return false;
+      v.assign(section.as<T>(), section.as<T>() + section.count());
+      return true;
+    };
+
+    const SceneSection& block_section = binary.getSection(BLOCK);
+    if (block_section.element_size != sizeof(SceneBlock) ||
+        block_section.count() != 1 || !load(PRIMITIVES, primitives) ||
+        !load(PRIMITIVE_REFS, primitive_refs) || !load(BBOXES, bboxes) ||
+        !load(SPHERES, spheres) || !load(PLANES, planes) ||
+        !load(BVH_NODES, bvh.nodes) || !load(BVH_INDICES, bvh.indices) ||
+        !load(BVH_PRIMITIVE_IDS, bvh_primitive_ids) ||
+        !load(VERTICES, vertices) || !load(NORMALS, normals) ||
+        !load(TRIANGLES, triangles) || !load(LIGHT_CDF, light_cdf)) {
+      std::cerr << "scene binary was written by another build" << std::endl;
+      return false;
+    }
+    std::memcpy(&block, block_section.data, sizeof(SceneBlock));
+    if (!validateBinary()) {
+      std::cerr << "corrupted scene binary" << std::endl;
+      return false;
+    }
+
+    n_primitives = primitives.size();
+    n_materials = block.n_materials;
+    bvh.setupParents();
+    meshes.clear();
+    clearDirty();
+    return true;
+  }
+
+  // edits of scene, return false when nothing is changed
+  // only modified bytes are marked in dirty ranges
+
+  bool setMaterial(int material_id, const Material& material) {
+    if (material_id < 0 || material_id >= n_materials) {
+      std::cerr << "invalid material id " << material_id << std::endl;
+      return false;
+    }
+    if (material.brdf_type < 0 || material.brdf_type >= N_BRDF_TYPES) {
+      std::cerr << "invalid BRDF type " << material.brdf_type << std::endl;
+      return false;
+    }
+
+    Material& dst = block.materials[material_id];
+    if (dst.brdf_type == material.brdf_type && dst.kd == material.kd &&
+        dst.le == material.le) {
+      return false;
+    }
+    const bool emission_changed = dst.le != material.le;
+    if (emission_changed) {
+      Material materials[MAX_N_MATERIALS];
+      std::copy(block.materials, block.materials + n_materials, materials);
+      materials[material_id] = material;
+      if (countLights(materials) > MAX_N_LIGHTS) {
+        std::cerr << "number of lights exceeds " << MAX_N_LIGHTS << std::endl;
+        return false;
+      }
+    }
+    dst = material;
+    markBlockDirty(&dst, sizeof(Material));
+
+    // lights keep copy of emission
+    if (emission_changed) setupLights();
+    return true;
+  }
+
+  // type of primitive can not be changed, its record is updated in place
+  bool setPrimitive(int primID, const Primitive& primitive) {
+    if (primID < 0 || primID >= n_primitives) {
+      std::cerr << "invalid primitive id " << primID << std::endl;
+      return false;
+    }
+    Primitive& dst = primitives[primID];
+    if (primitive.type != dst.type) {
+      std::cerr << "type of primitive can not be changed" << std::endl;
+      return false;
+    }
+    if (primitive.material_id < 0 || primitive.material_id >= n_materials) {
+      std::cerr << "invalid material id " << primitive.material_id
+                << std::endl;
+      return false;
+    }
+    if ((primitive.type == 0 && !(primitive.radius > 0)) ||
+        (primitive.type == 1 &&
+         glm::cross(primitive.right, primitive.up) == glm::vec3(0))) {
+      std::cerr << "degenerate primitive" << std::endl;
+      return false;
+    }
+
+    const bool geometry_changed = !isSameGeometry(dst, primitive);
+    const bool material_changed = dst.material_id != primitive.material_id;
+    if (!geometry_changed && !material_changed) return false;
+    const bool emission_changed =
+        material_changed && block.materials[dst.material_id].le !=
+                                block.materials[primitive.material_id].le;
+    if (emission_changed &&
+        countLights(block.materials, primID, primitive.material_id) >
+            MAX_N_LIGHTS) {
+      std::cerr << "number of lights exceeds " << MAX_N_LIGHTS << std::endl;
+      return false;
+    }
+
+    dst = primitive;
+    dst.id = primID;
+    updateRecord(primID);
+
+    // topology of BVH is kept, large moves may make it slower
+    if (geometry_changed) {
+      bboxes[primID] = computeBBox(dst);
+      refitBVH(primID);
+    }
+    if (emission_changed) setupLights();
+    return true;
+  }
+
+  void clearDirty() {
+    block_dirty.clear();
+    spheres_dirty.clear();
+    planes_dirty.clear();
+    bvh_nodes_dirty.clear();
+    light_cdf_dirty = false;
+  }
+
+  // #defines of primitive and BRDF types present in scene, see global.frag
+  // counts are read from SceneBlock, so edits change variant only when set
+  // of types present changes
+  std::string getShaderDefines() const {
+    bool has_brdf[N_BRDF_TYPES] = {false, false, false};
+    for (int i = 0; i < n_materials; ++i) {
+      const int brdf_type = block.materials[i].brdf_type;
+      // unknown type keeps generic kernel
+      if (brdf_type < 0 || brdf_type >= N_BRDF_TYPES) return "";
+      has_brdf[brdf_type] = true;
+    }
+    const bool has_sphere = !spheres.empty();
+    const bool has_plane = !planes.empty();
+    const bool has_triangle = !triangles.empty();
+
+    // switch needs at least one case, empty scene keeps generic kernel
+    if (!(has_sphere || has_plane || has_triangle) ||
+        !(has_brdf[0] || has_brdf[1] || has_brdf[2])) {
+      return "";
+    }
+
+    std::string defines;
+    const auto define = [&](const std::string& name, int value) {
+      defines += "#define " + name + " " + std::to_string(value) + "\n";
+    };
+    define("SCENE_SPECIALIZED", 1);
+    define("HAS_SPHERE", has_sphere);
+    define("HAS_PLANE", has_plane);
+    define("HAS_TRIANGLE", has_triangle);
+    define("HAS_LAMBERT", has_brdf[0]);
+    define("HAS_MIRROR", has_brdf[1]);
+    define("HAS_GLASS", has_brdf[2]);
+    return defines;
   }
 };
 
@@ -0,0 +1,168 @@
+#ifndef _SCENE_BINARY_H
+#define _SCENE_BINARY_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// compiled scene, sections are raw arrays of the structs uploaded to GPU
+// file is only valid for the build which wrote it, element sizes are checked
+namespace SceneBinaryFormat {
+
+constexpr char MAGIC[8] = {'C', 'B', 'X', 'S', 'C', 'E', 'N', 'E'};
+constexpr std::uint32_t VERSION = 2;
+// offset of every section, enough for SIMD loads of any record
+constexpr std::uint64_t ALIGNMENT = 64;
+
+enum Section : std::uint32_t {
+  BLOCK,
+  PRIMITIVES,
+  PRIMITIVE_REFS,
+  BBOXES,
+  SPHERES,
+  PLANES,
+  BVH_NODES,
+  BVH_INDICES,
+  BVH_PRIMITIVE_IDS,
+  VERTICES,
+  NORMALS,
+  TRIANGLES,
+  LIGHT_CDF,
+  N_SECTIONS,
+};
+
+struct SectionEntry {
+  std::uint32_t element_size;
+  std::uint32_t reserved;
+  std::uint64_t offset;
+  std::uint64_t size;
+};
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t n_sections;
+  SectionEntry sections[N_SECTIONS];
+};
+
+}  // namespace SceneBinaryFormat
+
+// array of one section, data is not owned
+struct SceneSection {
+  const void* data = nullptr;
+  size_t size = 0;
+  size_t element_size = 0;
+
+  size_t count() const { return element_size ? size / element_size : 0; }
+  template <typename T>
+  const T* as() const {
+    return static_cast<const T*>(data);
+  }
+};
+
+// read only memory mapping of compiled scene
+// sections point into mapping and are valid while this object lives
+class SceneBinary {
+ private:
+  MappedFile file;
+  SceneSection sections[SceneBinaryFormat::N_SECTIONS];
+
+  bool validate() {
+    using namespace SceneBinaryFormat;
+    const char* data = file.data();
+    const size_t size = file.size();
+    if (size < sizeof(Header)) return false;
+    const Header* header = reinterpret_cast<const Header*>(data);
+    if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if (header->version != VERSION || header->n_sections != N_SECTIONS) {
+      std::cerr << "unsupported scene binary version" << std::endl;
+      return false;
+    }
+
+    for (std::uint32_t i = 0; i < N_SECTIONS; ++i) {
+      const SectionEntry& entry = header->sections[i];
+      if (entry.offset % ALIGNMENT != 0 || entry.offset > size ||
+          entry.size > size - entry.offset || entry.element_size == 0 ||
+          entry.size % entry.element_size != 0) {
+        std::cerr << "corrupted scene binary section " << i << std::endl;
+        return false;
+      }
+      sections[i].data = data + entry.offset;
+      sections[i].size = entry.size;
+      sections[i].element_size = entry.element_size;
+    }
+    return true;
+  }
+
+ public:
+  SceneBinary() {}
+  SceneBinary(const SceneBinary&) = delete;
+  SceneBinary& operator=(const SceneBinary&) = delete;
+
+  // return false when file is missing or not a compiled scene
+  bool open(const std::string& filepath) {
+    if (!file.open(filepath)) return false;
+    if (!validate()) {
+      file.close();
+      return false;
+    }
+    return true;
+  }
+
+  bool isOpen() const { return file.isOpen(); }
+
+  const SceneSection& getSection(SceneBinaryFormat::Section section) const {
+    return sections[section];
+  }
+
+  // compiled scene starts with magic
+  static bool isSceneBinary(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    char magic[sizeof(SceneBinaryFormat::MAGIC)];
+    if (!file.read(magic, sizeof(magic))) return false;
+    return std::memcmp(magic, SceneBinaryFormat::MAGIC, sizeof(magic)) == 0;
+  }
+
+  // write sections, sections[i] is SceneBinaryFormat::Section i
+  static bool write(const std::string& filepath,
+                    const std::vector<SceneSection>& sections) {
+    using namespace SceneBinaryFormat;
+    if (sections.size() != N_SECTIONS) return false;
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.n_sections = N_SECTIONS;
+
+    const auto align = [](std::uint64_t offset) {
+      return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    };
+    std::uint64_t offset = align(sizeof(Header));
+    for (std::uint32_t i = 0; i < N_SECTIONS; ++i) {
+      header.sections[i].element_size = sections[i].element_size;
+      header.sections[i].reserved = 0;
+      header.sections[i].offset = offset;
+      header.sections[i].size = sections[i].size;
+      offset = align(offset + sections[i].size);
+    }
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) return false;
+    const char zeros[ALIGNMENT] = {};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    std::uint64_t written = sizeof(Header);
+    for (std::uint32_t i = 0; i < N_SECTIONS; ++i) {
+      file.write(zeros, header.sections[i].offset - written);
+      file.write(static_cast<const char*>(sections[i].data), sections[i].size);
+      written = header.sections[i].offset + sections[i].size;
+    }
+    return static_cast<bool>(file);
+  }
+};
+
+#endif
\ No newline at end of file
@@ -1,84 +1,122 @@
 #ifndef _SHADER_H
 #define _SHADER_H
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
 #include <sstream>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
 #include "Shadinclude.hpp"
+#include "gl_state.h"
 #include "glad/glad.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
 class Shader {
+ public:
+  // directory of linked program binaries, empty disables cache
+  static inline std::string cache_directory = "./shader_cache";
+  // variants kept per shader, least recently used one is deleted beyond
+  static constexpr size_t MAX_PROGRAMS = 8;
+  // sources of failed variant are checked for changes at most this often
+  static constexpr std::chrono::milliseconds FAILED_CHECK_INTERVAL{1000};
+
  private:
+  using UniformValue =
+      std::variant<GLint, GLuint, GLfloat, glm::vec2, glm::uvec2, glm::vec3>;
+
   const std::string vertex_shader_filepath;
   std::string vertex_shader_source;
   const std::string fragment_shader_filepath;
   std::string fragment_shader_source;
-  GLuint vertex_shader;
-  GLuint fragment_shader;
-  GLuint program;
 
-  void compileShader() {
-    // compile vertex shader
-    vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    vertex_shader_source = Shadinclude::load(vertex_shader_filepath);
-    const char* vertex_shader_source_c_str = vertex_shader_source.c_str();
-    glShaderSource(vertex_shader, 1, &vertex_shader_source_c_str, nullptr);
-    glCompileShader(vertex_shader);
+  // #define lines injected after #version, one program per variant
+  std::string defines;
+  std::map<std::string, GLuint> programs;
+  // keys of programs, least recently used first
+  std::vector<std::string> recent;
 
-    // handle compilation error
-    GLint success = 0;
-    glGetShaderiv(vertex_shader, GL_COMPILE_STATUS, &success);
-    if (success == GL_FALSE) {
-      std::cerr << "failed to compile vertex shader" << std::endl;
+  // program of current variant, compiled on first use
+  GLuint program = 0;
 
-      GLint logSize = 0;
-      glGetShaderiv(vertex_shader, GL_INFO_LOG_LENGTH, &logSize);
-      std::vector<GLchar> errorLog(logSize);
-      glGetShaderInfoLog(vertex_shader, logSize, &logSize, &errorLog[0]);
-      std::string errorLogStr(errorLog.begin(), errorLog.end());
-      std::cerr << errorLogStr << std::endl;
+  // variants which failed to build and write time of sources then, not
+  // rebuilt until sources change
+  std::map<std::string, std::filesystem::file_time_type> failed;
+  std::chrono::steady_clock::time_point failed_checked;
 
-      glDeleteShader(vertex_shader);
-      return;
-    }
+  // uniforms and block bindings are kept to set them on programs linked
+  // later, stale programs missed some of them
+  std::map<std::string, UniformValue> uniforms;
+  std::map<std::string, GLuint> blocks;
+  std::set<GLuint> stale_programs;
+
+  // per program uniform locations resolved at link time and values last
+  // set on it, unchanged values are not sent again
+  struct ProgramUniforms {
+    std::map<std::string, GLint> locations;
+    std::map<std::string, UniformValue> applied;
+  };
+  std::map<GLuint, ProgramUniforms> program_uniforms;
 
-    // compile fragment shader
-    fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    fragment_shader_source = Shadinclude::load(fragment_shader_filepath);
-    const char* fragment_shader_source_c_str = fragment_shader_source.c_str();
-    glShaderSource(fragment_shader, 1, &fragment_shader_source_c_str, nullptr);
-    glCompileShader(fragment_shader);
+  static GLuint compileShader(GLenum type, const std::string& source) {
+    const GLuint shader = glCreateShader(type);
+    const char* source_c_str = source.c_str();
+    glShaderSource(shader, 1, &source_c_str, nullptr);
+    glCompileShader(shader);
 
     // handle compilation error
-    success = 0;
-    glGetShaderiv(fragment_shader, GL_COMPILE_STATUS, &success);
+    GLint success = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (success == GL_FALSE) {
-      std::cerr << "failed to compile fragment shader" << std::endl;
+      std::cerr << "failed to compile "
+                << (type == GL_VERTEX_SHADER ? "vertex" : "fragment")
+                << " shader" << std::endl;
 
       GLint logSize = 0;
-      glGetShaderiv(fragment_shader, GL_INFO_LOG_LENGTH, &logSize);
+      glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logSize);
       std::vector<GLchar> errorLog(logSize);
-      glGetShaderInfoLog(fragment_shader, logSize, &logSize, &errorLog[0]);
+      glGetShaderInfoLog(shader, logSize, &logSize, &errorLog[0]);
       std::string errorLogStr(errorLog.begin(), errorLog.end());
       std::cerr << errorLogStr << std::endl;
 
-      glDeleteShader(fragment_shader);
-      return;
+      glDeleteShader(shader);
+      return 0;
     }
+    return shader;
   }
 
   void linkShader() {
+    const GLuint vertex_shader =
+        compileShader(GL_VERTEX_SHADER, vertex_shader_source);
+    const GLuint fragment_shader =
+        compileShader(GL_FRAGMENT_SHADER, fragment_shader_source);
+    if (!vertex_shader || !fragment_shader) {
+      glDeleteShader(vertex_shader);
+      glDeleteShader(fragment_shader);
+      return;
+    }
+
     // Link Shader Program
     program = glCreateProgram();
+    if (GLAD_GL_ARB_get_program_binary) {
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                          GL_TRUE);
+    }
     glAttachShader(program, vertex_shader);
     glAttachShader(program, fragment_shader);
     glLinkProgram(program);
     glDetachShader(program, vertex_shader);
     glDetachShader(program, fragment_shader);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
 
     // handle link error
     int success = 0;
@@ -94,8 +132,272 @@ class Shader {
       std::cerr << errorLogStr << std::endl;
 
       glDeleteProgram(program);
+      program = 0;
+      return;
+    }
+  }
+
+  // FNV-1a of expanded sources and driver, binary is only valid for the
+  // driver which produced it
+  std::string cacheFilepath() const {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    const auto feed = [&](const std::string& str) {
+      for (const char c : str) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+      }
+      // separator, so that boundaries of strings change hash
+      hash ^= 0xff;
+      hash *= 0x100000001b3ULL;
+    };
+    feed(vertex_shader_source);
+    feed(fragment_shader_source);
+    for (const GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+      const GLubyte* str = glGetString(name);
+      feed(str ? reinterpret_cast<const char*>(str) : "");
+    }
+
+    char filename[32];
+    std::snprintf(filename, sizeof(filename), "%016llx.bin",
+                  static_cast<unsigned long long>(hash));
+    return cache_directory + "/" + filename;
+  }
+
+  // return false when binary is missing or rejected by driver
+  bool loadProgramBinary(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    // format followed by at least one byte of binary
+    const std::streamoff size = file.tellg();
+    if (size <= static_cast<std::streamoff>(sizeof(GLenum))) return false;
+    file.seekg(0);
+
+    GLenum format = 0;
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    std::vector<char> binary(size - sizeof(format));
+    file.read(binary.data(), binary.size());
+    if (!file) return false;
+
+    program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), binary.size());
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (success == GL_FALSE) {
+      glDeleteProgram(program);
+      program = 0;
+      return false;
+    }
+    return true;
+  }
+
+  void saveProgramBinary(const std::string& filepath) const {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    std::error_code ec;
+    std::filesystem::create_directories(cache_directory, ec);
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) return;
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(binary.data(), binary.size());
+  }
+
+  // driver may expose extension without any binary format
+  static bool hasBinaryFormat() {
+    if (!GLAD_GL_ARB_get_program_binary) return false;
+    GLint n_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+    return n_formats > 0;
+  }
+
+  static std::string injectDefines(const std::string& source,
+                                   const std::string& defines) {
+    if (defines.empty()) return source;
+    // #version must stay first line
+    const size_t pos = source.find('\n');
+    if (pos == std::string::npos) return source + "\n" + defines;
+    return source.substr(0, pos + 1) + defines + source.substr(pos + 1);
+  }
+
+  // newest write time of sources, includes are searched in directory of
+  // fragment shader
+  std::filesystem::file_time_type sourcesWriteTime() const {
+    namespace fs = std::filesystem;
+    fs::file_time_type newest = fs::file_time_type::min();
+    const auto update = [&](const fs::path& path) {
+      std::error_code ec;
+      const fs::file_time_type time = fs::last_write_time(path, ec);
+      if (!ec && time > newest) newest = time;
+    };
+    update(vertex_shader_filepath);
+    std::error_code ec;
+    const fs::path directory = fs::path(fragment_shader_filepath).parent_path();
+    for (fs::recursive_directory_iterator it(directory, ec), end;
+         !ec && it != end; it.increment(ec)) {
+      update(it->path());
+    }
+    return newest;
+  }
+
+  // true when current variant failed to build from current sources
+  bool hasFailed() {
+    const auto it = failed.find(defines);
+    if (it == failed.end()) return false;
+    // directory is scanned at most once per interval, not on every activate()
+    const auto now = std::chrono::steady_clock::now();
+    if (now - failed_checked < FAILED_CHECK_INTERVAL) return true;
+    failed_checked = now;
+    if (sourcesWriteTime() == it->second) return true;
+    failed.erase(it);
+    return false;
+  }
+
+  // load program from cache or compile it, then apply kept state
+  void createProgram() {
+    // taken before reading, so edits during build cause a retry
+    const std::filesystem::file_time_type sources_time = sourcesWriteTime();
+    vertex_shader_source = Shadinclude::load(vertex_shader_filepath);
+    fragment_shader_source =
+        injectDefines(Shadinclude::load(fragment_shader_filepath), defines);
+
+    const bool use_cache = !cache_directory.empty() && hasBinaryFormat();
+    const std::string filepath = use_cache ? cacheFilepath() : "";
+    if (!use_cache || !loadProgramBinary(filepath)) {
+      linkShader();
+      if (use_cache && program) saveProgramBinary(filepath);
+    }
+    if (!program) {
+      failed[defines] = sources_time;
+      failed_checked = std::chrono::steady_clock::now();
       return;
     }
+
+    evictPrograms();
+    programs[defines] = program;
+    touch(defines);
+    queryUniformLocations();
+    applyState();
+  }
+
+  void queryUniformLocations() {
+    ProgramUniforms& state = program_uniforms[program];
+    GLint n_uniforms = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &n_uniforms);
+    GLint max_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<GLchar> name(max_length + 1);
+    for (GLint i = 0; i < n_uniforms; ++i) {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(program, i, name.size(), &length, &size, &type,
+                         name.data());
+      std::string uniform_name(name.data(), length);
+      // arrays are reported as "name[0]"
+      if (uniform_name.size() > 3 &&
+          uniform_name.compare(uniform_name.size() - 3, 3, "[0]") == 0) {
+        uniform_name.resize(uniform_name.size() - 3);
+      }
+      // uniforms of blocks have no location
+      const GLint location =
+          glGetUniformLocation(program, uniform_name.c_str());
+      if (location >= 0) state.locations[uniform_name] = location;
+    }
+  }
+
+  void applyState() {
+    for (const auto& [name, value] : uniforms) {
+      applyUniform(name, value);
+    }
+    for (const auto& [name, binding_number] : blocks) {
+      applyUBO(name, binding_number);
+    }
+  }
+
+  // mark variant as most recently used
+  void touch(const std::string& key) {
+    const auto it = std::find(recent.begin(), recent.end(), key);
+    if (it != recent.end()) recent.erase(it);
+    recent.push_back(key);
+  }
+
+  // delete least recently used variants to make room for one more
+  void evictPrograms() {
+    while (programs.size() >= MAX_PROGRAMS && !recent.empty()) {
+      const auto it = programs.find(recent.front());
+      recent.erase(recent.begin());
+      if (it == programs.end()) continue;
+      glDeleteProgram(it->second);
+      stale_programs.erase(it->second);
+      program_uniforms.erase(it->second);
+      programs.erase(it);
+      // deleted name may be reused
+      GLState::get().invalidate();
+    }
+  }
+
+  void markOthersStale() {
+    for (const auto& [key, other] : programs) {
+      if (other != program) stale_programs.insert(other);
+    }
+  }
+
+  // program is bound only when value has to be sent
+  void applyUniform(const std::string& uniform_name,
+                    const UniformValue& value) {
+    ProgramUniforms& state = program_uniforms[program];
+    // not used by this variant
+    const auto location_it = state.locations.find(uniform_name);
+    if (location_it == state.locations.end()) return;
+    const GLint location = location_it->second;
+
+    const auto applied_it = state.applied.find(uniform_name);
+    if (applied_it != state.applied.end() && applied_it->second == value) {
+      GLState::get().countSkipped();
+      return;
+    }
+    state.applied[uniform_name] = value;
+
+    GLState::get().useProgram(program);
+    GLState::get().countCall();
+    std::visit(
+        [location](const auto& v) {
+          using T = std::decay_t<decltype(v)>;
+          if constexpr (std::is_same_v<T, GLint>) {
+            glUniform1i(location, v);
+          } else if constexpr (std::is_same_v<T, GLuint>) {
+            glUniform1ui(location, v);
+          } else if constexpr (std::is_same_v<T, GLfloat>) {
+            glUniform1f(location, v);
+          } else if constexpr (std::is_same_v<T, glm::vec2>) {
+            glUniform2fv(location, 1, glm::value_ptr(v));
+          } else if constexpr (std::is_same_v<T, glm::uvec2>) {
+            glUniform2uiv(location, 1, glm::value_ptr(v));
+          } else {
+            glUniform3fv(location, 1, glm::value_ptr(v));
+          }
+        },
+        value);
+  }
+
+  void applyUBO(const std::string& block_name, GLuint binding_number) {
+    const GLuint index = glGetUniformBlockIndex(program, block_name.c_str());
+    glUniformBlockBinding(program, index, binding_number);
+  }
+
+  // set uniform now if program exists, otherwise at first use
+  void setUniformValue(const std::string& uniform_name,
+                       const UniformValue& value) {
+    uniforms[uniform_name] = value;
+    markOthersStale();
+    if (!isCompiled()) return;
+    compile();
+    applyUniform(uniform_name, value);
   }
 
  public:
@@ -103,73 +405,93 @@ class Shader {
   Shader(const std::string& _vertex_shader_filepath,
          const std::string& _fragment_shader_filepath)
       : vertex_shader_filepath(_vertex_shader_filepath),
-        fragment_shader_filepath(_fragment_shader_filepath) {
-    compileShader();
-    linkShader();
-  }
+        fragment_shader_filepath(_fragment_shader_filepath) {}
 
   void destroy() {
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
-    glDeleteProgram(program);
+    for (const auto& [key, variant] : programs) {
+      glDeleteProgram(variant);
+    }
+    programs.clear();
+    recent.clear();
+    failed.clear();
+    stale_programs.clear();
+    program_uniforms.clear();
+    program = 0;
+    // deleted names may be reused
+    GLState::get().invalidate();
+  }
+
+  // switch variant, e.g. "#define HAS_SPHERE 1\n"
+  void setDefines(const std::string& defines) {
+    if (defines == this->defines) return;
+    this->defines = defines;
+    const auto it = programs.find(defines);
+    program = it != programs.end() ? it->second : 0;
+    if (program) touch(defines);
+  }
+  const std::string& getDefines() const { return defines; }
+
+  bool isCompiled() const { return program != 0; }
+  // compile now instead of at first use, variant which failed is skipped
+  void compile() {
+    if (!isCompiled()) {
+      if (hasFailed()) return;
+      createProgram();
+    } else if (stale_programs.erase(program)) {
+      applyState();
+    }
   }
 
-  void activate() const { glUseProgram(program); }
-  void deactivate() const { glUseProgram(0); }
+  // program stays bound until another one is activated
+  // false without binding anything when program failed to build
+  bool activate() {
+    compile();
+    if (!isCompiled()) return false;
+    GLState::get().useProgram(program);
+    return true;
+  }
 
-  void setUniform(const std::string& uniform_name, GLint value) const {
-    activate();
-    const GLint location = glGetUniformLocation(program, uniform_name.c_str());
-    glUniform1i(location, value);
-    deactivate();
+  void setUniform(const std::string& uniform_name, GLint value) {
+    setUniformValue(uniform_name, value);
   }
-  void setUniform(const std::string& uniform_name, GLuint value) const {
-    activate();
-    const GLint location = glGetUniformLocation(program, uniform_name.c_str());
-    glUniform1ui(location, value);
-    deactivate();
+  void setUniform(const std::string& uniform_name, GLuint value) {
+    setUniformValue(uniform_name, value);
   }
-  void setUniform(const std::string& uniform_name, GLfloat value) const {
-    activate();
-    const GLint location = glGetUniformLocation(program, uniform_name.c_str());
-    glUniform1f(location, value);
-    deactivate();
+  void setUniform(const std::string& uniform_name, GLfloat value) {
+    setUniformValue(uniform_name, value);
   }
   void setUniform(const std::string& uniform_name,
-                  const glm::vec2& value) const {
-    activate();
-    const GLint location = glGetUniformLocation(program, uniform_name.c_str());
-    glUniform2fv(location, 1, glm::value_ptr(value));
-    deactivate();
+                  const glm::vec2& value) {
+    setUniformValue(uniform_name, value);
   }
   void setUniform(const std::string& uniform_name,
-                  const glm::uvec2& value) const {
-    activate();
-    const GLint location = glGetUniformLocation(program, uniform_name.c_str());
-    glUniform2uiv(location, 1, glm::value_ptr(value));
-    deactivate();
+                  const glm::uvec2& value) {
+    setUniformValue(uniform_name, value);
   }
   void setUniform(const std::string& uniform_name,
-                  const glm::vec3& value) const {
-    activate();
-    const GLint location = glGetUniformLocation(program, uniform_name.c_str());
-    glUniform3fv(location, 1, glm::value_ptr(value));
-    deactivate();
+                  const glm::vec3& value) {
+    setUniformValue(uniform_name, value);
   }
 
+  // texture is bound now, sampler uniform may be deferred
   void setUniformTexture(const std::string& uniform_name, GLuint texture,
-                         GLuint texture_unit_number) const {
-    activate();
-    const GLint location = glGetUniformLocation(program, uniform_name.c_str());
-    glUniform1i(location, texture_unit_number);
-    glActiveTexture(GL_TEXTURE0 + texture_unit_number);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    deactivate();
+                         GLuint texture_unit_number) {
+    setUniformValue(uniform_name, GLint(texture_unit_number));
+    GLState::get().bindTexture(texture_unit_number, GL_TEXTURE_2D, texture);
   }
 
-  void setUBO(const std::string& block_name, GLuint binding_number) const {
-    const GLuint index = glGetUniformBlockIndex(program, block_name.c_str());
-    glUniformBlockBinding(program, index, binding_number);
+  void setUniformTextureBuffer(const std::string& uniform_name,
+                               GLuint texture,
+                               GLuint texture_unit_number) {
+    setUniformValue(uniform_name, GLint(texture_unit_number));
+    GLState::get().bindTexture(texture_unit_number, GL_TEXTURE_BUFFER, texture);
+  }
+
+  void setUBO(const std::string& block_name, GLuint binding_number) {
+    blocks[block_name] = binding_number;
+    markOthersStale();
+    if (!isCompiled()) return;
+    applyUBO(block_name, binding_number);
   }
 };
 
@@ -0,0 +1,89 @@
+#version 330 core
+
+#include common/global.frag
+#include common/adaptive.frag
+#include common/gbuffer.frag
+
+// (radiance, variance) of previous iteration
+uniform sampler2D colorTexture;
+
+// distance between taps, 2^iteration
+uniform int stepSize;
+
+// edge stopping parameters of SVGF(Schied et al. 2017)
+const float SIGMA_DEPTH = 1.0;
+const float SIGMA_NORMAL = 128.0;
+const float SIGMA_LUMINANCE = 4.0;
+const float SIGMA_ALBEDO = 0.1;
+
+in vec2 texCoord;
+out vec4 fragColor;
+
+// 3x3 gaussian of variance, smooths estimate of few samples
+float filteredVariance(in ivec2 p) {
+    const float kernel[2] = float[2](0.25, 0.125);
+    ivec2 size = textureSize(colorTexture, 0);
+    float variance = 0.0;
+    for(int y = -1; y <= 1; ++y) {
+        for(int x = -1; x <= 1; ++x) {
+            ivec2 q = clamp(p + ivec2(x, y), ivec2(0), size - 1);
+            float w = kernel[abs(x)] * kernel[abs(y)] * 4.0;
+            variance += w * texelFetch(colorTexture, q, 0).a;
+        }
+    }
+    return variance;
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(colorTexture, 0);
+
+    vec4 center = texelFetch(colorTexture, p, 0);
+    vec3 normal = texelFetch(gbufferNormal, p, 0).xyz;
+    float depth = texelFetch(gbufferPosition, p, 0).w;
+    vec4 albedoGradient = texelFetch(gbufferAlbedo, p, 0);
+
+    // background is not filtered
+    if(depth <= 0.0) {
+        fragColor = center;
+        return;
+    }
+
+    float lum = luminance(center.rgb);
+    float lumScale = SIGMA_LUMINANCE * sqrt(max(filteredVariance(p), 0.0)) + 1e-10;
+
+    // 5x5 B3 spline kernel
+    const float kernel[3] = float[3](0.375, 0.25, 0.0625);
+
+    vec3 sumColor = vec3(0);
+    float sumVariance = 0.0;
+    float sumWeight = 0.0;
+    for(int y = -2; y <= 2; ++y) {
+        for(int x = -2; x <= 2; ++x) {
+            ivec2 offset = ivec2(x, y) * stepSize;
+            ivec2 q = p + offset;
+            if(any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size))) {
+                continue;
+            }
+
+            vec4 c = texelFetch(colorTexture, q, 0);
+            vec3 n = texelFetch(gbufferNormal, q, 0).xyz;
+            float z = texelFetch(gbufferPosition, q, 0).w;
+            vec3 a = texelFetch(gbufferAlbedo, q, 0).rgb;
+
+            float wDepth = abs(depth - z) / (SIGMA_DEPTH * albedoGradient.a * length(vec2(offset)) + 1e-3);
+            float wNormal = pow(max(dot(normal, n), 0.0), SIGMA_NORMAL);
+            float wLum = abs(lum - luminance(c.rgb)) / lumScale;
+            float wAlbedo = length(albedoGradient.rgb - a) / SIGMA_ALBEDO;
+
+            float w = kernel[abs(x)] * kernel[abs(y)] * wNormal * exp(-wDepth - wLum - wAlbedo);
+            sumColor += w * c.rgb;
+            // variance is filtered with squared weights
+            sumVariance += w * w * c.a;
+            sumWeight += w;
+        }
+    }
+
+    // center tap always has positive weight
+    fragColor = vec4(sumColor / sumWeight, sumVariance / (sumWeight * sumWeight));
+}
\ No newline at end of file
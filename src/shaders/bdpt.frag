@@ -12,9 +12,15 @@
 
 in vec2 texCoord;
 
-layout (location = 0) out vec3 color;
+layout (location = 0) out vec4 color;
 layout (location = 1) out uint state;
 
+// compile time bound of maxDepth for subpath arrays, see
+// Renderer::updateShaderDefines()
+#ifndef MAX_DEPTH
+#define MAX_DEPTH 128
+#endif
+
 struct VertexInfo {
   vec3 x; // position
   vec3 n; // normal
@@ -36,7 +42,8 @@ int generateLightSubpath() {
   vec3 normal;
   vec3 dpdu;
   vec3 dpdv;
-  vec3 x0 = samplePointOnPrimitive(primitives[light.primID], normal, dpdu, dpdv, pdf_area);
+  int primID;
+  vec3 x0 = samplePointOnLight(light, primID, normal, dpdu, dpdv, pdf_area);
 
   lightSubpath[0].x = x0;
   lightSubpath[0].n = normal;
@@ -52,7 +59,7 @@ int generateLightSubpath() {
   vec3 brdf = vec3(1); // BRDF
 
   // generate path
-  for(int i = 1; i <= MAX_DEPTH; ++i) {
+  for(int i = 1; i <= min(maxDepth, MAX_DEPTH); ++i) {
     // russian roulette
     if(random() >= rr_prob) {
       break;
@@ -64,13 +71,12 @@ int generateLightSubpath() {
       n_L++;
 
       // hit surface info
-      Primitive hitPrimitive = primitives[info.primID];
-      Material hitMaterial = materials[hitPrimitive.material_id];
+      Material hitMaterial = materials[info.materialID];
 
       // set vertex info
       lightSubpath[i].x = info.hitPos;
       lightSubpath[i].n = info.hitNormal;
-      lightSubpath[i].material_id = hitPrimitive.material_id;
+      lightSubpath[i].material_id = info.materialID;
 
       // compute alpha
       lightSubpath[i].alpha = abs(dot(lightSubpath[i - 1].n, ray.direction)) / (rr_prob * pdf_solid) * brdf * lightSubpath[i - 1].alpha;
@@ -117,7 +123,7 @@ int generateEyeSubpath(in vec2 ij) {
   vec3 brdf = vec3(1); // BRDF
 
   // generate path
-  for(int i = 1; i <= MAX_DEPTH; ++i) {
+  for(int i = 1; i <= min(maxDepth, MAX_DEPTH); ++i) {
     // russian roulette
     if(random() >= rr_prob) {
       break;
@@ -129,13 +135,12 @@ int generateEyeSubpath(in vec2 ij) {
       n_E++;
 
       // hit surface info
-      Primitive hitPrimitive = primitives[info.primID];
-      Material hitMaterial = materials[hitPrimitive.material_id];
+      Material hitMaterial = materials[info.materialID];
 
       // set vertex info
       eyeSubpath[i].x = info.hitPos;
       eyeSubpath[i].n = info.hitNormal;
-      eyeSubpath[i].material_id = hitPrimitive.material_id;
+      eyeSubpath[i].material_id = info.materialID;
 
       // compute alpha
       eyeSubpath[i].alpha = abs(dot(eyeSubpath[i - 1].n, ray.direction)) / (rr_prob * pdf_solid) * brdf * eyeSubpath[i - 1].alpha;
@@ -175,9 +180,9 @@ void main() {
     Ray ray = rayGen(uv, pdf);
     float cos_term = dot(camera.camForward, ray.direction);
 
-    // accumulate sampled color on accumTexture
+    // accumulate sampled color and number of rays on accumTexture
     vec3 radiance = computeRadiance(ray) / pdf;
-    color = texture(accumTexture, texCoord).xyz + radiance * cos_term;
+    color = texture(accumTexture, texCoord) + vec4(radiance * cos_term, RAY_COUNT);
 
     // save RNG state on stateTexture
     state = RNG_STATE.a;
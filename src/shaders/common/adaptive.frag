@@ -0,0 +1,29 @@
+// moments: (sum of luminance, sum of squared luminance, number of samples)
+// variance of the mean luminance
+float varianceOfMean(in vec4 moments) {
+    float n = moments.z;
+    if(n < 2.0) {
+        return 1e30;
+    }
+    float mean = moments.x / n;
+    float variance = max(moments.y / n - mean * mean, 0.0) * n / (n - 1.0);
+    return variance / n;
+}
+
+// relative standard error of the mean luminance
+float relativeError(in vec4 moments) {
+    if(moments.z < 2.0) {
+        return 1e30;
+    }
+    return sqrt(varianceOfMean(moments)) / max(moments.x / moments.z, 1e-3);
+}
+
+// pixel stops sampling when relative error is below threshold
+// threshold 0 disables adaptive sampling
+bool isConverged(in vec4 moments, in float threshold, in int minSamples) {
+    return threshold > 0.0 && moments.z >= float(minSamples) && relativeError(moments) < threshold;
+}
+
+float luminance(in vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
\ No newline at end of file
@@ -4,37 +4,48 @@ float fresnel(in vec3 v, in float n1, in float n2) {
 }
 
 vec3 BRDF(in vec3 wo, in vec3 wi, in Material material) {
-    switch(material.brdf_type) {
+    switch(BRDF_TYPE(material)) {
+#if HAS_LAMBERT
         // lambert
         case 0:
         return material.kd * PI_INV;
         break;
+#endif
+#if HAS_MIRROR
         // mirror
         case 1:
         return vec3(0);
         break;
+#endif
+#if HAS_GLASS
         // glass
         case 2:
         return vec3(0);
         break;
+#endif
     }
 }
 
 vec3 sampleBRDF(in vec3 wo, out vec3 wi, in Material material, out float pdf) {
-    switch(material.brdf_type) {
+    switch(BRDF_TYPE(material)) {
+#if HAS_LAMBERT
     // lambert
     case 0:
         wi = sampleCosineHemisphere(random(), random(), pdf);
         return material.kd * PI_INV;
         break;
+#endif
 
+#if HAS_MIRROR
     // mirror
     case 1:
         pdf = 1.0;
         wi = reflect(-wo, vec3(0, 1, 0));
         return material.kd / abs(wi.y);
         break;
+#endif
 
+#if HAS_GLASS
     // glass
     case 2:
         pdf = 1.0;
@@ -68,5 +79,6 @@ vec3 sampleBRDF(in vec3 wo, out vec3 wi, in Material material, out float pdf) {
 
         return material.kd / abs(wi.y);
         break;
+#endif
     }
 }
\ No newline at end of file
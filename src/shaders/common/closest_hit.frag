@@ -1,27 +1,118 @@
-bool intersect_each(in Ray ray, in Primitive primitive, out IntersectInfo info) {
-    switch(primitive.type) {
-    // Sphere
-    case 0:
-        return intersectSphere(primitive.center, primitive.radius, ray, info);
-    // Plane
-    case 1:
-        return intersectPlane(primitive.leftCornerPoint, primitive.right, primitive.up, ray, info);
+bool intersect_each(in Ray ray, in int primID, out IntersectInfo info) {
+    int index = primID & PRIMITIVE_INDEX_MASK;
+    switch(PRIMITIVE_TYPE(primID)) {
+#if HAS_SPHERE
+    case PRIMITIVE_SPHERE:
+        return intersectSphere(index, ray, info);
+#endif
+#if HAS_PLANE
+    case PRIMITIVE_PLANE:
+        return intersectPlane(index, ray, info);
+#endif
+#if HAS_TRIANGLE
+    case PRIMITIVE_TRIANGLE:
+        return intersectTriangle(index, ray, info);
+#endif
     }
 }
 
+// same as BVH::MAX_DEPTH in bvh.h
+const int BVH_STACK_SIZE = 64;
+
+// return entry distance of ray, or -1 when ray misses box before tmax
+float intersectAABB(in vec3 bmin, in vec3 bmax, in Ray ray, in vec3 invDir, in float tmax) {
+    vec3 t0 = (bmin - ray.origin) * invDir;
+    vec3 t1 = (bmax - ray.origin) * invDir;
+    vec3 tmin3 = min(t0, t1);
+    vec3 tmax3 = max(t0, t1);
+    float tnear = max(max(tmin3.x, tmin3.y), max(tmin3.z, 0.0));
+    float tfar = min(min(tmax3.x, tmax3.y), min(tmax3.z, tmax));
+    return tnear <= tfar ? tnear : -1.0;
+}
+
+float intersectNode(in int node, in Ray ray, in vec3 invDir, in float tmax) {
+    vec3 bmin = intBitsToFloat(texelFetch(bvhNodeBuffer, 2 * node).xyz);
+    vec3 bmax = intBitsToFloat(texelFetch(bvhNodeBuffer, 2 * node + 1).xyz);
+    return intersectAABB(bmin, bmax, ray, invDir, tmax);
+}
+
 bool intersect(in Ray ray, out IntersectInfo info) {
     bool hit = false;
     info.t = RAY_TMAX;
+#ifdef COUNT_RAYS
+    RAY_COUNT += 1.0;
+#endif
+
+    if(n_primitives == 0) {
+        return false;
+    }
+
+    vec3 invDir = 1.0 / ray.direction;
+    if(intersectNode(0, ray, invDir, info.t) < 0.0) {
+        return false;
+    }
+
+    // stack of far children and their entry distance
+    int stack[BVH_STACK_SIZE];
+    float stackT[BVH_STACK_SIZE];
+    int sp = 0;
 
-    for(int i = 0; i < n_primitives; ++i) {
-        IntersectInfo temp;
-        if(intersect_each(ray, primitives[i], temp)) {
-            if(temp.t < info.t) {
-                hit = true;
-                temp.primID = primitives[i].id;
-                info = temp;
+    int node = 0;
+    while(true) {
+        ivec4 t0 = texelFetch(bvhNodeBuffer, 2 * node);
+        int count = texelFetch(bvhNodeBuffer, 2 * node + 1).w;
+
+        // leaf
+        if(count > 0) {
+            for(int i = t0.w; i < t0.w + count; ++i) {
+                int primID = texelFetch(bvhIndexBuffer, i).x;
+                IntersectInfo temp;
+                if(intersect_each(ray, primID, temp)) {
+                    if(temp.t < info.t) {
+                        hit = true;
+                        temp.primID = primID;
+                        info = temp;
+                    }
+                }
+            }
+        }
+        // interior, visit nearer child first
+        else {
+            int left = node + 1;
+            int right = t0.w;
+            float tl = intersectNode(left, ray, invDir, info.t);
+            float tr = intersectNode(right, ray, invDir, info.t);
+            if(tl >= 0.0 && tr >= 0.0) {
+                bool leftFirst = tl <= tr;
+                stack[sp] = leftFirst ? right : left;
+                stackT[sp] = leftFirst ? tr : tl;
+                sp++;
+                node = leftFirst ? left : right;
+                continue;
+            }
+            else if(tl >= 0.0) {
+                node = left;
+                continue;
+            }
+            else if(tr >= 0.0) {
+                node = right;
+                continue;
             }
         }
+
+        // pop next node, skip nodes behind closest hit
+        bool found = false;
+        while(sp > 0) {
+            sp--;
+            if(stackT[sp] <= info.t) {
+                node = stack[sp];
+                found = true;
+                break;
+            }
+        }
+        if(!found) {
+            break;
+        }
     }
 
     return hit;
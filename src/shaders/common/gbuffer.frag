@@ -0,0 +1,44 @@
+// G-buffer of current view, see gbuffer.frag
+// position: (hit position, distance), distance 0 is miss
+// normal: (normal, unused)
+// albedo: (albedo, screen space depth gradient)
+// uv: (u, v, material id, unused)
+// primitive: primitive id, integer texture since float is exact only up to
+// 2^24
+uniform sampler2D gbufferPosition;
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferAlbedo;
+uniform sampler2D gbufferUV;
+uniform usampler2D gbufferPrimitive;
+
+// start paths from G-buffer instead of tracing primary ray
+uniform bool primaryCache;
+
+// orthonormal basis around n(Duff et al. 2017)
+void orthonormalBasis(in vec3 n, out vec3 t, out vec3 b) {
+    float s = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + n.z);
+    float c = n.x * n.y * a;
+    t = vec3(1.0 + s * n.x * n.x * a, s * c, -s * n.x);
+    b = vec3(c, s + n.y * n.y * a, -n.y);
+}
+
+// primary hit of pixel center, tangents are any basis around normal
+bool primaryHit(in ivec2 pixel, out IntersectInfo info) {
+    vec4 position = texelFetch(gbufferPosition, pixel, 0);
+    if(position.w <= 0.0) {
+        return false;
+    }
+    vec4 normal = texelFetch(gbufferNormal, pixel, 0);
+    vec4 uv = texelFetch(gbufferUV, pixel, 0);
+
+    info.t = position.w;
+    info.hitPos = position.xyz;
+    info.hitNormal = normal.xyz;
+    orthonormalBasis(info.hitNormal, info.dpdu, info.dpdv);
+    info.u = uv.x;
+    info.v = uv.y;
+    info.primID = int(texelFetch(gbufferPrimitive, pixel, 0).x);
+    info.materialID = int(uv.z);
+    return true;
+}
\ No newline at end of file
@@ -4,7 +4,17 @@ const float PI_2_INV = 1.0 / (2.0 * PI);
 
 const float RAY_TMIN =  0.1;
 const float RAY_TMAX = 10000.0;
-const int MAX_DEPTH = 100;
+
+// scene specialization, see Scene::getShaderDefines()
+// HAS_*: 0 removes code of primitive or BRDF type absent from scene
+#ifndef SCENE_SPECIALIZED
+#define HAS_SPHERE 1
+#define HAS_PLANE 1
+#define HAS_TRIANGLE 1
+#define HAS_LAMBERT 1
+#define HAS_MIRROR 1
+#define HAS_GLASS 1
+#endif
 
 struct Ray {
     vec3 origin;
@@ -20,6 +30,7 @@ struct IntersectInfo {
     float u;
     float v;
     int primID;
+    int materialID;
 };
 
 struct Material {
@@ -28,19 +39,32 @@ struct Material {
     vec3 le;
 };
 
-struct Primitive {
-    int id;
-    int type;
-    vec3 center;
-    float radius;
-    vec3 leftCornerPoint;
-    vec3 up;
-    vec3 right;
-    int material_id;
-};
+// primitive reference, type in upper bits and record index in lower bits
+// same as Scene::PRIMITIVE_TYPE_SHIFT in scene.h
+const int PRIMITIVE_TYPE_SHIFT = 28;
+const int PRIMITIVE_INDEX_MASK = (1 << PRIMITIVE_TYPE_SHIFT) - 1;
+const int PRIMITIVE_SPHERE = 0;
+const int PRIMITIVE_PLANE = 1;
+const int PRIMITIVE_TRIANGLE = 2;
 
+// type is constant when scene has only one
+#if HAS_SPHERE + HAS_PLANE + HAS_TRIANGLE == 1
+#define PRIMITIVE_TYPE(primID) (HAS_PLANE * PRIMITIVE_PLANE + HAS_TRIANGLE * PRIMITIVE_TRIANGLE)
+#else
+#define PRIMITIVE_TYPE(primID) ((primID) >> PRIMITIVE_TYPE_SHIFT)
+#endif
+#if HAS_LAMBERT + HAS_MIRROR + HAS_GLASS == 1
+#define BRDF_TYPE(material) (HAS_MIRROR * 1 + HAS_GLASS * 2)
+#else
+#define BRDF_TYPE(material) ((material).brdf_type)
+#endif
+
+// mesh light is n_triangles consecutive triangles from primID, sampled by
+// area CDF at cdf_offset of lightCDFBuffer, see Light in scene.h
 struct Light {
     int primID;
+    int n_triangles;
+    int cdf_offset;
     vec3 le;
 };
 
@@ -48,4 +72,7 @@ struct XORShift32_state {
     uint a;
 };
 
-XORShift32_state RNG_STATE;
\ No newline at end of file
+XORShift32_state RNG_STATE;
+
+// number of rays traced by intersect(), stays 0 without COUNT_RAYS
+float RAY_COUNT = 0.0;
\ No newline at end of file
@@ -1,8 +1,12 @@
+bool intersectSphere(in int sphere, in Ray ray, out IntersectInfo info) {
+    ivec4 texel0 = texelFetch(sphereBuffer, 2 * sphere);
+    ivec4 texel1 = texelFetch(sphereBuffer, 2 * sphere + 1);
+    vec3 center = intBitsToFloat(texel0.xyz);
+    float radius2 = intBitsToFloat(texel0.w);
 
-bool intersectSphere(in vec3 center, in float radius, in Ray ray, out IntersectInfo info) {
-    float b = dot(ray.origin - center, ray.direction);
-    float len = length(ray.origin - center);
-    float c = len*len - radius*radius;
+    vec3 oc = ray.origin - center;
+    float b = dot(oc, ray.direction);
+    float c = dot(oc, oc) - radius2;
     float D = b*b - c;
     if(D < 0.0) {
         return false;
@@ -18,8 +22,12 @@ bool intersectSphere(in vec3 center, in float radius, in Ray ray, out IntersectI
         }
     }
 
+    float radius = intBitsToFloat(texel1.x);
+    float radiusInv = intBitsToFloat(texel1.y);
+
     info.t = t;
     info.hitPos = ray.origin + t*ray.direction;
+    info.materialID = texel1.z;
 
     vec3 r = info.hitPos - center;
     info.hitNormal = normalize(r);
@@ -29,7 +37,7 @@ bool intersectSphere(in vec3 center, in float radius, in Ray ray, out IntersectI
     if(phi < 0.0) {
         phi += 2.0 * PI;
     }
-    float theta = acos(clamp(r.y / radius, -1.0, 1.0));
+    float theta = acos(clamp(r.y * radiusInv, -1.0, 1.0));
     info.dpdv = normalize(vec3(cos(phi) * r.y, -radius * sin(theta), sin(phi) * r.y));
 
     info.u = phi * 0.5 * PI_INV;
@@ -37,23 +45,26 @@ bool intersectSphere(in vec3 center, in float radius, in Ray ray, out IntersectI
     return true;
 }
 
-bool intersectPlane(in vec3 leftCornerPoint, in vec3 right, in vec3 up, in Ray ray, out IntersectInfo info) {
-    vec3 normal = normalize(cross(right, up));
-    vec3 center = leftCornerPoint + 0.5 * right + 0.5 * up;
-    vec3 rightDir = normalize(right);
-    float rightLength = length(right);
-    vec3 upDir = normalize(up);
-    float upLength = length(up);
+bool intersectPlane(in int plane, in Ray ray, out IntersectInfo info) {
+    ivec4 texel0 = texelFetch(planeBuffer, 4 * plane);
+    ivec4 texel1 = texelFetch(planeBuffer, 4 * plane + 1);
+    vec3 origin = intBitsToFloat(texel0.xyz);
+    vec3 normal = intBitsToFloat(texel1.xyz);
 
-    float t = -dot(ray.origin - center, normal) / dot(ray.direction, normal);
+    float t = -dot(ray.origin - origin, normal) / dot(ray.direction, normal);
     if(t < RAY_TMIN || t > RAY_TMAX) {
         return false;
     }
 
+    ivec4 texel2 = texelFetch(planeBuffer, 4 * plane + 2);
+    ivec4 texel3 = texelFetch(planeBuffer, 4 * plane + 3);
+    vec3 rightDir = intBitsToFloat(texel2.xyz);
+    vec3 upDir = intBitsToFloat(texel3.xyz);
+
     vec3 hitPos = ray.origin + t*ray.direction;
-    float dx = dot(hitPos - leftCornerPoint, rightDir);
-    float dy = dot(hitPos - leftCornerPoint, upDir);
-    if(dx < 0.0 || dx > rightLength || dy < 0.0 || dy > upLength) {
+    float u = dot(hitPos - origin, rightDir) * intBitsToFloat(texel2.w);
+    float v = dot(hitPos - origin, upDir) * intBitsToFloat(texel3.w);
+    if(u < 0.0 || u > 1.0 || v < 0.0 || v > 1.0) {
         return false;
     }
 
@@ -62,7 +73,92 @@ bool intersectPlane(in vec3 leftCornerPoint, in vec3 right, in vec3 up, in Ray r
     info.hitNormal = dot(-ray.direction, normal) > 0.0 ? normal : -normal;
     info.dpdu = rightDir;
     info.dpdv = upDir;
-    info.u = dx / rightLength;
-    info.v = dy / upLength;
+    info.u = u;
+    info.v = v;
+    info.materialID = texel0.w;
+    return true;
+}
+
+// watertight ray/triangle intersection
+// Woop et al. 2013, Watertight Ray/Triangle Intersection
+bool intersectTriangle(in int triangle, in Ray ray, out IntersectInfo info) {
+    ivec4 vertex = texelFetch(triangleBuffer, 2 * triangle);
+    vec3 p0 = texelFetch(vertexBuffer, vertex.x).xyz;
+    vec3 p1 = texelFetch(vertexBuffer, vertex.y).xyz;
+    vec3 p2 = texelFetch(vertexBuffer, vertex.z).xyz;
+
+    // permute axes so that largest component of direction is z
+    vec3 absDir = abs(ray.direction);
+    int kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0 : 2) : (absDir.y > absDir.z ? 1 : 2);
+    int kx = kz == 2 ? 0 : kz + 1;
+    int ky = kx == 2 ? 0 : kx + 1;
+    // preserve winding
+    if(ray.direction[kz] < 0.0) {
+        int tmp = kx;
+        kx = ky;
+        ky = tmp;
+    }
+
+    // shear constants
+    float Sz = 1.0 / ray.direction[kz];
+    float Sx = ray.direction[kx] * Sz;
+    float Sy = ray.direction[ky] * Sz;
+
+    // vertices relative to ray origin, sheared
+    vec3 A = p0 - ray.origin;
+    vec3 B = p1 - ray.origin;
+    vec3 C = p2 - ray.origin;
+    float Ax = A[kx] - Sx * A[kz];
+    float Ay = A[ky] - Sy * A[kz];
+    float Bx = B[kx] - Sx * B[kz];
+    float By = B[ky] - Sy * B[kz];
+    float Cx = C[kx] - Sx * C[kz];
+    float Cy = C[ky] - Sy * C[kz];
+
+    // scaled barycentric coordinates
+    float U = Cx * By - Cy * Bx;
+    float V = Ax * Cy - Ay * Cx;
+    float W = Bx * Ay - By * Ax;
+    if((U < 0.0 || V < 0.0 || W < 0.0) && (U > 0.0 || V > 0.0 || W > 0.0)) {
+        return false;
+    }
+    float det = U + V + W;
+    if(det == 0.0) {
+        return false;
+    }
+
+    // hit distance
+    float T = Sz * (U * A[kz] + V * B[kz] + W * C[kz]);
+    float t = T / det;
+    if(t < RAY_TMIN || t > RAY_TMAX) {
+        return false;
+    }
+    vec3 barycentric = vec3(U, V, W) / det;
+
+    // geometric normal faces the ray like plane
+    vec3 normal = normalize(cross(p1 - p0, p2 - p0));
+    if(dot(-ray.direction, normal) < 0.0) {
+        normal = -normal;
+    }
+
+    // interpolate shading normal
+    ivec4 vertexNormal = texelFetch(triangleBuffer, 2 * triangle + 1);
+    if(vertexNormal.x >= 0) {
+        vec3 n = barycentric.x * texelFetch(normalBuffer, vertexNormal.x).xyz
+               + barycentric.y * texelFetch(normalBuffer, vertexNormal.y).xyz
+               + barycentric.z * texelFetch(normalBuffer, vertexNormal.z).xyz;
+        n = normalize(n);
+        normal = dot(n, normal) > 0.0 ? n : -n;
+    }
+
+    info.t = t;
+    info.hitPos = barycentric.x * p0 + barycentric.y * p1 + barycentric.z * p2;
+    info.hitNormal = normal;
+    vec3 e1 = p1 - p0;
+    info.dpdu = normalize(e1 - dot(e1, normal) * normal);
+    info.dpdv = cross(normal, info.dpdu);
+    info.u = barycentric.y;
+    info.v = barycentric.z;
+    info.materialID = vertex.w;
     return true;
 }
\ No newline at end of file
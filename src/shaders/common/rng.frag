@@ -1,3 +1,51 @@
+// sampler types, same as SamplerType in render_types.h
+const int SAMPLER_XORSHIFT = 0;
+const int SAMPLER_SOBOL = 1;
+const int SAMPLER_BLUE_NOISE = 2;
+const int SAMPLER_PCG = 3;
+
+// blue noise texture size, same as BlueNoise::SIZE in blue_noise.h
+const int BLUE_NOISE_SIZE = 64;
+
+// sample index of current path and dimension inside current bounce
+// dimensions are grouped by 4, each group is a 4D Sobol point
+uint SAMPLE_INDEX = 0u;
+uint SAMPLE_BOUNCE = 0u;
+uint SAMPLE_DIMENSION = 0u;
+uint PIXEL_SEED = 0u;
+
+// Sobol direction numbers of dimension 1 to 3(Joe and Kuo)
+// dimension 0 is bit reversal of index
+const uint SOBOL_DIRECTIONS[96] = uint[](
+    // dimension 1
+    0x80000000u, 0xc0000000u, 0xa0000000u, 0xf0000000u,
+    0x88000000u, 0xcc000000u, 0xaa000000u, 0xff000000u,
+    0x80800000u, 0xc0c00000u, 0xa0a00000u, 0xf0f00000u,
+    0x88880000u, 0xcccc0000u, 0xaaaa0000u, 0xffff0000u,
+    0x80008000u, 0xc000c000u, 0xa000a000u, 0xf000f000u,
+    0x88008800u, 0xcc00cc00u, 0xaa00aa00u, 0xff00ff00u,
+    0x80808080u, 0xc0c0c0c0u, 0xa0a0a0a0u, 0xf0f0f0f0u,
+    0x88888888u, 0xccccccccu, 0xaaaaaaaau, 0xffffffffu,
+    // dimension 2
+    0x80000000u, 0xc0000000u, 0x60000000u, 0x90000000u,
+    0xe8000000u, 0x5c000000u, 0x8e000000u, 0xc5000000u,
+    0x68800000u, 0x9cc00000u, 0xee600000u, 0x55900000u,
+    0x80680000u, 0xc09c0000u, 0x60ee0000u, 0x90550000u,
+    0xe8808000u, 0x5cc0c000u, 0x8e606000u, 0xc5909000u,
+    0x6868e800u, 0x9c9c5c00u, 0xeeee8e00u, 0x5555c500u,
+    0x8000e880u, 0xc0005cc0u, 0x60008e60u, 0x9000c590u,
+    0xe8006868u, 0x5c009c9cu, 0x8e00eeeeu, 0xc5005555u,
+    // dimension 3
+    0x80000000u, 0xc0000000u, 0x20000000u, 0x50000000u,
+    0xf8000000u, 0x74000000u, 0xa2000000u, 0x93000000u,
+    0xd8800000u, 0x25400000u, 0x59e00000u, 0xe6d00000u,
+    0x78080000u, 0xb40c0000u, 0x82020000u, 0xc3050000u,
+    0x208f8000u, 0x51474000u, 0xfbea2000u, 0x75d93000u,
+    0xa0858800u, 0x914e5400u, 0xdbe79e00u, 0x25db6d00u,
+    0x58800080u, 0xe54000c0u, 0x79e00020u, 0xb6d00050u,
+    0x800800f8u, 0xc00c0074u, 0x200200a2u, 0x50050093u
+);
+
 uint xorshift32(inout XORShift32_state state) {
     uint x = state.a;
     x ^= x << 13u;
@@ -7,10 +55,134 @@ uint xorshift32(inout XORShift32_state state) {
     return x;
 }
 
+uint hash(uint x) {
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+uint hashCombine(uint seed, uint v) {
+    return seed ^ (hash(v) + (seed << 6u) + (seed >> 2u));
+}
+
+// counter based hash(Jarzynski and Olano 2020)
+uvec4 pcg4d(uvec4 v) {
+    v = v * 1664525u + 1013904223u;
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+    v ^= v >> 16u;
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+    return v;
+}
+
+uint reverseBits(uint x) {
+    x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+    x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+    x = ((x >> 4u) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4u);
+    x = ((x >> 8u) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8u);
+    return (x >> 16u) | (x << 16u);
+}
+
+// Owen scrambling by hashing(Burley 2020)
+uint laineKarrasPermutation(uint x, uint seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint nestedUniformScramble(uint x, uint seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+uint sobol(uint index, uint dimension) {
+    if(dimension == 0u) {
+        return reverseBits(index);
+    }
+
+    uint x = 0u;
+    int offset = 32 * int(dimension - 1u);
+    for(int bit = 0; index != 0u; index >>= 1u, ++bit) {
+        if((index & 1u) != 0u) {
+            x ^= SOBOL_DIRECTIONS[offset + bit];
+        }
+    }
+    return x;
+}
+
+// shuffled and scrambled Sobol, seed decorrelates dimension groups
+uint scrambledSobol(uint seed) {
+    uint group = SAMPLE_DIMENSION / 4u;
+    uint dimension = SAMPLE_DIMENSION % 4u;
+    uint groupSeed = hashCombine(hashCombine(seed, SAMPLE_BOUNCE), group);
+
+    uint index = nestedUniformScramble(SAMPLE_INDEX, groupSeed);
+    return nestedUniformScramble(sobol(index, dimension), hashCombine(groupSeed, dimension));
+}
+
+// per pixel offset from blue noise, shifted toroidally for each dimension
+float blueNoise() {
+    uint shift = hash(hashCombine(SAMPLE_BOUNCE, SAMPLE_DIMENSION));
+    ivec2 p = (ivec2(gl_FragCoord.xy) + ivec2(shift & 0xffffu, shift >> 16u)) % BLUE_NOISE_SIZE;
+    return texelFetch(blueNoiseTexture, p, 0).x;
+}
+
 float random() {
+    if(samplerType == SAMPLER_PCG) {
+        uint dimension = hashCombine(hashCombine(randomSeed, SAMPLE_BOUNCE), SAMPLE_DIMENSION);
+        uint x = pcg4d(uvec4(uvec2(gl_FragCoord.xy), SAMPLE_INDEX, dimension)).x;
+        SAMPLE_DIMENSION++;
+        return float(x >> 8u) * 5.9604645e-8;
+    }
+    else if(samplerType == SAMPLER_SOBOL) {
+        uint x = scrambledSobol(PIXEL_SEED);
+        SAMPLE_DIMENSION++;
+        return float(x >> 8u) * 5.9604645e-8;
+    }
+    else if(samplerType == SAMPLER_BLUE_NOISE) {
+        // same sequence for all pixels, rotated by blue noise
+        uint x = scrambledSobol(randomSeed);
+        float u = fract(float(x >> 8u) * 5.9604645e-8 + blueNoise());
+        SAMPLE_DIMENSION++;
+        return u;
+    }
+
     return float(xorshift32(RNG_STATE)) * 2.3283064e-10;
 }
 
 void setSeed(in vec2 uv) {
-    RNG_STATE.a = texture(stateTexture, uv).x;
+    PIXEL_SEED = hashCombine(randomSeed, uint(gl_FragCoord.x) + 0x10000u * uint(gl_FragCoord.y));
+
+    // only xorshift32 carries state between passes
+    if(samplerType == SAMPLER_XORSHIFT) {
+        RNG_STATE.a = texture(stateTexture, uv).x;
+        // state is zero after resize, seed it on first pass
+        if(RNG_STATE.a == 0u) {
+            RNG_STATE.a = max(hash(PIXEL_SEED), 1u);
+        }
+    }
+}
+
+// start index-th sample of the pixel from camera
+void startSample(in uint index) {
+    SAMPLE_INDEX = index;
+    SAMPLE_BOUNCE = 0u;
+    SAMPLE_DIMENSION = 0u;
+}
+
+// dimensions of each bounce are decorrelated by bounce number, so that
+// bounces using different number of dimensions do not shift later ones
+void startBounce(in int depth) {
+    SAMPLE_BOUNCE = uint(depth + 1);
+    SAMPLE_DIMENSION = 0u;
 }
\ No newline at end of file
@@ -14,16 +14,27 @@ vec3 sampleCosineHemisphere(in float u, in float v, out float pdf) {
     return vec3(cos(phi) * sin(theta), y, sin(phi) * sin(theta));
 }
 
-vec3 samplePlane(in float u, in float v, in vec3 leftCornerPoint, in vec3 right, in vec3 up, out vec3 normal, out vec3 dpdu, out vec3 dpdv, out float pdf_area) {
-    normal = normalize(cross(right, up));
-    dpdu = normalize(right);
-    dpdv = normalize(up);
-    pdf_area = 1.0 / (length(right) * length(up));
-    return leftCornerPoint + u*right + v*up;
+vec3 samplePlane(in float u, in float v, in int plane, out vec3 normal, out vec3 dpdu, out vec3 dpdv, out float pdf_area) {
+    ivec4 texel0 = texelFetch(planeBuffer, 4 * plane);
+    ivec4 texel1 = texelFetch(planeBuffer, 4 * plane + 1);
+    ivec4 texel2 = texelFetch(planeBuffer, 4 * plane + 2);
+    ivec4 texel3 = texelFetch(planeBuffer, 4 * plane + 3);
+    float rightLengthInv = intBitsToFloat(texel2.w);
+    float upLengthInv = intBitsToFloat(texel3.w);
+
+    normal = intBitsToFloat(texel1.xyz);
+    dpdu = intBitsToFloat(texel2.xyz);
+    dpdv = intBitsToFloat(texel3.xyz);
+    pdf_area = rightLengthInv * upLengthInv;
+    return intBitsToFloat(texel0.xyz) + (u / rightLengthInv) * dpdu + (v / upLengthInv) * dpdv;
 }
 
-vec3 sampleSphere(in float u, in float v, in vec3 center, in float radius, out vec3 normal, out vec3 dpdu, out vec3 dpdv, out float pdf_area) {
-    pdf_area = 1.0 / (4.0 * PI * radius * radius);
+vec3 sampleSphere(in float u, in float v, in int sphere, out vec3 normal, out vec3 dpdu, out vec3 dpdv, out float pdf_area) {
+    ivec4 texel0 = texelFetch(sphereBuffer, 2 * sphere);
+    vec3 center = intBitsToFloat(texel0.xyz);
+    float radius = intBitsToFloat(texelFetch(sphereBuffer, 2 * sphere + 1).x);
+
+    pdf_area = 1.0 / (4.0 * PI * intBitsToFloat(texel0.w));
     float theta = acos(1.0 - 2.0 * u);
     float phi = 2.0 * PI * v;
     float sinPhi = sin(phi);
@@ -36,13 +47,68 @@ vec3 sampleSphere(in float u, in float v, in vec3 center, in float radius, out v
     return center + r;
 }
 
-vec3 samplePointOnPrimitive(in Primitive primitive, out vec3 normal, out vec3 dpdu, out vec3 dpdv, out float pdf_area) {
-    switch(primitive.type) {
-        // Sphere
-        case 0:
-        return sampleSphere(random(), random(), primitive.center, primitive.radius, normal, dpdu, dpdv, pdf_area);
-        // Plane
-        case 1:
-        return samplePlane(random(), random(), primitive.leftCornerPoint, primitive.right, primitive.up, normal, dpdu, dpdv, pdf_area);
+vec3 sampleTriangle(in float u, in float v, in int triangle, out vec3 normal, out vec3 dpdu, out vec3 dpdv, out float pdf_area) {
+    ivec4 vertex = texelFetch(triangleBuffer, 2 * triangle);
+    vec3 p0 = texelFetch(vertexBuffer, vertex.x).xyz;
+    vec3 p1 = texelFetch(vertexBuffer, vertex.y).xyz;
+    vec3 p2 = texelFetch(vertexBuffer, vertex.z).xyz;
+
+    vec3 e1 = p1 - p0;
+    vec3 e2 = p2 - p0;
+    vec3 n = cross(e1, e2);
+    normal = normalize(n);
+    dpdu = normalize(e1);
+    dpdv = cross(normal, dpdu);
+    pdf_area = 2.0 / length(n);
+
+    // uniform barycentric coordinates
+    float su = sqrt(u);
+    return p0 + (1.0 - su) * e1 + v * su * e2;
+}
+
+vec3 samplePointOnPrimitive(in int primID, out vec3 normal, out vec3 dpdu, out vec3 dpdv, out float pdf_area) {
+    int index = primID & PRIMITIVE_INDEX_MASK;
+    switch(PRIMITIVE_TYPE(primID)) {
+#if HAS_SPHERE
+        case PRIMITIVE_SPHERE:
+        return sampleSphere(random(), random(), index, normal, dpdu, dpdv, pdf_area);
+#endif
+#if HAS_PLANE
+        case PRIMITIVE_PLANE:
+        return samplePlane(random(), random(), index, normal, dpdu, dpdv, pdf_area);
+#endif
+#if HAS_TRIANGLE
+        case PRIMITIVE_TRIANGLE:
+        return sampleTriangle(random(), random(), index, normal, dpdu, dpdv, pdf_area);
+#endif
     }
+}
+
+// sample point on light, mesh light first picks a triangle by area
+// primID is the sampled primitive, pdf_area is w.r.t. area of whole light
+vec3 samplePointOnLight(in Light light, out int primID, out vec3 normal, out vec3 dpdu, out vec3 dpdv, out float pdf_area) {
+    primID = light.primID;
+    float pdf_choice = 1.0;
+    if(light.n_triangles > 0) {
+        // first triangle whose CDF exceeds u, zero area triangles are never picked
+        float u = random();
+        int lo = 0;
+        int hi = light.n_triangles - 1;
+        while(lo < hi) {
+            int mid = (lo + hi) / 2;
+            if(texelFetch(lightCDFBuffer, light.cdf_offset + mid).x <= u) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        float cdf_prev = lo > 0 ? texelFetch(lightCDFBuffer, light.cdf_offset + lo - 1).x : 0.0;
+        pdf_choice = texelFetch(lightCDFBuffer, light.cdf_offset + lo).x - cdf_prev;
+        // references of consecutive triangles are consecutive
+        primID += lo;
+    }
+
+    vec3 x = samplePointOnPrimitive(primID, normal, dpdu, dpdv, pdf_area);
+    pdf_area *= pdf_choice;
+    return x;
 }
\ No newline at end of file
@@ -1,5 +1,31 @@
 uniform sampler2D accumTexture;
 uniform usampler2D stateTexture;
+uniform int samplesPerPass;
+// max number of bounces
+uniform int maxDepth;
+
+// sampler type, global seed and blue noise for SAMPLER_BLUE_NOISE,
+// see rng.frag
+uniform int samplerType;
+uniform uint randomSeed;
+uniform sampler2D blueNoiseTexture;
+
+// adaptive sampling
+uniform sampler2D momentsTexture;
+uniform float adaptiveThreshold;
+uniform int adaptiveMinSamples;
+
+// SphereRecord: 2 texels, PlaneRecord: 4 texels, BVHNode: 2 texels,
+// Triangle: 2 texels, see scene.h, bvh.h and obj_loader.h
+uniform isamplerBuffer sphereBuffer;
+uniform isamplerBuffer planeBuffer;
+uniform isamplerBuffer bvhNodeBuffer;
+uniform isamplerBuffer bvhIndexBuffer;
+uniform samplerBuffer vertexBuffer;
+uniform samplerBuffer normalBuffer;
+uniform isamplerBuffer triangleBuffer;
+// area CDF of triangles of mesh lights
+uniform samplerBuffer lightCDFBuffer;
 
 layout(std140) uniform GlobalBlock {
   uvec2 resolution;
@@ -15,13 +41,11 @@ layout(std140) uniform CameraBlock {
 } camera;
 
 const int MAX_N_MATERIALS = 100;
-const int MAX_N_PRIMITIVES = 100;
 const int MAX_N_LIGHTS = 100;
 layout(std140) uniform SceneBlock {
   int n_materials;
   int n_primitives;
   int n_lights;
   Material materials[MAX_N_MATERIALS];
-  Primitive primitives[MAX_N_PRIMITIVES];
   Light lights[MAX_N_LIGHTS];
 };
\ No newline at end of file
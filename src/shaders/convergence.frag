@@ -0,0 +1,27 @@
+#version 330 core
+
+#include common/adaptive.frag
+
+uniform sampler2D momentsTexture;
+uniform float adaptiveThreshold;
+uniform int adaptiveMinSamples;
+
+in vec2 texCoord;
+out vec4 fragColor;
+
+void main() {
+  vec4 moments = texture(momentsTexture, texCoord);
+
+  // converged pixels are dark green, active pixels are colored by error
+  // relative to threshold(blue: close to threshold, red: far from it)
+  vec3 color;
+  if(isConverged(moments, adaptiveThreshold, adaptiveMinSamples)) {
+    color = vec3(0.0, 0.25, 0.0);
+  } else {
+    float threshold = adaptiveThreshold > 0.0 ? adaptiveThreshold : 0.01;
+    float x = clamp(log2(relativeError(moments) / threshold) / 4.0, 0.0, 1.0);
+    color = mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), x);
+  }
+
+  fragColor = vec4(color, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#version 330 core
+
+#include common/adaptive.frag
+
+uniform sampler2D accumTexture;
+uniform sampler2D momentsTexture;
+
+in vec2 texCoord;
+// (mean radiance, variance of mean luminance)
+out vec4 fragColor;
+
+void main() {
+    vec4 moments = texture(momentsTexture, texCoord);
+    if(moments.z <= 0.0) {
+        fragColor = vec4(0);
+        return;
+    }
+
+    vec3 color = texture(accumTexture, texCoord).rgb / moments.z;
+    fragColor = vec4(color, varianceOfMean(moments));
+}
\ No newline at end of file
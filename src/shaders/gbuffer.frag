@@ -0,0 +1,45 @@
+#version 330 core
+
+#include common/global.frag
+#include common/uniform.frag
+#include common/raygen.frag
+#include common/util.frag
+#include common/intersect.frag
+#include common/closest_hit.frag
+
+in vec2 texCoord;
+
+// primary hit of pixel center, see common/gbuffer.frag
+layout (location = 0) out vec4 position;
+layout (location = 1) out vec4 normal;
+layout (location = 2) out vec4 albedo;
+layout (location = 3) out vec4 uv;
+layout (location = 4) out uint primitive;
+
+void main() {
+    // generate initial ray through pixel center
+    vec2 sensorUV = (2.0*gl_FragCoord.xy - resolution) * resolutionYInv;
+    sensorUV.y = -sensorUV.y;
+    float pdf;
+    Ray ray = rayGen(sensorUV, pdf);
+
+    float depth = 0.0;
+    position = vec4(0);
+    normal = vec4(0);
+    albedo = vec4(0);
+    uv = vec4(0);
+    primitive = 0u;
+    IntersectInfo info;
+    if(intersect(ray, info)) {
+        Material hitMaterial = materials[info.materialID];
+        depth = info.t;
+        position = vec4(info.hitPos, depth);
+        normal = vec4(info.hitNormal, 0.0);
+        albedo.rgb = hitMaterial.kd;
+        uv = vec4(info.u, info.v, float(info.materialID), 0.0);
+        primitive = uint(info.primID);
+    }
+
+    // derivatives are taken outside of non-uniform branch
+    albedo.a = max(abs(dFdx(depth)), abs(dFdy(depth)));
+}
\ No newline at end of file
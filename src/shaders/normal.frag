@@ -1,26 +1,19 @@
 #version 330 core
 
 #include common/global.frag
-#include common/uniform.frag
-#include common/raygen.frag
-#include common/util.frag
-#include common/intersect.frag
-#include common/closest_hit.frag
+#include common/gbuffer.frag
 
 in vec2 texCoord;
 out vec4 fragColor;
 
 void main() {
-    // generate initial ray
-    vec2 uv = (2.0*gl_FragCoord.xy - resolution) * resolutionYInv;
-    uv.y = -uv.y;
-    float pdf;
-    Ray ray = rayGen(uv, pdf);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 position = texelFetch(gbufferPosition, pixel, 0);
 
     vec3 color = vec3(0);
-    IntersectInfo info;
-    if(intersect(ray, info)) {
-      color = 0.5 * (info.hitNormal + 1.0);
+    if(position.w > 0.0) {
+        vec4 normal = texelFetch(gbufferNormal, pixel, 0);
+        color = 0.5 * (normal.xyz + 1.0);
     }
 
     fragColor = vec4(color, 1.0);
@@ -1,12 +1,22 @@
 #version 330 core
 
-uniform float samplesInv;
 uniform sampler2D accumTexture;
+// number of samples of each pixel in z
+uniform sampler2D momentsTexture;
+// filtered mean, see atrous.frag
+uniform sampler2D denoisedTexture;
+uniform bool denoise;
 
 in vec2 texCoord;
 out vec4 fragColor;
 
 void main() {
-  vec3 color = texture(accumTexture, texCoord).xyz * samplesInv;
+  vec3 color;
+  if(denoise) {
+    color = texture(denoisedTexture, texCoord).xyz;
+  } else {
+    float samples = texture(momentsTexture, texCoord).z;
+    color = samples > 0.0 ? texture(accumTexture, texCoord).xyz / samples : vec3(0);
+  }
   fragColor = vec4(pow(color, vec3(0.4545)), 1.0);
 }
\ No newline at end of file
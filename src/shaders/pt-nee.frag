@@ -9,20 +9,23 @@
 #include common/closest_hit.frag
 #include common/sampling.frag
 #include common/brdf.frag
+#include common/adaptive.frag
+#include common/gbuffer.frag
 
 in vec2 texCoord;
 
-layout (location = 0) out vec3 color;
+layout (location = 0) out vec4 color;
 layout (location = 1) out uint state;
+layout (location = 2) out vec4 moments;
 
 bool sampleLight(in Light light, in IntersectInfo info, out vec3 wi, out float pdf) {
   // sample point on light primitive
-  Primitive primitive = primitives[light.primID];
   vec3 normal;
   vec3 dpdu;
   vec3 dpdv;
   float pdf_area;
-  vec3 sampledPos = samplePointOnPrimitive(primitive, normal, dpdu, dpdv, pdf_area);
+  int primID;
+  vec3 sampledPos = samplePointOnLight(light, primID, normal, dpdu, dpdv, pdf_area);
 
   // test visibility
   wi = normalize(sampledPos - info.hitPos);
@@ -32,7 +35,7 @@ bool sampleLight(in Light light, in IntersectInfo info, out vec3 wi, out float p
 
   Ray shadowRay = Ray(info.hitPos, wi);
   IntersectInfo shadowInfo;
-  if(intersect(shadowRay, shadowInfo) && shadowInfo.primID == light.primID && distance(shadowInfo.hitPos, sampledPos) < 0.1) {
+  if(intersect(shadowRay, shadowInfo) && shadowInfo.primID == primID && distance(shadowInfo.hitPos, sampledPos) < 0.1) {
     // convert area p.d.f. to solid angle p.d.f.
     float r = shadowInfo.t;
     float cos_term = abs(dot(-wi, normal));
@@ -50,7 +53,9 @@ vec3 computeRadiance(in Ray ray_in) {
     vec3 color = vec3(0);
     vec3 throughput = vec3(1);
     bool is_previous_specular = false;
-    for(int i = 0; i < MAX_DEPTH; ++i) {
+    for(int i = 0; i < maxDepth; ++i) {
+        startBounce(i);
+
         // russian roulette
         if(random() >= russian_roulette_prob) {
             break;
@@ -58,9 +63,9 @@ vec3 computeRadiance(in Ray ray_in) {
         throughput /= russian_roulette_prob;
 
         IntersectInfo info;
-        if(intersect(ray, info)) {
-            Primitive hitPrimitive = primitives[info.primID];
-            Material hitMaterial = materials[hitPrimitive.material_id];
+        bool hit = i == 0 && primaryCache ? primaryHit(ivec2(gl_FragCoord.xy), info) : intersect(ray, info);
+        if(hit) {
+            Material hitMaterial = materials[info.materialID];
             vec3 wo = -ray.direction;
             vec3 wo_local = worldToLocal(wo, info.dpdu, info.hitNormal, info.dpdv);
 
@@ -71,7 +76,7 @@ vec3 computeRadiance(in Ray ray_in) {
             }
 
             // Light Sampling
-            if(hitMaterial.brdf_type == 0) {
+            if(BRDF_TYPE(hitMaterial) == 0) {
               for(int k = 0; k < n_lights; ++k) {
                 Light light = lights[k];
                 vec3 wi_light;
@@ -108,7 +113,7 @@ vec3 computeRadiance(in Ray ray_in) {
             // set next ray
             ray = Ray(info.hitPos, wi);
 
-            is_previous_specular = (hitMaterial.brdf_type != 0);
+            is_previous_specular = (BRDF_TYPE(hitMaterial) != 0);
         }
         else {
             color += throughput * vec3(0);
@@ -120,19 +125,41 @@ vec3 computeRadiance(in Ray ray_in) {
 }
 
 void main() {
+    // skip converged pixel, accumulated values are kept
+    vec4 prevMoments = texture(momentsTexture, texCoord);
+    if(isConverged(prevMoments, adaptiveThreshold, adaptiveMinSamples)) {
+        discard;
+    }
+
     // set RNG seed
     setSeed(texCoord);
 
-    // generate initial ray
-    vec2 uv = (2.0*(gl_FragCoord.xy + vec2(random(), random())) - resolution) * resolutionYInv;
-    uv.y = -uv.y;
-    float pdf;
-    Ray ray = rayGen(uv, pdf);
-    float cos_term = dot(camera.camForward, ray.direction);
+    vec3 radiance = vec3(0);
+    vec2 lumMoments = vec2(0);
+    for(int k = 0; k < samplesPerPass; ++k) {
+        startSample(uint(prevMoments.z) + uint(k));
+
+        // generate initial ray
+        // cached primary hit is at pixel center
+        vec2 jitter = primaryCache ? vec2(0) : vec2(random(), random());
+        vec2 uv = (2.0*(gl_FragCoord.xy + jitter) - resolution) * resolutionYInv;
+        uv.y = -uv.y;
+        float pdf;
+        Ray ray = rayGen(uv, pdf);
+        float cos_term = dot(camera.camForward, ray.direction);
+
+        vec3 L = computeRadiance(ray) / pdf * cos_term;
+        radiance += L;
+
+        float lum = luminance(L);
+        lumMoments += vec2(lum, lum * lum);
+    }
+
+    // accumulate sampled color and number of rays on accumTexture
+    color = texture(accumTexture, texCoord) + vec4(radiance, RAY_COUNT);
 
-    // accumulate sampled color on accumTexture
-    vec3 radiance = computeRadiance(ray) / pdf;
-    color = texture(accumTexture, texCoord).xyz + radiance * cos_term;
+    // accumulate luminance moments and number of samples
+    moments = prevMoments + vec4(lumMoments, samplesPerPass, 0);
 
     // save RNG state on stateTexture
     state = RNG_STATE.a;
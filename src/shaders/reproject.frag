@@ -0,0 +1,76 @@
+#version 330 core
+
+#include common/global.frag
+#include common/uniform.frag
+#include common/gbuffer.frag
+
+// G-buffer position and normal of previous view
+uniform sampler2D previousPosition;
+uniform sampler2D previousNormal;
+
+// camera of previous view, same layout as CameraBlock
+uniform vec3 prevCamPos;
+uniform vec3 prevCamForward;
+uniform vec3 prevCamRight;
+uniform vec3 prevCamUp;
+uniform float prevCamA;
+
+// number of samples kept from history
+uniform float maxHistory;
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 color;
+layout (location = 1) out vec4 moments;
+
+// inverse of rayGen() for previous camera
+bool projectToPrevious(in vec3 p, out vec2 fragCoord) {
+    vec3 d = normalize(p - prevCamPos);
+    float cos_term = dot(d, prevCamForward);
+    if(cos_term <= 0.0) {
+        return false;
+    }
+
+    float k = prevCamA / cos_term;
+    vec2 uv = -k * vec2(dot(d, prevCamRight), dot(d, prevCamUp));
+    uv.y = -uv.y;
+    fragCoord = 0.5 * (uv / resolutionYInv + vec2(resolution));
+    return all(greaterThanEqual(fragCoord, vec2(0))) && all(lessThan(fragCoord, vec2(resolution)));
+}
+
+void main() {
+    color = vec4(0);
+    moments = vec4(0);
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 position = texelFetch(gbufferPosition, pixel, 0);
+    if(position.w <= 0.0) {
+        return;
+    }
+
+    vec2 prevFragCoord;
+    if(!projectToPrevious(position.xyz, prevFragCoord)) {
+        return;
+    }
+    ivec2 prevPixel = ivec2(prevFragCoord);
+
+    // reject disoccluded or different surface
+    vec4 prevPosition = texelFetch(previousPosition, prevPixel, 0);
+    vec3 normal = texelFetch(gbufferNormal, pixel, 0).xyz;
+    vec3 prevNormal = texelFetch(previousNormal, prevPixel, 0).xyz;
+    if(prevPosition.w <= 0.0 || dot(normal, prevNormal) < 0.9) {
+        return;
+    }
+    if(distance(position.xyz, prevPosition.xyz) > 0.01 * position.w) {
+        return;
+    }
+
+    // clamp history length so that new samples are not washed out
+    vec4 prevMoments = texelFetch(momentsTexture, prevPixel, 0);
+    if(prevMoments.z <= 0.0) {
+        return;
+    }
+    float scale = min(maxHistory / prevMoments.z, 1.0);
+    color = scale * texelFetch(accumTexture, prevPixel, 0);
+    moments = vec4(scale * prevMoments.xyz, 0);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 330 core
+
+// sum of number of samples over blocks of pixels, see
+// Renderer::startSampleSum()
+// same as Renderer::SAMPLE_SUM_BLOCK_SIZE
+const int BLOCK_SIZE = 16;
+
+uniform sampler2D momentsTexture;
+
+out float sum;
+
+void main() {
+    // blocks at right and top border are partial
+    ivec2 size = textureSize(momentsTexture, 0);
+    ivec2 origin = ivec2(gl_FragCoord.xy) * BLOCK_SIZE;
+    ivec2 end = min(origin + BLOCK_SIZE, size);
+
+    float s = 0.0;
+    for(int y = origin.y; y < end.y; ++y) {
+        for(int x = origin.x; x < end.x; ++x) {
+            s += texelFetch(momentsTexture, ivec2(x, y), 0).z;
+        }
+    }
+    sum = s;
+}
\ No newline at end of file
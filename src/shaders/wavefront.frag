@@ -0,0 +1,151 @@
+#version 330 core
+
+#include common/global.frag
+#include common/uniform.frag
+#include common/rng.frag
+#include common/raygen.frag
+#include common/util.frag
+#include common/intersect.frag
+#include common/closest_hit.frag
+#include common/sampling.frag
+#include common/brdf.frag
+#include common/adaptive.frag
+
+// path state of each pixel, advanced one bounce per pass
+// origin: (ray origin, russian roulette probability)
+// direction: (ray direction, depth)
+// throughput: (throughput, 1 if path is alive)
+uniform sampler2D pathOriginTexture;
+uniform sampler2D pathDirectionTexture;
+uniform sampler2D pathThroughputTexture;
+
+in vec2 texCoord;
+
+layout (location = 0) out vec4 color;
+layout (location = 1) out uint state;
+layout (location = 2) out vec4 moments;
+layout (location = 3) out vec4 pathOrigin;
+layout (location = 4) out vec4 pathDirection;
+layout (location = 5) out vec4 pathThroughput;
+
+// start index-th path from camera, camera weight is folded into throughput
+void generatePath(in uint index) {
+    startSample(index);
+
+    vec2 uv = (2.0*(gl_FragCoord.xy + vec2(random(), random())) - resolution) * resolutionYInv;
+    uv.y = -uv.y;
+    float pdf;
+    Ray ray = rayGen(uv, pdf);
+    float cos_term = dot(camera.camForward, ray.direction);
+
+    pathOrigin = vec4(ray.origin, 1.0);
+    pathDirection = vec4(ray.direction, 0.0);
+    pathThroughput = vec4(vec3(cos_term / pdf), 1.0);
+}
+
+// advance path one bounce, return true when path is terminated
+// L is the radiance of the terminated path
+bool advancePath(out vec3 L) {
+    L = vec3(0);
+
+    Ray ray = Ray(pathOrigin.xyz, pathDirection.xyz);
+    float russian_roulette_prob = pathOrigin.w;
+    float depth = pathDirection.w;
+    vec3 throughput = pathThroughput.rgb;
+
+    startBounce(int(depth));
+
+    // russian roulette
+    if(depth >= float(maxDepth) || random() >= russian_roulette_prob) {
+        return true;
+    }
+    throughput /= russian_roulette_prob;
+
+    IntersectInfo info;
+    if(!intersect(ray, info)) {
+        return true;
+    }
+
+    Material hitMaterial = materials[info.materialID];
+
+    // Le
+    if(any(greaterThan(hitMaterial.le, vec3(0)))) {
+        L = throughput * hitMaterial.le;
+        return true;
+    }
+
+    // BRDF Sampling
+    vec3 wo = -ray.direction;
+    vec3 wo_local = worldToLocal(wo, info.dpdu, info.hitNormal, info.dpdv);
+    float pdf;
+    vec3 wi_local;
+    vec3 brdf = sampleBRDF(wo_local, wi_local, hitMaterial, pdf);
+    // prevent NaN
+    if(pdf == 0.0) {
+        return true;
+    }
+    vec3 wi = localToWorld(wi_local, info.dpdu, info.hitNormal, info.dpdv);
+
+    // update throughput
+    float cos_term = abs(wi_local.y);
+    throughput *= brdf * cos_term / pdf;
+
+    // update russian roulette probability
+    russian_roulette_prob = min(max(max(throughput.x, throughput.y), throughput.z), 1.0);
+
+    // set next ray
+    pathOrigin = vec4(info.hitPos, russian_roulette_prob);
+    pathDirection = vec4(wi, depth + 1.0);
+    pathThroughput = vec4(throughput, 1.0);
+    return false;
+}
+
+void main() {
+    vec4 prevMoments = texture(momentsTexture, texCoord);
+    pathOrigin = texture(pathOriginTexture, texCoord);
+    pathDirection = texture(pathDirectionTexture, texCoord);
+    pathThroughput = texture(pathThroughputTexture, texCoord);
+
+    // converged pixel does not start new path
+    bool alive = pathThroughput.a > 0.0;
+    if(!alive && isConverged(prevMoments, adaptiveThreshold, adaptiveMinSamples)) {
+        discard;
+    }
+
+    // set RNG seed
+    setSeed(texCoord);
+
+    // one path in flight, its index is the number of finished paths
+    if(alive) {
+        startSample(uint(prevMoments.z));
+    }
+    else {
+        generatePath(uint(prevMoments.z));
+    }
+
+    vec3 radiance = vec3(0);
+    vec3 lumMoments = vec3(0);
+    vec3 L;
+    if(advancePath(L)) {
+        radiance = L;
+        float lum = luminance(L);
+        lumMoments = vec3(lum, lum * lum, 1.0);
+
+        // regenerate on termination
+        if(isConverged(prevMoments + vec4(lumMoments, 0), adaptiveThreshold, adaptiveMinSamples)) {
+            pathThroughput = vec4(0);
+        }
+        else {
+            generatePath(uint(prevMoments.z) + 1u);
+        }
+    }
+
+    // accumulate radiance of terminated path and number of rays
+    color = texture(accumTexture, texCoord) + vec4(radiance, RAY_COUNT);
+
+    // accumulate luminance moments and number of samples
+    moments = prevMoments + vec4(lumMoments, 0);
+
+    // save RNG state on stateTexture
+    state = RNG_STATE.a;
+}
\ No newline at end of file
@@ -0,0 +1,158 @@
+#ifndef _SIMD_H
+#define _SIMD_H
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+
+// float lanes of the widest instruction set enabled at compile time
+// AVX2: 8 lanes, SSE2: 4 lanes, otherwise 1 lane of plain float
+// comparisons return masks, lanes of a mask are all ones or all zeros
+namespace simd {
+
+#if defined(SIMD_AVX2)
+
+constexpr int WIDTH = 8;
+
+struct FloatV {
+  __m256 v;
+
+  FloatV() {}
+  FloatV(__m256 v) : v(v) {}
+  FloatV(float f) : v(_mm256_set1_ps(f)) {}
+
+  static FloatV load(const float* ptr) { return _mm256_load_ps(ptr); }
+  void store(float* ptr) const { _mm256_store_ps(ptr, v); }
+};
+
+inline FloatV operator+(FloatV a, FloatV b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatV operator-(FloatV a, FloatV b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatV operator*(FloatV a, FloatV b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatV operator/(FloatV a, FloatV b) { return _mm256_div_ps(a.v, b.v); }
+inline FloatV operator-(FloatV a) {
+  return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f));
+}
+inline FloatV operator<(FloatV a, FloatV b) {
+  return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);
+}
+inline FloatV operator<=(FloatV a, FloatV b) {
+  return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ);
+}
+inline FloatV operator>(FloatV a, FloatV b) {
+  return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ);
+}
+inline FloatV operator>=(FloatV a, FloatV b) {
+  return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ);
+}
+inline FloatV operator&(FloatV a, FloatV b) { return _mm256_and_ps(a.v, b.v); }
+inline FloatV operator|(FloatV a, FloatV b) { return _mm256_or_ps(a.v, b.v); }
+inline FloatV sqrt(FloatV a) { return _mm256_sqrt_ps(a.v); }
+inline FloatV min(FloatV a, FloatV b) { return _mm256_min_ps(a.v, b.v); }
+inline FloatV max(FloatV a, FloatV b) { return _mm256_max_ps(a.v, b.v); }
+// mask ? a : b
+inline FloatV select(FloatV mask, FloatV a, FloatV b) {
+  return _mm256_blendv_ps(b.v, a.v, mask.v);
+}
+// bit i is set when lane i of mask is set
+inline int movemask(FloatV mask) { return _mm256_movemask_ps(mask.v); }
+
+#elif defined(SIMD_SSE2)
+
+constexpr int WIDTH = 4;
+
+struct FloatV {
+  __m128 v;
+
+  FloatV() {}
+  FloatV(__m128 v) : v(v) {}
+  FloatV(float f) : v(_mm_set1_ps(f)) {}
+
+  static FloatV load(const float* ptr) { return _mm_load_ps(ptr); }
+  void store(float* ptr) const { _mm_store_ps(ptr, v); }
+};
+
+inline FloatV operator+(FloatV a, FloatV b) { return _mm_add_ps(a.v, b.v); }
+inline FloatV operator-(FloatV a, FloatV b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatV operator*(FloatV a, FloatV b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatV operator/(FloatV a, FloatV b) { return _mm_div_ps(a.v, b.v); }
+inline FloatV operator-(FloatV a) {
+  return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f));
+}
+inline FloatV operator<(FloatV a, FloatV b) { return _mm_cmplt_ps(a.v, b.v); }
+inline FloatV operator<=(FloatV a, FloatV b) { return _mm_cmple_ps(a.v, b.v); }
+inline FloatV operator>(FloatV a, FloatV b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline FloatV operator>=(FloatV a, FloatV b) { return _mm_cmpge_ps(a.v, b.v); }
+inline FloatV operator&(FloatV a, FloatV b) { return _mm_and_ps(a.v, b.v); }
+inline FloatV operator|(FloatV a, FloatV b) { return _mm_or_ps(a.v, b.v); }
+inline FloatV sqrt(FloatV a) { return _mm_sqrt_ps(a.v); }
+inline FloatV min(FloatV a, FloatV b) { return _mm_min_ps(a.v, b.v); }
+inline FloatV max(FloatV a, FloatV b) { return _mm_max_ps(a.v, b.v); }
+// mask ? a : b, SSE2 has no blendv
+inline FloatV select(FloatV mask, FloatV a, FloatV b) {
+  return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+inline int movemask(FloatV mask) { return _mm_movemask_ps(mask.v); }
+
+#else
+
+constexpr int WIDTH = 1;
+
+struct FloatV {
+  float v;
+
+  FloatV() {}
+  FloatV(float f) : v(f) {}
+
+  static FloatV load(const float* ptr) { return *ptr; }
+  void store(float* ptr) const { *ptr = v; }
+};
+
+// mask is stored as float with all bits set
+inline FloatV maskOf(bool b) {
+  const std::uint32_t bits = b ? 0xffffffffu : 0u;
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+inline bool isSet(FloatV mask) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &mask.v, sizeof(bits));
+  return bits != 0;
+}
+
+inline FloatV operator+(FloatV a, FloatV b) { return a.v + b.v; }
+inline FloatV operator-(FloatV a, FloatV b) { return a.v - b.v; }
+inline FloatV operator*(FloatV a, FloatV b) { return a.v * b.v; }
+inline FloatV operator/(FloatV a, FloatV b) { return a.v / b.v; }
+inline FloatV operator-(FloatV a) { return -a.v; }
+inline FloatV operator<(FloatV a, FloatV b) { return maskOf(a.v < b.v); }
+inline FloatV operator<=(FloatV a, FloatV b) { return maskOf(a.v <= b.v); }
+inline FloatV operator>(FloatV a, FloatV b) { return maskOf(a.v > b.v); }
+inline FloatV operator>=(FloatV a, FloatV b) { return maskOf(a.v >= b.v); }
+inline FloatV operator&(FloatV a, FloatV b) {
+  return maskOf(isSet(a) && isSet(b));
+}
+inline FloatV operator|(FloatV a, FloatV b) {
+  return maskOf(isSet(a) || isSet(b));
+}
+inline FloatV sqrt(FloatV a) { return std::sqrt(a.v); }
+inline FloatV min(FloatV a, FloatV b) { return a.v < b.v ? a.v : b.v; }
+inline FloatV max(FloatV a, FloatV b) { return a.v > b.v ? a.v : b.v; }
+inline FloatV select(FloatV mask, FloatV a, FloatV b) {
+  return isSet(mask) ? a : b;
+}
+inline int movemask(FloatV mask) { return isSet(mask) ? 1 : 0; }
+
+#endif
+
+}  // namespace simd
+
+#endif
\ No newline at end of file
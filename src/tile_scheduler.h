@@ -0,0 +1,118 @@
+#ifndef _TILE_SCHEDULER_H
+#define _TILE_SCHEDULER_H
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// splits image into tiles and hands them out in spiral order from the
+// center, so that neighboring dispatches touch neighboring pixels
+// each tile keeps its own number of samples
+class TileScheduler {
+ public:
+  struct Tile {
+    glm::uvec2 offset;
+    glm::uvec2 size;
+  };
+
+ private:
+  glm::uvec2 resolution;
+  glm::uvec2 tile_size;
+  glm::uvec2 n_tiles;
+  std::vector<unsigned int> order;
+  unsigned int cursor;
+  std::vector<float> samples;  // per tile
+
+  void setup() {
+    n_tiles = (resolution + tile_size - glm::uvec2(1)) / tile_size;
+    const unsigned int count = n_tiles.x * n_tiles.y;
+
+    // sort by ring around the center, then by angle inside the ring
+    const glm::vec2 center = 0.5f * glm::vec2(n_tiles - glm::uvec2(1));
+    std::vector<glm::vec2> keys(count);
+    order.resize(count);
+    for (unsigned int i = 0; i < count; ++i) {
+      const glm::vec2 d =
+          glm::vec2(i % n_tiles.x, i / n_tiles.x) - center;
+      keys[i] = glm::vec2(std::round(std::max(std::abs(d.x), std::abs(d.y))),
+                          std::atan2(d.y, d.x));
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](unsigned int a, unsigned int b) {
+                       if (keys[a].x != keys[b].x) return keys[a].x < keys[b].x;
+                       return keys[a].y < keys[b].y;
+                     });
+
+    samples.assign(count, 0);
+    cursor = 0;
+  }
+
+ public:
+  // tile_size 0 means whole image as a single tile
+  TileScheduler(const glm::uvec2& resolution, unsigned int tile_size = 0) {
+    resize(resolution, tile_size);
+  }
+
+  void resize(const glm::uvec2& resolution, unsigned int tile_size) {
+    this->resolution = resolution;
+    this->tile_size = tile_size == 0 ? resolution : glm::uvec2(tile_size);
+    setup();
+  }
+
+  // change tile size, every new tile gets the number of samples every pixel
+  // had at least
+  void retile(unsigned int tile_size) {
+    const float min_samples = getMinSamples();
+    resize(resolution, tile_size);
+    std::fill(samples.begin(), samples.end(), min_samples);
+  }
+
+  // restart from the center with no samples
+  void reset() {
+    std::fill(samples.begin(), samples.end(), 0.0f);
+    cursor = 0;
+  }
+
+  glm::uvec2 getTileSize() const { return tile_size; }
+  glm::uvec2 getNumberOfTiles() const { return n_tiles; }
+  unsigned int getTileCount() const { return order.size(); }
+  const std::vector<float>& getSamples() const { return samples; }
+
+  // number of samples every pixel has at least
+  unsigned int getMinSamples() const {
+    return *std::min_element(samples.begin(), samples.end());
+  }
+
+  // return index of next tile
+  unsigned int next() {
+    const unsigned int index = order[cursor];
+    cursor = (cursor + 1) % order.size();
+    return index;
+  }
+
+  Tile getTile(unsigned int index) const {
+    Tile tile;
+    tile.offset =
+        glm::uvec2(index % n_tiles.x, index / n_tiles.x) * tile_size;
+    tile.size = glm::min(tile_size, resolution - tile.offset);
+    return tile;
+  }
+
+  void addSamples(unsigned int index, unsigned int n) { samples[index] += n; }
+
+  // position in spiral order, saved with samples by checkpoints
+  unsigned int getCursor() const { return cursor; }
+  // false when number of tiles differs
+  bool restore(const std::vector<float>& samples, unsigned int cursor) {
+    if (samples.size() != this->samples.size() || cursor >= order.size()) {
+      return false;
+    }
+    this->samples = samples;
+    this->cursor = cursor;
+    return true;
+  }
+};
+
+#endif
\ No newline at end of file